@@ -87,4 +87,10 @@
 #define PTE_SMALL_AP_URO_SRW	(0xaa << 4)
 #define PTE_SMALL_AP_URW_SRW	(0xff << 4)
 
+/*
+ *   - extended large page
+ */
+#define PTE_LARGE_TEX(x)	((x) << 12)	/* v6 */
+#define PTE_LARGE_XN		(1 << 15)	/* v6 */
+
 #endif
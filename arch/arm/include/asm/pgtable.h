@@ -150,6 +150,17 @@ extern void __pgd_error(const char *file, int line, unsigned long val);
 #define SUPERSECTION_SIZE	(1UL << SUPERSECTION_SHIFT)
 #define SUPERSECTION_MASK	(~(SUPERSECTION_SIZE-1))
 
+/*
+ * ARMv6 large page size, used for vmalloc and ioremap areas.
+ */
+#define LARGEPAGE_SHIFT		16
+#define LARGEPAGE_SIZE		(1UL << LARGEPAGE_SHIFT)
+#define LARGEPAGE_MASK		(~(LARGEPAGE_SIZE-1))
+
+#ifdef CONFIG_ARM_VMAP_LARGE_PAGES
+#define VMAP_LARGE_ORDER	(LARGEPAGE_SHIFT - PAGE_SHIFT)
+#endif
+
 /*
  * "Linux" PTE definitions.
  *
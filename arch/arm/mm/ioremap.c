@@ -117,6 +117,77 @@ int ioremap_page(unsigned long virt, unsigned long phys,
 }
 EXPORT_SYMBOL(ioremap_page);
 
+#ifdef CONFIG_ARM_VMAP_LARGE_PAGES
+#define LARGEPAGE_PTES	(LARGEPAGE_SIZE >> PAGE_SHIFT)
+
+/*
+ * Large pages are described by sixteen identical hardware PTEs.  Linux
+ * keeps its own small page PTEs as they are, so the page table walkers
+ * and vunmap(), which clears the entries one at a time, are unaffected.
+ *
+ * Only the ARMv6 extended format is handled, whose large page descriptor
+ * holds the same attribute bits as the small page one, with XN and TEX
+ * moved up.
+ */
+static int vmap_large_pages_usable(void)
+{
+	return cpu_architecture() >= CPU_ARCH_ARMv6 && (get_cr() & CR_XP);
+}
+
+static int promote_large_page(pte_t *ptep)
+{
+	unsigned long *hwptep = (unsigned long *)(ptep - PTRS_PER_PTE);
+	unsigned long pte = pte_val(ptep[0]);
+	unsigned long small, large;
+	int i;
+
+	if (!pte_present(ptep[0]) || (pte_pfn(ptep[0]) & (LARGEPAGE_PTES - 1)))
+		return 0;
+	for (i = 1; i < LARGEPAGE_PTES; i++)
+		if (pte_val(ptep[i]) != pte + (i << PAGE_SHIFT))
+			return 0;
+
+	small = hwptep[0];
+	if (!(small & PTE_TYPE_SMALL))
+		return 0;
+
+	large = (small & LARGEPAGE_MASK) | PTE_TYPE_LARGE;
+	large |= small & (PTE_EXT_NG | PTE_EXT_SHARED | PTE_EXT_APX |
+			  PTE_EXT_AP_MASK | PTE_CACHEABLE | PTE_BUFFERABLE);
+	large |= PTE_LARGE_TEX((small >> 6) & 7);
+	if (small & PTE_EXT_XN)
+		large |= PTE_LARGE_XN;
+
+	for (i = 0; i < LARGEPAGE_PTES; i++)
+		hwptep[i] = large;
+	clean_dcache_area(hwptep, LARGEPAGE_PTES * sizeof(*hwptep));
+
+	return 1;
+}
+
+void arch_vmap_large_pages(unsigned long addr, unsigned long end)
+{
+	unsigned long start;
+	pmd_t *pmd;
+
+	if (!vmap_large_pages_usable())
+		return;
+
+	addr = ALIGN(addr, LARGEPAGE_SIZE);
+	for (start = addr; addr + LARGEPAGE_SIZE <= end;
+	     addr += LARGEPAGE_SIZE) {
+		pmd = pmd_offset(pgd_offset_k(addr), addr);
+		if ((pmd_val(*pmd) & PMD_TYPE_MASK) != PMD_TYPE_TABLE)
+			continue;
+		promote_large_page(pte_offset_kernel(pmd, addr));
+	}
+
+	/* Don't leave small page TLB entries overlapping the large ones */
+	if (addr > start)
+		flush_tlb_kernel_range(start, addr);
+}
+#endif /* CONFIG_ARM_VMAP_LARGE_PAGES */
+
 void __check_kvm_seq(struct mm_struct *mm)
 {
 	unsigned int seq;
@@ -141,6 +212,9 @@ void __check_kvm_seq(struct mm_struct *mm)
  *
  * Note that get_vm_area() allocates a guard 4K page, so we need to mask
  * the size back to 1MB aligned or we will overflow in the loop below.
+ *
+ * Only the 2MB aligned middle of an area is section mapped, the parts
+ * before and after it use page tables shared with the neighbouring areas.
  */
 static void unmap_area_sections(unsigned long virt, unsigned long size)
 {
@@ -252,6 +326,40 @@ remap_area_supersections(unsigned long virt, unsigned long pfn,
 
 	return 0;
 }
+
+static int
+remap_area_mixed(unsigned long virt, unsigned long pfn,
+		 size_t size, const struct mem_type *type)
+{
+	unsigned long sect_start = ALIGN(virt, PMD_SIZE);
+	unsigned long sect_end = (virt + size) & PMD_MASK;
+	int err = 0;
+
+	if (sect_start > virt)
+		err = remap_area_pages(virt, pfn, sect_start - virt, type);
+	if (!err)
+		err = remap_area_sections(sect_start,
+				pfn + ((sect_start - virt) >> PAGE_SHIFT),
+				sect_end - sect_start, type);
+	if (!err && virt + size > sect_end)
+		err = remap_area_pages(sect_end,
+				pfn + ((sect_end - virt) >> PAGE_SHIFT),
+				virt + size - sect_end, type);
+	return err;
+}
+
+/*
+ * Undo the section part of remap_area_mixed(), the rest is vunmap()'s.
+ * Also covers fully (super)section mapped areas.
+ */
+static void unmap_area_mixed(unsigned long virt, size_t size)
+{
+	unsigned long sect_start = ALIGN(virt, PMD_SIZE);
+	unsigned long sect_end = (virt + size) & PMD_MASK;
+
+	if (sect_start < sect_end)
+		unmap_area_sections(sect_start, sect_end - sect_start);
+}
 #endif
 
 
@@ -303,18 +411,26 @@ __arm_ioremap_pfn(unsigned long pfn, unsigned long offset, size_t size,
 	       !((__pfn_to_phys(pfn) | size | addr) & ~SUPERSECTION_MASK)) {
 		area->flags |= VM_ARM_SECTION_MAPPING;
 		err = remap_area_supersections(addr, pfn, size, type);
-	} else if (!((__pfn_to_phys(pfn) | size | addr) & ~PMD_MASK)) {
+	} else if (!((__pfn_to_phys(pfn) ^ addr) & ~PMD_MASK) &&
+		   ALIGN(addr, PMD_SIZE) < ((addr + size) & PMD_MASK)) {
 		area->flags |= VM_ARM_SECTION_MAPPING;
-		err = remap_area_sections(addr, pfn, size, type);
+		err = remap_area_mixed(addr, pfn, size, type);
 	} else
 #endif
 		err = remap_area_pages(addr, pfn, size, type);
 
 	if (err) {
+#ifndef CONFIG_SMP
+		if (area->flags & VM_ARM_SECTION_MAPPING)
+			unmap_area_mixed(addr, size);
+#endif
  		vunmap((void *)addr);
  		return NULL;
  	}
 
+	/* The page mapped head and tail may still fit large pages */
+	arch_vmap_large_pages(addr, addr + size);
+
 	flush_cache_vmap(addr, addr + size);
 	return (void __iomem *) (offset + addr);
 }
@@ -355,8 +471,8 @@ void __iounmap(volatile void __iomem *io_addr)
 	for (p = &vmlist ; (tmp = *p) ; p = &tmp->next) {
 		if ((tmp->flags & VM_IOREMAP) && (tmp->addr == addr)) {
 			if (tmp->flags & VM_ARM_SECTION_MAPPING) {
-				unmap_area_sections((unsigned long)tmp->addr,
-						    tmp->size);
+				unmap_area_mixed((unsigned long)tmp->addr,
+						 tmp->size);
 			}
 			break;
 		}
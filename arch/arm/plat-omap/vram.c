@@ -32,8 +32,10 @@
 #include <linux/omapfb.h>
 #include <linux/completion.h>
 #include <linux/debugfs.h>
+#include <linux/cma.h>
 
 #include <asm/setup.h>
+#include <asm/cacheflush.h>
 
 #include <mach/sram.h>
 #include <mach/vram.h>
@@ -68,6 +70,7 @@ static int postponed_cnt;
 static struct {
 	unsigned long paddr;
 	size_t size;
+	struct cma *cma;
 } postponed_regions[MAX_POSTPONED_REGIONS];
 
 struct vram_alloc {
@@ -81,6 +84,8 @@ struct vram_region {
 	struct list_head alloc_list;
 	unsigned long paddr;
 	unsigned pages;
+	/* contiguous memory area backing the region, NULL for carveouts */
+	struct cma *cma;
 };
 
 static DEFINE_MUTEX(region_mutex);
@@ -96,7 +101,7 @@ static inline int region_mem_type(unsigned long paddr)
 }
 
 static struct vram_region *omap_vram_create_region(unsigned long paddr,
-		unsigned pages)
+		unsigned pages, struct cma *cma)
 {
 	struct vram_region *rm;
 
@@ -106,6 +111,7 @@ static struct vram_region *omap_vram_create_region(unsigned long paddr,
 		INIT_LIST_HEAD(&rm->alloc_list);
 		rm->paddr = paddr;
 		rm->pages = pages;
+		rm->cma = cma;
 	}
 
 	return rm;
@@ -149,7 +155,39 @@ static void omap_vram_free_allocation(struct vram_alloc *va)
 	kfree(va);
 }
 
-int omap_vram_add_region(unsigned long paddr, size_t size)
+/*
+ * Allocations in a region backed by a contiguous memory area have to be
+ * claimed from the page allocator first.  The pages may have been used
+ * through the cached kernel mapping, so write back and invalidate those
+ * lines before the memory is handed out for DMA and write-combined maps.
+ */
+static int omap_vram_claim(struct vram_region *rm, unsigned long paddr,
+		unsigned pages)
+{
+	size_t size = pages << PAGE_SHIFT;
+	int r;
+
+	if (!rm->cma)
+		return 0;
+
+	r = cma_claim(rm->cma, paddr, size);
+	if (r)
+		return r;
+
+	dmac_flush_range(phys_to_virt(paddr), phys_to_virt(paddr + size));
+	outer_flush_range(paddr, paddr + size);
+
+	return 0;
+}
+
+static void omap_vram_release(struct vram_region *rm, struct vram_alloc *va)
+{
+	if (rm->cma)
+		cma_release(rm->cma, va->paddr, va->pages << PAGE_SHIFT);
+}
+
+static int __omap_vram_add_region(unsigned long paddr, size_t size,
+		struct cma *cma)
 {
 	struct vram_region *rm;
 	unsigned pages;
@@ -161,7 +199,7 @@ int omap_vram_add_region(unsigned long paddr, size_t size)
 		size &= PAGE_MASK;
 		pages = size >> PAGE_SHIFT;
 
-		rm = omap_vram_create_region(paddr, pages);
+		rm = omap_vram_create_region(paddr, pages, cma);
 		if (rm == NULL)
 			return -ENOMEM;
 
@@ -172,12 +210,18 @@ int omap_vram_add_region(unsigned long paddr, size_t size)
 
 		postponed_regions[postponed_cnt].paddr = paddr;
 		postponed_regions[postponed_cnt].size = size;
+		postponed_regions[postponed_cnt].cma = cma;
 
 		++postponed_cnt;
 	}
 	return 0;
 }
 
+int omap_vram_add_region(unsigned long paddr, size_t size)
+{
+	return __omap_vram_add_region(paddr, size, NULL);
+}
+
 int omap_vram_free(unsigned long paddr, size_t size)
 {
 	struct vram_region *rm;
@@ -204,6 +248,7 @@ int omap_vram_free(unsigned long paddr, size_t size)
 	return -EINVAL;
 
 found:
+	omap_vram_release(rm, alloc);
 	omap_vram_free_allocation(alloc);
 
 	mutex_unlock(&region_mutex);
@@ -250,8 +295,14 @@ static int _omap_vram_reserve(unsigned long paddr, unsigned pages)
 found:
 		DBG("FOUND area start %lx, end %lx\n", start, end);
 
-		if (omap_vram_create_allocation(rm, paddr, pages) == NULL)
+		alloc = omap_vram_create_allocation(rm, paddr, pages);
+		if (alloc == NULL)
+			return -ENOMEM;
+
+		if (omap_vram_claim(rm, paddr, pages)) {
+			omap_vram_free_allocation(alloc);
 			return -ENOMEM;
+		}
 
 		return 0;
 	}
@@ -367,6 +418,11 @@ found:
 		if (alloc == NULL)
 			return -ENOMEM;
 
+		if (omap_vram_claim(rm, start, pages)) {
+			omap_vram_free_allocation(alloc);
+			return -ENOMEM;
+		}
+
 		*paddr = start;
 
 		_omap_vram_clear(start, pages);
@@ -410,9 +466,9 @@ static int vram_debug_show(struct seq_file *s, void *unused)
 
 	list_for_each_entry(vr, &region_list, list) {
 		size = vr->pages << PAGE_SHIFT;
-		seq_printf(s, "%08lx-%08lx (%d bytes)\n",
+		seq_printf(s, "%08lx-%08lx (%d bytes)%s\n",
 				vr->paddr, vr->paddr + size - 1,
-				size);
+				size, vr->cma ? " cma" : "");
 
 		list_for_each_entry(va, &vr->alloc_list, list) {
 			size = va->pages << PAGE_SHIFT;
@@ -459,8 +515,9 @@ static __init int omap_vram_init(void)
 	vram_initialized = 1;
 
 	for (i = 0; i < postponed_cnt; i++)
-		omap_vram_add_region(postponed_regions[i].paddr,
-				postponed_regions[i].size);
+		__omap_vram_add_region(postponed_regions[i].paddr,
+				postponed_regions[i].size,
+				postponed_regions[i].cma);
 
 #ifdef CONFIG_DEBUG_FS
 	if (omap_vram_create_debugfs())
@@ -502,6 +559,7 @@ void __init omapfb_reserve_sdram(void)
 {
 	struct bootmem_data	*bdata;
 	unsigned long		sdram_start, sdram_size;
+	struct cma		*cma;
 	u32 paddr;
 	u32 size = 0;
 
@@ -532,13 +590,26 @@ void __init omapfb_reserve_sdram(void)
 	sdram_start = bdata->node_min_pfn << PAGE_SHIFT;
 	sdram_size = (bdata->node_low_pfn << PAGE_SHIFT) - sdram_start;
 
-	if (paddr) {
-		if ((paddr & ~PAGE_MASK) || paddr < sdram_start ||
-				paddr + size > sdram_start + sdram_size) {
-			printk(KERN_ERR "Illegal SDRAM region for VRAM\n");
-			return;
-		}
+	if (paddr && ((paddr & ~PAGE_MASK) || paddr < sdram_start ||
+				paddr + size > sdram_start + sdram_size)) {
+		printk(KERN_ERR "Illegal SDRAM region for VRAM\n");
+		return;
+	}
 
+	/*
+	 * Prefer a contiguous memory area, so that the part of VRAM that
+	 * is not allocated to framebuffers or overlays can be used by the
+	 * rest of the system.
+	 */
+	cma = cma_reserve("vram", paddr, size);
+	if (cma) {
+		paddr = cma_base(cma);
+		__omap_vram_add_region(paddr, size, cma);
+		pr_info("Lending %u bytes SDRAM for VRAM\n", size);
+		return;
+	}
+
+	if (paddr) {
 		if (reserve_bootmem(paddr, size, BOOTMEM_EXCLUSIVE) < 0) {
 			pr_err("FB: failed to reserve VRAM\n");
 			return;
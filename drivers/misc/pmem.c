@@ -23,6 +23,7 @@
 #include <linux/android_pmem.h>
 #include <linux/mempolicy.h>
 #include <linux/sched.h>
+#include <linux/cma.h>
 #include <asm/io.h>
 #include <asm/uaccess.h>
 #include <asm/cacheflush.h>
@@ -107,6 +108,8 @@ struct pmem_info {
 	unsigned char __iomem *vbase;
 	/* total size of the pmem space */
 	unsigned long size;
+	/* contiguous memory area backing the space, NULL for a carveout */
+	struct cma *cma;
 	/* number of entries in the pmem space */
 	unsigned long num_entries;
 	/* pfn of the garbage page in memory */
@@ -232,16 +235,35 @@ static int is_master_owner(struct file *file)
 	return ret;
 }
 
-static int pmem_free(int id, int index)
+/*
+ * With a contiguous memory area behind the space, the memory of an
+ * allocation has to be claimed from the page allocator before use and
+ * given back when it is freed.  Write back and invalidate the lines of
+ * the kernel mapping the pages were used through, as the space is also
+ * mapped uncached.
+ */
+static int pmem_claim(int id, unsigned long paddr, unsigned long len)
+{
+	if (!pmem[id].cma)
+		return 0;
+	if (cma_claim(pmem[id].cma, paddr, len))
+		return -1;
+	dmac_flush_range(phys_to_virt(paddr), phys_to_virt(paddr + len));
+	outer_flush_range(paddr, paddr + len);
+	return 0;
+}
+
+static void pmem_unclaim(int id, unsigned long paddr, unsigned long len)
+{
+	if (pmem[id].cma)
+		cma_release(pmem[id].cma, paddr, len);
+}
+
+static void pmem_free_slot(int id, int index)
 {
 	/* caller should hold the write lock on pmem_sem! */
 	int buddy, curr = index;
-	DLOG("index %d\n", index);
 
-	if (pmem[id].no_allocator) {
-		pmem[id].allocated = 0;
-		return 0;
-	}
 	/* clean up the bitmap, merging any buddies */
 	pmem[id].bitmap[curr].allocated = 0;
 	/* find a slots buddy Buddy# = Slot# ^ (1 << order)
@@ -259,7 +281,21 @@ static int pmem_free(int id, int index)
 			break;
 		}
 	} while (curr < pmem[id].num_entries);
+}
+
+static int pmem_free(int id, int index)
+{
+	/* caller should hold the write lock on pmem_sem! */
+	DLOG("index %d\n", index);
 
+	if (pmem[id].no_allocator) {
+		/* in no_allocator mode the index is the allocation size */
+		pmem_unclaim(id, pmem[id].base, PAGE_ALIGN(index));
+		pmem[id].allocated = 0;
+		return 0;
+	}
+	pmem_unclaim(id, PMEM_START_ADDR(id, index), PMEM_LEN(id, index));
+	pmem_free_slot(id, index);
 	return 0;
 }
 
@@ -389,6 +425,8 @@ static int pmem_allocate(int id, unsigned long len)
 		DLOG("no allocator");
 		if ((len > pmem[id].size) || pmem[id].allocated)
 			return -1;
+		if (pmem_claim(id, pmem[id].base, PAGE_ALIGN(len)))
+			return -1;
 		pmem[id].allocated = 1;
 		return len;
 	}
@@ -435,6 +473,12 @@ static int pmem_allocate(int id, unsigned long len)
 		PMEM_ORDER(id, buddy) = PMEM_ORDER(id, best_fit);
 	}
 	pmem[id].bitmap[best_fit].allocated = 1;
+	if (pmem_claim(id, PMEM_START_ADDR(id, best_fit),
+		       PMEM_LEN(id, best_fit))) {
+		printk(KERN_WARNING "pmem: could not claim memory!\n");
+		pmem_free_slot(id, best_fit);
+		return -1;
+	}
 	return best_fit;
 }
 
@@ -1229,6 +1273,12 @@ int pmem_setup(struct android_pmem_platform_data *pdata,
 	pmem[id].buffered = pdata->buffered;
 	pmem[id].base = pdata->start;
 	pmem[id].size = pdata->size;
+	pmem[id].cma = pdata->cma;
+	if (pmem[id].cma) {
+		pmem[id].base = cma_base(pdata->cma);
+		if (!pmem[id].size || pmem[id].size > cma_size(pdata->cma))
+			pmem[id].size = cma_size(pdata->cma);
+	}
 	pmem[id].ioctl = ioctl;
 	pmem[id].release = release;
 	init_rwsem(&pmem[id].bitmap_sem);
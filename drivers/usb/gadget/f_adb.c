@@ -25,6 +25,9 @@
 #include <linux/wait.h>
 #include <linux/err.h>
 #include <linux/interrupt.h>
+#include <linux/mm.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 
 #include <linux/types.h>
 #include <linux/device.h>
@@ -60,6 +63,7 @@ struct adb_dev {
 	atomic_t open_excl;
 
 	struct list_head tx_idle;
+	struct list_head tx_zc_idle;
 	struct list_head rx_idle;
 	struct list_head rx_done;
 
@@ -220,6 +224,22 @@ static void adb_complete_in(struct usb_ep *ep, struct usb_request *req)
 	wake_up(&dev->write_wq);
 }
 
+/* completion for tx requests pointing straight at a spliced page */
+static void adb_complete_in_zc(struct usb_ep *ep, struct usb_request *req)
+{
+	struct adb_dev *dev = _adb_dev;
+
+	if (req->status != 0)
+		dev->error = 1;
+
+	put_page(req->context);
+	req->context = NULL;
+	req->buf = NULL;
+	req_put(dev, &dev->tx_zc_idle, req);
+
+	wake_up(&dev->write_wq);
+}
+
 static void adb_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct adb_dev *dev = _adb_dev;
@@ -278,6 +298,15 @@ static int __init create_bulk_endpoints(struct adb_dev *dev,
 		req_put(dev, &dev->tx_idle, req);
 	}
 
+	/* these get their buffer from the pipe page being spliced */
+	for (i = 0; i < TX_REQ_MAX; i++) {
+		req = usb_ep_alloc_request(dev->ep_in, GFP_KERNEL);
+		if (!req)
+			goto fail;
+		req->complete = adb_complete_in_zc;
+		req_put(dev, &dev->tx_zc_idle, req);
+	}
+
 	return 0;
 
 fail:
@@ -453,6 +482,83 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+/*
+ * Send one pipe buffer to the host. Lowmem pages at a word aligned offset
+ * are queued to the controller as they are, holding a page reference until
+ * the transfer completes. Anything else is copied into a regular tx request.
+ */
+static int pipe_to_adb(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
+			struct splice_desc *sd)
+{
+	struct adb_dev *dev = sd->u.file->private_data;
+	struct usb_request *req = 0;
+	struct list_head *idle;
+	int zero_copy, ret;
+	void *src;
+
+	ret = buf->ops->confirm(pipe, buf);
+	if (ret)
+		return ret;
+
+	zero_copy = !PageHighMem(buf->page) && !(buf->offset & 3);
+	idle = zero_copy ? &dev->tx_zc_idle : &dev->tx_idle;
+
+	if (dev->error)
+		return -EIO;
+	ret = wait_event_interruptible(dev->write_wq,
+		((req = req_get(dev, idle)) || dev->error));
+	if (ret < 0)
+		return ret;
+	if (!req)
+		return -EIO;
+
+	if (zero_copy) {
+		get_page(buf->page);
+		req->context = buf->page;
+		req->buf = page_address(buf->page) + buf->offset;
+	} else {
+		if (sd->len > BULK_BUFFER_SIZE)
+			sd->len = BULK_BUFFER_SIZE;
+		src = buf->ops->map(pipe, buf, 1);
+		memcpy(req->buf, src + buf->offset, sd->len);
+		buf->ops->unmap(pipe, buf, src);
+	}
+
+	req->length = sd->len;
+	ret = usb_ep_queue(dev->ep_in, req, GFP_ATOMIC);
+	if (ret < 0) {
+		DBG(dev->cdev, "pipe_to_adb: xfer error %d\n", ret);
+		dev->error = 1;
+		if (zero_copy) {
+			put_page(buf->page);
+			req->context = NULL;
+			req->buf = NULL;
+		}
+		req_put(dev, idle, req);
+		return -EIO;
+	}
+
+	return sd->len;
+}
+
+static ssize_t adb_splice_write(struct pipe_inode_info *pipe, struct file *fp,
+				loff_t *ppos, size_t len, unsigned int flags)
+{
+	struct adb_dev *dev = fp->private_data;
+	ssize_t ret;
+
+	DBG(dev->cdev, "adb_splice_write(%d)\n", len);
+
+	if (_lock(&dev->write_excl))
+		return -EBUSY;
+
+	ret = splice_from_pipe(pipe, fp, ppos, len, flags, pipe_to_adb);
+
+	_unlock(&dev->write_excl);
+	DBG(dev->cdev, "adb_splice_write returning %d\n", ret);
+	return ret;
+}
+
 static int adb_open(struct inode *ip, struct file *fp)
 {
 	printk(KERN_INFO "adb_open\n");
@@ -479,6 +585,7 @@ static struct file_operations adb_fops = {
 	.owner = THIS_MODULE,
 	.read = adb_read,
 	.write = adb_write,
+	.splice_write = adb_splice_write,
 	.open = adb_open,
 	.release = adb_release,
 };
@@ -538,6 +645,8 @@ adb_function_unbind(struct usb_configuration *c, struct usb_function *f)
 		adb_request_free(req, dev->ep_out);
 	while ((req = req_get(dev, &dev->tx_idle)))
 		adb_request_free(req, dev->ep_in);
+	while ((req = req_get(dev, &dev->tx_zc_idle)))
+		adb_request_free(req, dev->ep_in);
 
 	dev->online = 0;
 	dev->error = 1;
@@ -618,6 +727,7 @@ int __init adb_function_add(struct usb_composite_dev *cdev,
 	INIT_LIST_HEAD(&dev->rx_idle);
 	INIT_LIST_HEAD(&dev->rx_done);
 	INIT_LIST_HEAD(&dev->tx_idle);
+	INIT_LIST_HEAD(&dev->tx_zc_idle);
 
 	dev->cdev = cdev;
 	dev->function.name = "adb";
@@ -24,6 +24,7 @@
 #include <linux/file.h>
 #include <linux/mm.h>
 #include <linux/mman.h>
+#include <linux/pagemap.h>
 #include <linux/slab.h>
 #include <linux/timer.h>
 #include <linux/aio.h>
@@ -672,6 +673,20 @@ static inline int __queue_kicked_iocb(struct kiocb *iocb)
 	return 0;
 }
 
+/*
+ * Drop the page a buffered read retry was waiting on, see
+ * aio_wait_on_pages().
+ */
+static inline void aio_put_wait_page(struct kiocb *iocb)
+{
+	struct page *page = iocb->ki_wait.private;
+
+	if (page) {
+		iocb->ki_wait.private = NULL;
+		page_cache_release(page);
+	}
+}
+
 /* aio_run_iocb
  *	This is the core aio execution routine. It is
  *	invoked both for initial i/o submission and
@@ -737,6 +752,7 @@ static ssize_t aio_run_iocb(struct kiocb *iocb)
 
 	/* Quit retrying if the i/o has been cancelled */
 	if (kiocbIsCancelled(iocb)) {
+		aio_put_wait_page(iocb);
 		ret = -EINTR;
 		aio_complete(iocb, ret, 0);
 		/* must not access the iocb after this */
@@ -816,17 +832,12 @@ static int __aio_run_iocbs(struct kioctx *ctx)
 
 static void aio_queue_work(struct kioctx * ctx)
 {
-	unsigned long timeout;
 	/*
-	 * if someone is waiting, get the work started right
-	 * away, otherwise, use a longer delay
+	 * Get the work started right away even if nobody is waiting in
+	 * io_getevents(): completions may be harvested straight from the
+	 * ring, so nothing else is going to run the retries.
 	 */
-	smp_mb();
-	if (waitqueue_active(&ctx->wait))
-		timeout = 1;
-	else
-		timeout = HZ/10;
-	queue_delayed_work(aio_wq, &ctx->wq, timeout);
+	queue_delayed_work(aio_wq, &ctx->wq, 1);
 }
 
 
@@ -972,6 +983,10 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 		return 1;
 	}
 
+	count_vm_event(AIO_COMPLETE);
+	count_vm_events(AIO_COMPLETE_USECS,
+			ktime_us_delta(ktime_get(), iocb->ki_submit_time));
+
 	info = &ctx->ring_info;
 
 	/* add a completion event to the ring buffer.
@@ -1359,6 +1374,87 @@ static void aio_advance_iovec(struct kiocb *iocb, ssize_t ret)
 	BUG_ON(ret > 0 && iocb->ki_left == 0);
 }
 
+/*
+ * Wakeup of a buffered read waiting for a page to be read in.  The page
+ * wait queues are shared, so make sure it is our page that got unlocked.
+ */
+static int aio_page_wake_function(wait_queue_t *wait, unsigned mode,
+				  int sync, void *arg)
+{
+	struct kiocb *iocb = container_of(wait, struct kiocb, ki_wait);
+	struct wait_bit_key *key = arg;
+	struct page *page = wait->private;
+
+	if (key->flags != &page->flags || key->bit_nr != PG_locked)
+		return 0;
+
+	list_del_init(&wait->task_list);
+	kick_iocb(iocb);
+	return 1;
+}
+
+/*
+ * ->aio_read() of a buffered file blocks in the submitter on every page
+ * that has to be read in.  Instead, start readahead for what is missing
+ * and have the iocb kicked for another try once the first page under
+ * read is unlocked by its I/O completion.  Only once the whole range is
+ * uptodate does ->aio_read() get to run, and it then merely copies.
+ *
+ * Returns 1 if the iocb is waiting on a page.  Anything unusual, such
+ * as a page that failed to read, is left for ->aio_read() to handle.
+ */
+static int aio_wait_on_pages(struct kiocb *iocb)
+{
+	struct file *file = iocb->ki_filp;
+	struct address_space *mapping = file->f_mapping;
+	struct inode *inode = mapping->host;
+	pgoff_t index, last;
+	struct page *page;
+	loff_t isize;
+
+	aio_put_wait_page(iocb);
+
+	if ((file->f_flags & O_DIRECT) || !S_ISREG(inode->i_mode) ||
+	    file->f_op->aio_read != generic_file_aio_read)
+		return 0;
+
+	isize = i_size_read(inode);
+	if (!iocb->ki_left || iocb->ki_pos >= isize)
+		return 0;
+	index = iocb->ki_pos >> PAGE_CACHE_SHIFT;
+	last = (min_t(loff_t, iocb->ki_pos + iocb->ki_left, isize) - 1) >>
+		PAGE_CACHE_SHIFT;
+
+	for (; index <= last; index++) {
+		page = find_get_page(mapping, index);
+		if (!page) {
+			page_cache_sync_readahead(mapping, &file->f_ra, file,
+						  index, last - index + 1);
+			page = find_get_page(mapping, index);
+			if (!page)
+				return 0;
+		}
+		if (PageUptodate(page)) {
+			page_cache_release(page);
+			continue;
+		}
+
+		iocb->ki_wait.func = aio_page_wake_function;
+		iocb->ki_wait.private = page;
+		if (!wait_on_page_locked_async(page, &iocb->ki_wait)) {
+			count_vm_event(AIO_READ_RETRY);
+			return 1;
+		}
+		iocb->ki_wait.private = NULL;
+		if (!PageUptodate(page)) {
+			page_cache_release(page);
+			return 0;
+		}
+		page_cache_release(page);
+	}
+	return 0;
+}
+
 static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 {
 	struct file *file = iocb->ki_filp;
@@ -1382,6 +1478,9 @@ static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 	if (iocb->ki_pos < 0)
 		return -EINVAL;
 
+	if (opcode == IOCB_CMD_PREADV && aio_wait_on_pages(iocb))
+		return -EIOCBRETRY;
+
 	do {
 		ret = rw_op(iocb, &iocb->ki_iovec[iocb->ki_cur_seg],
 			    iocb->ki_nr_segs - iocb->ki_cur_seg,
@@ -1588,6 +1687,7 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	struct kiocb *req;
 	struct file *file;
 	ssize_t ret;
+	ktime_t start = ktime_get();
 
 	/* enforce forwards compatibility on users */
 	if (unlikely(iocb->aio_reserved1 || iocb->aio_reserved2)) {
@@ -1639,6 +1739,7 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	req->ki_obj.user = user_iocb;
 	req->ki_user_data = iocb->aio_data;
 	req->ki_pos = iocb->aio_offset;
+	req->ki_submit_time = start;
 
 	req->ki_buf = (char __user *)(unsigned long)iocb->aio_buf;
 	req->ki_left = req->ki_nbytes = iocb->aio_nbytes;
@@ -1660,6 +1761,9 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	}
 	spin_unlock_irq(&ctx->ctx_lock);
 	aio_put_req(req);	/* drop extra ref to req */
+
+	count_vm_event(AIO_SUBMIT);
+	count_vm_events(AIO_SUBMIT_USECS, ktime_us_delta(ktime_get(), start));
 	return 0;
 
 out_put_req:
@@ -37,6 +37,13 @@
 int sysctl_vfs_cache_pressure __read_mostly = 100;
 EXPORT_SYMBOL_GPL(sysctl_vfs_cache_pressure);
 
+/*
+ * How many unused negative dentries a directory may keep cached.  Lookups
+ * probing for files that don't exist (library and class search paths) can
+ * otherwise fill the dcache with entries nobody asks for twice.
+ */
+int sysctl_dentry_negative_limit __read_mostly = 128;
+
  __cacheline_aligned_in_smp DEFINE_SPINLOCK(dcache_lock);
 __cacheline_aligned_in_smp DEFINE_SEQLOCK(rename_lock);
 
@@ -121,29 +128,65 @@ static void dentry_iput(struct dentry * dentry)
 	}
 }
 
+/*
+ * Negative dentries are counted as such when they go on the LRU, per
+ * superblock and against their parent, and stay counted until they come
+ * off it again even if they are instantiated in the meantime.
+ */
+static void dentry_negative_parent(struct dentry *dentry, int delta)
+{
+	if ((dentry->d_flags & DCACHE_NEGATIVE_LRU) && !IS_ROOT(dentry))
+		dentry->d_parent->d_nr_negative += delta;
+}
+
+static void dentry_lru_account(struct dentry *dentry)
+{
+	struct super_block *sb = dentry->d_sb;
+
+	sb->s_nr_dentry_unused++;
+	dentry_stat.nr_unused++;
+	if (!dentry->d_inode) {
+		dentry->d_flags |= DCACHE_NEGATIVE_LRU;
+		dentry_negative_parent(dentry, 1);
+		sb->s_nr_dentry_negative++;
+		dentry_stat.nr_negative++;
+	}
+}
+
+static void dentry_lru_unaccount(struct dentry *dentry)
+{
+	struct super_block *sb = dentry->d_sb;
+
+	sb->s_nr_dentry_unused--;
+	dentry_stat.nr_unused--;
+	if (dentry->d_flags & DCACHE_NEGATIVE_LRU) {
+		dentry_negative_parent(dentry, -1);
+		dentry->d_flags &= ~DCACHE_NEGATIVE_LRU;
+		sb->s_nr_dentry_negative--;
+		dentry_stat.nr_negative--;
+	}
+}
+
 /*
  * dentry_lru_(add|add_tail|del|del_init) must be called with dcache_lock held.
  */
 static void dentry_lru_add(struct dentry *dentry)
 {
 	list_add(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-	dentry->d_sb->s_nr_dentry_unused++;
-	dentry_stat.nr_unused++;
+	dentry_lru_account(dentry);
 }
 
 static void dentry_lru_add_tail(struct dentry *dentry)
 {
 	list_add_tail(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-	dentry->d_sb->s_nr_dentry_unused++;
-	dentry_stat.nr_unused++;
+	dentry_lru_account(dentry);
 }
 
 static void dentry_lru_del(struct dentry *dentry)
 {
 	if (!list_empty(&dentry->d_lru)) {
 		list_del(&dentry->d_lru);
-		dentry->d_sb->s_nr_dentry_unused--;
-		dentry_stat.nr_unused--;
+		dentry_lru_unaccount(dentry);
 	}
 }
 
@@ -151,8 +194,7 @@ static void dentry_lru_del_init(struct dentry *dentry)
 {
 	if (likely(!list_empty(&dentry->d_lru))) {
 		list_del_init(&dentry->d_lru);
-		dentry->d_sb->s_nr_dentry_unused--;
-		dentry_stat.nr_unused--;
+		dentry_lru_unaccount(dentry);
 	}
 }
 
@@ -240,6 +282,13 @@ repeat:
  	if (d_unhashed(dentry))
 		goto kill_it;
   	if (list_empty(&dentry->d_lru)) {
+		/* Directory already caching plenty of misses? */
+		if (!dentry->d_inode && !IS_ROOT(dentry) &&
+		    dentry->d_parent->d_nr_negative >=
+				sysctl_dentry_negative_limit) {
+			__count_vm_event(DENTRY_NEGATIVE_CAPPED);
+			goto unhash_it;
+		}
   		dentry->d_flags |= DCACHE_REFERENCED;
 		dentry_lru_add(dentry);
   	}
@@ -476,10 +525,13 @@ restart:
 			/*
 			 * If we are honouring the DCACHE_REFERENCED flag and
 			 * the dentry has this flag set, don't free it. Clear
-			 * the flag and put it back on the LRU.
+			 * the flag and put it back on the LRU.  Negative
+			 * dentries get no second chance: they are cheap to
+			 * recreate and must not push out real metadata.
 			 */
 			if ((flags & DCACHE_REFERENCED)
-				&& (dentry->d_flags & DCACHE_REFERENCED)) {
+				&& (dentry->d_flags & DCACHE_REFERENCED)
+				&& !(dentry->d_flags & DCACHE_NEGATIVE_LRU)) {
 				dentry->d_flags &= ~DCACHE_REFERENCED;
 				list_move_tail(&dentry->d_lru, &referenced);
 				spin_unlock(&dentry->d_lock);
@@ -506,6 +558,8 @@ restart:
 			spin_unlock(&dentry->d_lock);
 			continue;
 		}
+		__count_vm_event(dentry->d_inode ? DENTRY_PRUNED :
+						   DENTRY_NEGATIVE_PRUNED);
 		prune_one_dentry(dentry);
 		/* dentry->d_lock was dropped in prune_one_dentry() */
 		cond_resched_lock(&dcache_lock);
@@ -947,6 +1001,7 @@ struct dentry *d_alloc(struct dentry * parent, const struct qstr *name)
 	dentry->d_op = NULL;
 	dentry->d_fsdata = NULL;
 	dentry->d_mounted = 0;
+	dentry->d_nr_negative = 0;
 	INIT_HLIST_NODE(&dentry->d_hash);
 	INIT_LIST_HEAD(&dentry->d_lru);
 	INIT_LIST_HEAD(&dentry->d_subdirs);
@@ -1429,6 +1484,41 @@ next:
  	return found;
 }
 
+/**
+ * __d_lookup_rcu - search for a dentry without taking a reference
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ *
+ * Like __d_lookup(), but for the lazy path walk: the caller holds
+ * rcu_read_lock() and gets a hashed child of @parent back with its d_lock
+ * held instead of with a reference.  Parents with their own d_compare are
+ * not handled here.
+ */
+struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name)
+{
+	unsigned int len = name->len;
+	unsigned int hash = name->hash;
+	const unsigned char *str = name->name;
+	struct hlist_head *head = d_hash(parent, hash);
+	struct hlist_node *node;
+	struct dentry *dentry;
+
+	hlist_for_each_entry_rcu(dentry, node, head, d_hash) {
+		if (dentry->d_name.hash != hash)
+			continue;
+		if (dentry->d_parent != parent)
+			continue;
+
+		spin_lock(&dentry->d_lock);
+		if (dentry->d_parent == parent && !d_unhashed(dentry) &&
+		    dentry->d_name.len == len &&
+		    !memcmp(dentry->d_name.name, str, len))
+			return dentry;
+		spin_unlock(&dentry->d_lock);
+	}
+	return NULL;
+}
+
 /**
  * d_hash_and_lookup - hash the qstr then search for a dentry
  * @dir: Directory to search in
@@ -1679,6 +1769,8 @@ already_unhashed:
 	swap(dentry->d_name.hash, target->d_name.hash);
 
 	/* ... and switch the parents */
+	dentry_negative_parent(dentry, -1);
+	dentry_negative_parent(target, -1);
 	if (IS_ROOT(dentry)) {
 		dentry->d_parent = target->d_parent;
 		target->d_parent = target;
@@ -1691,6 +1783,8 @@ already_unhashed:
 	}
 
 	list_add(&dentry->d_u.d_child, &dentry->d_parent->d_subdirs);
+	dentry_negative_parent(dentry, 1);
+	dentry_negative_parent(target, 1);
 	spin_unlock(&target->d_lock);
 	fsnotify_d_move(dentry);
 	spin_unlock(&dentry->d_lock);
@@ -1787,6 +1881,8 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 	switch_names(dentry, anon);
 	swap(dentry->d_name.hash, anon->d_name.hash);
 
+	dentry_negative_parent(dentry, -1);
+	dentry_negative_parent(anon, -1);
 	dparent = dentry->d_parent;
 	aparent = anon->d_parent;
 
@@ -1803,6 +1899,8 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 		list_add(&anon->d_u.d_child, &anon->d_parent->d_subdirs);
 	else
 		INIT_LIST_HEAD(&anon->d_u.d_child);
+	dentry_negative_parent(dentry, 1);
+	dentry_negative_parent(anon, 1);
 
 	anon->d_flags &= ~DCACHE_DISCONNECTED;
 }
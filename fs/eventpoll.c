@@ -104,6 +104,9 @@
 
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
 
+/* Number of events ep_send_events() copies to userspace in one go */
+#define EP_SEND_BATCH 16
+
 struct epoll_filefd {
 	struct file *file;
 	int fd;
@@ -143,11 +146,14 @@ struct epitem {
 	struct list_head rdllink;
 
 	/*
-	 * Works together "struct eventpoll"->ovflist in keeping the
+	 * Works together "struct eventpoll"->readyq in keeping the
 	 * single linked chain of items.
 	 */
 	struct epitem *next;
 
+	/* Set while the item sits on "struct eventpoll"->readyq */
+	atomic_t queued;
+
 	/* The file descriptor information this item refers to */
 	struct epoll_filefd ffd;
 
@@ -197,11 +203,11 @@ struct eventpoll {
 	struct rb_root rbr;
 
 	/*
-	 * This is a single linked list that chains all the "struct epitem" that
-	 * happened while transfering ready events to userspace w/out
-	 * holding ->lock.
+	 * This is a lock-less single linked list that chains all the
+	 * "struct epitem" the poll callback found ready. They are moved to
+	 * rdllist by whoever next looks at it holding ->lock.
 	 */
-	struct epitem *ovflist;
+	atomic_long_t readyq;
 
 	/* The user that created the eventpoll descriptor */
 	struct user_struct *user;
@@ -311,6 +317,64 @@ static inline int ep_op_has_event(int op)
 	return op != EPOLL_CTL_DEL;
 }
 
+/*
+ * Queue an item on ep->readyq. Only whole-list removal is ever done on the
+ * other side, so a plain compare-and-swap push is safe.
+ */
+static void ep_readyq_push(struct eventpoll *ep, struct epitem *epi)
+{
+	long head;
+
+	do {
+		head = atomic_long_read(&ep->readyq);
+		epi->next = (struct epitem *) head;
+	} while (atomic_long_cmpxchg(&ep->readyq, head, (long) epi) != head);
+}
+
+/*
+ * Move the items queued by the poll callback to the tail of @list, oldest
+ * first. Must be called with "ep->lock" held.
+ */
+static void ep_readyq_splice(struct eventpoll *ep, struct list_head *list)
+{
+	struct epitem *epi, *nepi, *first = NULL;
+
+	epi = (struct epitem *) atomic_long_xchg(&ep->readyq, 0);
+	if (!epi)
+		return;
+	for (; epi; epi = nepi) {
+		nepi = epi->next;
+		epi->next = first;
+		first = epi;
+	}
+	for (epi = first; epi; epi = nepi) {
+		nepi = epi->next;
+		epi->next = EP_UNACTIVE_PTR;
+		/*
+		 * Order the ->next accesses above before the callback can
+		 * see the item unqueued and push it again.
+		 */
+		smp_mb();
+		atomic_set(&epi->queued, 0);
+		if (!ep_is_linked(&epi->rdllink))
+			list_add_tail(&epi->rdllink, list);
+	}
+	/*
+	 * Events from here on queue the items again: make sure the callers'
+	 * f_op->poll() calls see everything that came before.
+	 */
+	smp_mb();
+}
+
+/*
+ * Tells if there is anything on the ready list or the callback queue. Can be
+ * called without locks, as a hint.
+ */
+static inline int ep_events_available(struct eventpoll *ep)
+{
+	return !list_empty(&ep->rdllist) || atomic_long_read(&ep->readyq);
+}
+
 /* Initialize the poll safe wake up structure */
 static void ep_poll_safewake_init(struct poll_safewake *psw)
 {
@@ -424,7 +488,12 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 
 	rb_erase(&epi->rbn, &ep->rbr);
 
+	/*
+	 * The poll callback can no longer queue the item, but it may still be
+	 * sitting on ep->readyq: flush that before unlinking it.
+	 */
 	spin_lock_irqsave(&ep->lock, flags);
+	ep_readyq_splice(ep, &ep->rdllist);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
 	spin_unlock_irqrestore(&ep->lock, flags);
@@ -499,17 +568,14 @@ static int ep_eventpoll_release(struct inode *inode, struct file *file)
 static unsigned int ep_eventpoll_poll(struct file *file, poll_table *wait)
 {
 	unsigned int pollflags = 0;
-	unsigned long flags;
 	struct eventpoll *ep = file->private_data;
 
 	/* Insert inside our poll wait queue */
 	poll_wait(file, &ep->poll_wait, wait);
 
 	/* Check our condition */
-	spin_lock_irqsave(&ep->lock, flags);
-	if (!list_empty(&ep->rdllist))
+	if (ep_events_available(ep))
 		pollflags = POLLIN | POLLRDNORM;
-	spin_unlock_irqrestore(&ep->lock, flags);
 
 	return pollflags;
 }
@@ -581,7 +647,7 @@ static int ep_alloc(struct eventpoll **pep)
 	init_waitqueue_head(&ep->poll_wait);
 	INIT_LIST_HEAD(&ep->rdllist);
 	ep->rbr = RB_ROOT;
-	ep->ovflist = EP_UNACTIVE_PTR;
+	atomic_long_set(&ep->readyq, 0);
 	ep->user = user;
 
 	*pep = ep;
@@ -634,16 +700,12 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
-	int pwake = 0;
-	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
 
 	DNPRINTK(3, (KERN_INFO "[%p] eventpoll: poll_callback(%p) epi=%p ep=%p\n",
 		     current, epi->ffd.file, epi, ep));
 
-	spin_lock_irqsave(&ep->lock, flags);
-
 	/*
 	 * If the event mask does not contain any poll(2) event, we consider the
 	 * descriptor to be disabled. This condition is likely the effect of the
@@ -651,43 +713,26 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * until the next EPOLL_CTL_MOD will be issued.
 	 */
 	if (!(epi->event.events & ~EP_PRIVATE_BITS))
-		goto out_unlock;
+		return 1;
 
 	/*
-	 * If we are trasfering events to userspace, we can hold no locks
-	 * (because we're accessing user memory, and because of linux f_op->poll()
-	 * semantics). All the events that happens during that period of time are
-	 * chained in ep->ovflist and requeued later on.
+	 * Queue the item without taking "ep->lock": we are called with the
+	 * target's wait queue lock held, possibly from interrupt context, for
+	 * every single event. Whoever holds "ep->lock" next moves it to the
+	 * ready list. If it is queued already, so was the wakeup.
 	 */
-	if (unlikely(ep->ovflist != EP_UNACTIVE_PTR)) {
-		if (epi->next == EP_UNACTIVE_PTR) {
-			epi->next = ep->ovflist;
-			ep->ovflist = epi;
-		}
-		goto out_unlock;
-	}
-
-	/* If this file is already in the ready list we exit soon */
-	if (ep_is_linked(&epi->rdllink))
-		goto is_linked;
+	if (atomic_xchg(&epi->queued, 1))
+		return 1;
+	ep_readyq_push(ep, epi);
 
-	list_add_tail(&epi->rdllink, &ep->rdllist);
-
-is_linked:
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
-	 * wait list.
+	 * wait list. The atomic operations above order the queueing against
+	 * the waitqueue_active() checks.
 	 */
 	if (waitqueue_active(&ep->wq))
-		wake_up_locked(&ep->wq);
+		wake_up(&ep->wq);
 	if (waitqueue_active(&ep->poll_wait))
-		pwake++;
-
-out_unlock:
-	spin_unlock_irqrestore(&ep->lock, flags);
-
-	/* We have to call this outside the lock */
-	if (pwake)
 		ep_poll_safewake(&psw, &ep->poll_wait);
 
 	return 1;
@@ -761,6 +806,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	epi->event = *event;
 	epi->nwait = 0;
 	epi->next = EP_UNACTIVE_PTR;
+	atomic_set(&epi->queued, 0);
 
 	/* Initialize the poll table using the queue callback */
 	epq.epi = epi;
@@ -804,7 +850,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 
 		/* Notify waiting tasks that events are available */
 		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+			wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
@@ -827,11 +873,10 @@ error_unregister:
 
 	/*
 	 * We need to do this because an event could have been arrived on some
-	 * allocated wait queue. Note that we don't care about the ep->ovflist
-	 * list, since that is used/cleaned only inside a section bound by "mtx".
-	 * And ep_insert() is called with "mtx" held.
+	 * allocated wait queue, and queued the item on ep->readyq.
 	 */
 	spin_lock_irqsave(&ep->lock, flags);
+	ep_readyq_splice(ep, &ep->rdllist);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
 	spin_unlock_irqrestore(&ep->lock, flags);
@@ -880,7 +925,7 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 
 			/* Notify waiting tasks that events are available */
 			if (waitqueue_active(&ep->wq))
-				wake_up_locked(&ep->wq);
+				wake_up(&ep->wq);
 			if (waitqueue_active(&ep->poll_wait))
 				pwake++;
 		}
@@ -894,14 +939,50 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	return 0;
 }
 
+/*
+ * Copy a batch of harvested events to userspace with a single user copy.
+ * Once that succeeded the items are finished off: one-shot ones are
+ * disabled and level triggered ones go back on the ready list. If it
+ * fails, they go back on @txlist undelivered.
+ */
+static int ep_send_batch(struct eventpoll *ep, struct epoll_event __user *uevents,
+			 struct epoll_event *events, struct epitem **items,
+			 int n, struct list_head *txlist)
+{
+	int i;
+
+	if (__copy_to_user(uevents, events, n * sizeof(struct epoll_event))) {
+		while (n--)
+			list_add(&items[n]->rdllink, txlist);
+		return -EFAULT;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct epitem *epi = items[i];
+
+		/*
+		 * At this point, noone can insert into ep->rdllist besides
+		 * us. The epoll_ctl() callers are locked out by us holding
+		 * "mtx" and the poll callback queues on ep->readyq.
+		 */
+		if (epi->event.events & EPOLLONESHOT)
+			epi->event.events &= EP_PRIVATE_BITS;
+		else if (!(epi->event.events & EPOLLET))
+			list_add_tail(&epi->rdllink, &ep->rdllist);
+	}
+	return 0;
+}
+
 static int ep_send_events(struct eventpoll *ep, struct epoll_event __user *events,
 			  int maxevents)
 {
-	int eventcnt, error = -EFAULT, pwake = 0;
+	int eventcnt = 0, nbatch = 0, error = 0, pwake = 0;
 	unsigned int revents;
 	unsigned long flags;
-	struct epitem *epi, *nepi;
+	struct epitem *epi;
 	struct list_head txlist;
+	struct epoll_event batch[EP_SEND_BATCH];
+	struct epitem *batch_items[EP_SEND_BATCH];
 
 	INIT_LIST_HEAD(&txlist);
 
@@ -912,24 +993,21 @@ static int ep_send_events(struct eventpoll *ep, struct epoll_event __user *event
 	mutex_lock(&ep->mtx);
 
 	/*
-	 * Steal the ready list, and re-init the original one to the
-	 * empty list. Also, set ep->ovflist to NULL so that events
-	 * happening while looping w/out locks, are not lost. We cannot
-	 * have the poll callback to queue directly on ep->rdllist,
-	 * because we are doing it in the loop below, in a lockless way.
+	 * Steal the ready list and whatever the poll callback queued, and
+	 * re-init the original one to the empty list. Events happening while
+	 * we loop w/out locks are queued on ep->readyq and left for the next
+	 * harvest.
 	 */
 	spin_lock_irqsave(&ep->lock, flags);
-	list_splice(&ep->rdllist, &txlist);
-	INIT_LIST_HEAD(&ep->rdllist);
-	ep->ovflist = NULL;
+	list_splice_init(&ep->rdllist, &txlist);
+	ep_readyq_splice(ep, &txlist);
 	spin_unlock_irqrestore(&ep->lock, flags);
 
 	/*
 	 * We can loop without lock because this is a task private list.
-	 * We just splice'd out the ep->rdllist in ep_collect_ready_items().
 	 * Items cannot vanish during the loop because we are holding "mtx".
 	 */
-	for (eventcnt = 0; !list_empty(&txlist) && eventcnt < maxevents;) {
+	while (!list_empty(&txlist) && eventcnt + nbatch < maxevents) {
 		epi = list_first_entry(&txlist, struct epitem, rdllink);
 
 		list_del_init(&epi->rdllink);
@@ -941,59 +1019,35 @@ static int ep_send_events(struct eventpoll *ep, struct epoll_event __user *event
 		 */
 		revents = epi->ffd.file->f_op->poll(epi->ffd.file, NULL);
 		revents &= epi->event.events;
+		if (!revents)
+			continue;
 
 		/*
-		 * Is the event mask intersect the caller-requested one,
-		 * deliver the event to userspace. Again, we are holding
-		 * "mtx", so no operations coming from userspace can change
-		 * the item.
+		 * The event mask intersects the caller-requested one: stage
+		 * the event, and hand a full batch over to userspace. Again,
+		 * we are holding "mtx", so no operations coming from
+		 * userspace can change the item.
 		 */
-		if (revents) {
-			if (__put_user(revents,
-				       &events[eventcnt].events) ||
-			    __put_user(epi->event.data,
-				       &events[eventcnt].data))
-				goto errxit;
-			if (epi->event.events & EPOLLONESHOT)
-				epi->event.events &= EP_PRIVATE_BITS;
-			eventcnt++;
+		batch[nbatch].events = revents;
+		batch[nbatch].data = epi->event.data;
+		batch_items[nbatch++] = epi;
+		if (nbatch == EP_SEND_BATCH) {
+			error = ep_send_batch(ep, &events[eventcnt], batch,
+					      batch_items, nbatch, &txlist);
+			if (error)
+				break;
+			eventcnt += nbatch;
+			nbatch = 0;
 		}
-		/*
-		 * At this point, noone can insert into ep->rdllist besides
-		 * us. The epoll_ctl() callers are locked out by us holding
-		 * "mtx" and the poll callback will queue them in ep->ovflist.
-		 */
-		if (!(epi->event.events & EPOLLET) &&
-		    (revents & epi->event.events))
-			list_add_tail(&epi->rdllink, &ep->rdllist);
 	}
-	error = 0;
-
-errxit:
-
-	spin_lock_irqsave(&ep->lock, flags);
-	/*
-	 * During the time we spent in the loop above, some other events
-	 * might have been queued by the poll callback. We re-insert them
-	 * inside the main ready-list here.
-	 */
-	for (nepi = ep->ovflist; (epi = nepi) != NULL;
-	     nepi = epi->next, epi->next = EP_UNACTIVE_PTR) {
-		/*
-		 * If the above loop quit with errors, the epoll item might still
-		 * be linked to "txlist", and the list_splice() done below will
-		 * take care of those cases.
-		 */
-		if (!ep_is_linked(&epi->rdllink))
-			list_add_tail(&epi->rdllink, &ep->rdllist);
+	if (nbatch && !error) {
+		error = ep_send_batch(ep, &events[eventcnt], batch,
+				      batch_items, nbatch, &txlist);
+		if (!error)
+			eventcnt += nbatch;
 	}
-	/*
-	 * We need to set back ep->ovflist to EP_UNACTIVE_PTR, so that after
-	 * releasing the lock, events will be queued in the normal way inside
-	 * ep->rdllist.
-	 */
-	ep->ovflist = EP_UNACTIVE_PTR;
 
+	spin_lock_irqsave(&ep->lock, flags);
 	/*
 	 * In case of error in the event-send loop, or in case the number of
 	 * ready events exceeds the userspace limit, we need to splice the
@@ -1001,13 +1055,13 @@ errxit:
 	 */
 	list_splice(&txlist, &ep->rdllist);
 
-	if (!list_empty(&ep->rdllist)) {
+	if (ep_events_available(ep)) {
 		/*
 		 * Wake up (if active) both the eventpoll wait list and the ->poll()
 		 * wait list (delayed after we release the lock).
 		 */
 		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+			wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
@@ -1026,7 +1080,6 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		   int maxevents, long timeout)
 {
 	int res, eavail;
-	unsigned long flags;
 	long jtimeout;
 	wait_queue_t wait;
 
@@ -1039,18 +1092,15 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		MAX_SCHEDULE_TIMEOUT : (timeout * HZ + 999) / 1000;
 
 retry:
-	spin_lock_irqsave(&ep->lock, flags);
-
 	res = 0;
-	if (list_empty(&ep->rdllist)) {
+	if (!ep_events_available(ep)) {
 		/*
 		 * We don't have any available event to return to the caller.
 		 * We need to sleep here, and we will be wake up by
 		 * ep_poll_callback() when events will become available.
 		 */
 		init_waitqueue_entry(&wait, current);
-		wait.flags |= WQ_FLAG_EXCLUSIVE;
-		__add_wait_queue(&ep->wq, &wait);
+		add_wait_queue_exclusive(&ep->wq, &wait);
 
 		for (;;) {
 			/*
@@ -1059,26 +1109,22 @@ retry:
 			 * to TASK_INTERRUPTIBLE before doing the checks.
 			 */
 			set_current_state(TASK_INTERRUPTIBLE);
-			if (!list_empty(&ep->rdllist) || !jtimeout)
+			if (ep_events_available(ep) || !jtimeout)
 				break;
 			if (signal_pending(current)) {
 				res = -EINTR;
 				break;
 			}
 
-			spin_unlock_irqrestore(&ep->lock, flags);
 			jtimeout = schedule_timeout(jtimeout);
-			spin_lock_irqsave(&ep->lock, flags);
 		}
-		__remove_wait_queue(&ep->wq, &wait);
+		remove_wait_queue(&ep->wq, &wait);
 
 		set_current_state(TASK_RUNNING);
 	}
 
 	/* Is it worth to try to dig for events ? */
-	eavail = !list_empty(&ep->rdllist);
-
-	spin_unlock_irqrestore(&ep->lock, flags);
+	eavail = ep_events_available(ep);
 
 	/*
 	 * Try to transfer events to user space. In case we get 0 events and
@@ -1089,6 +1135,10 @@ retry:
 	    !(res = ep_send_events(ep, events, maxevents)) && jtimeout)
 		goto retry;
 
+	count_vm_event(EPOLL_WAIT);
+	if (res > 0)
+		count_vm_events(EPOLL_EVENTS, res);
+
 	return res;
 }
 
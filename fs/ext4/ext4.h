@@ -1064,6 +1064,8 @@ extern int ext4_mb_add_groupinfo(struct super_block *sb,
 		ext4_group_t i, struct ext4_group_desc *desc);
 extern void ext4_mb_update_group_info(struct ext4_group_info *grp,
 		ext4_grpblk_t add);
+extern void ext4_mb_group_need_init(struct super_block *sb,
+		ext4_group_t group);
 extern int ext4_mb_get_buddy_cache_lock(struct super_block *, ext4_group_t);
 extern void ext4_mb_put_buddy_cache_lock(struct super_block *,
 						ext4_group_t, int);
@@ -1277,7 +1279,10 @@ struct ext4_group_info {
 	unsigned short  bb_first_free;
 	unsigned short  bb_free;
 	unsigned short  bb_fragments;
+	short           bb_largest_free_order;	/* -1 until buddy is built */
+	ext4_group_t    bb_group;
 	struct          list_head bb_prealloc_list;
+	struct          list_head bb_largest_free_order_node;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
 #endif
@@ -135,6 +135,9 @@ struct ext4_inode_info {
 	__u16 i_extra_isize;
 
 	spinlock_t i_block_reservation_lock;
+
+	/* last transaction that changed this inode's metadata, for fsync */
+	tid_t i_sync_tid;
 };
 
 #endif	/* _EXT4_I */
@@ -168,6 +168,13 @@ static inline int ext4_handle_valid(handle_t *handle)
 	return 1;
 }
 
+static inline void ext4_update_inode_fsync_trans(handle_t *handle,
+						 struct inode *inode)
+{
+	if (ext4_handle_valid(handle))
+		EXT4_I(inode)->i_sync_tid = handle->h_transaction->t_tid;
+}
+
 static inline void ext4_handle_sync(handle_t *handle)
 {
 	if (ext4_handle_valid(handle))
@@ -106,6 +106,10 @@ struct ext4_sb_info {
 	tid_t s_last_transaction;
 	unsigned short *s_mb_offsets;
 	unsigned int *s_mb_maxs;
+	/* initialized groups, listed by largest free buddy order */
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
+	atomic_t s_mb_groups_need_init;
 
 	/* tunables */
 	unsigned long s_stripe;
@@ -115,6 +119,8 @@ struct ext4_sb_info {
 	unsigned int s_mb_stats;
 	unsigned int s_mb_order2_reqs;
 	unsigned int s_mb_group_prealloc;
+	unsigned int s_mb_prefetch;
+	unsigned int s_mb_optimize_scan;
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
 	unsigned long s_mb_last_start;
@@ -136,6 +142,12 @@ struct ext4_sb_info {
 	atomic_t s_bal_goals;	/* goal hits */
 	atomic_t s_bal_breaks;	/* too long searches */
 	atomic_t s_bal_2orders;	/* 2^order hits */
+	atomic_t s_bal_cr_hits[4];	/* allocations found at each cr */
+	atomic_t s_bal_cr_groups[4];	/* groups considered at each cr */
+	atomic_t s_bal_cr_failed[4];	/* passes over all groups w/o luck */
+	atomic_t s_bal_cr0_skipped;	/* cr 0 passes skipped via lists */
+	atomic_t s_bal_list_hits;	/* groups picked from order lists */
+	atomic_t s_mb_prefetched;	/* block bitmaps read ahead */
 	spinlock_t s_bal_lock;
 	unsigned long s_mb_buddies_generated;
 	unsigned long long s_mb_generation_time;
@@ -40,8 +40,8 @@
  * Another task could have dirtied this inode.  Its data can be in any
  * state in the journalling system.
  *
- * What we do is just kick off a commit and wait on it.  This will snapshot the
- * inode to disk.
+ * What we do is just kick off a commit of the last transaction which touched
+ * the inode and wait on it.  This will snapshot the inode to disk.
  */
 
 int ext4_sync_file(struct file *file, struct dentry *dentry, int datasync)
@@ -59,12 +59,13 @@ int ext4_sync_file(struct file *file, struct dentry *dentry, int datasync)
 	/*
 	 * data=writeback:
 	 *  The caller's filemap_fdatawrite()/wait will sync the data.
-	 *  sync_inode() will sync the metadata
+	 *  Committing the last transaction to touch the inode syncs the
+	 *  metadata.
 	 *
 	 * data=ordered:
 	 *  The caller's filemap_fdatawrite() will write the data and
-	 *  sync_inode() will write the inode if it is dirty.  Then the caller's
-	 *  filemap_fdatawait() will wait on the pages.
+	 *  committing i_sync_tid will write the inode if it changed.  Then
+	 *  the caller's filemap_fdatawait() will wait on the pages.
 	 *
 	 * data=journal:
 	 *  filemap_fdatawrite won't do anything (the buffers are clean).
@@ -79,22 +80,46 @@ int ext4_sync_file(struct file *file, struct dentry *dentry, int datasync)
 		goto out;
 	}
 
-	if (datasync && !(inode->i_state & I_DIRTY_DATASYNC))
-		goto out;
-
-	/*
-	 * The VFS has written the file data.  If the inode is unaltered
-	 * then we need not start a commit.
-	 */
-	if (inode->i_state & (I_DIRTY_SYNC|I_DIRTY_DATASYNC)) {
+	if (!journal) {
 		struct writeback_control wbc = {
 			.sync_mode = WB_SYNC_ALL,
 			.nr_to_write = 0, /* sys_fsync did this */
 		};
-		ret = sync_inode(inode, &wbc);
-		if (journal && (journal->j_flags & JBD2_BARRIER))
-			blkdev_issue_flush(inode->i_sb->s_bdev, NULL);
+
+		if (datasync && !(inode->i_state & I_DIRTY_DATASYNC))
+			goto out;
+		if (inode->i_state & (I_DIRTY_SYNC|I_DIRTY_DATASYNC))
+			ret = sync_inode(inode, &wbc);
+		goto out;
 	}
+
+	/*
+	 * The inode has already been logged by ext4_dirty_inode(), so all
+	 * we need is for the transaction which last changed it to reach
+	 * the disk.  If that was committed already there is nothing to do
+	 * but flush the data; concurrent fsyncs of a running transaction
+	 * share a single commit.
+	 */
+	if (!datasync || (inode->i_state & I_DIRTY_DATASYNC)) {
+		ret = jbd2_complete_transaction(journal,
+						EXT4_I(inode)->i_sync_tid);
+		if (ret < 0)
+			goto out;
+	}
+
+	/*
+	 * A commit of a transaction that was still running when we came in
+	 * went out after the caller's data writes, and its commit record is
+	 * a barrier: don't flush the cache a second time.  With an external
+	 * journal that barrier only reaches the journal device, so the
+	 * filesystem device still needs its own flush.
+	 */
+	if ((journal->j_flags & JBD2_BARRIER) &&
+	    (!ret || journal->j_fs_dev != journal->j_dev ||
+	     JBD2_HAS_INCOMPAT_FEATURE(journal,
+				JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)))
+		blkdev_issue_flush(inode->i_sb->s_bdev, NULL);
+	ret = 0;
 out:
 	return ret;
 }
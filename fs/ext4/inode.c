@@ -1136,6 +1136,9 @@ int ext4_get_blocks_wrap(handle_t *handle, struct inode *inode, sector_t block,
 		}
 	}
 
+	if (retval > 0 && handle)
+		ext4_update_inode_fsync_trans(handle, inode);
+
 	if (flag) {
 		EXT4_I(inode)->i_delalloc_reserved_flag = 0;
 		/*
@@ -4190,6 +4193,7 @@ static blkcnt_t ext4_inode_blocks(struct ext4_inode *raw_inode,
 
 struct inode *ext4_iget(struct super_block *sb, unsigned long ino)
 {
+	journal_t *journal = EXT4_SB(sb)->s_journal;
 	struct ext4_iloc iloc;
 	struct ext4_inode *raw_inode;
 	struct ext4_inode_info *ei;
@@ -4227,6 +4231,21 @@ struct inode *ext4_iget(struct super_block *sb, unsigned long ino)
 	ei->i_state = 0;
 	ei->i_dir_start_lookup = 0;
 	ei->i_dtime = le32_to_cpu(raw_inode->i_dtime);
+	/*
+	 * The inode may have been evicted with changes still sitting in a
+	 * transaction; have fsync wait for whatever is in flight.
+	 */
+	if (journal) {
+		transaction_t *transaction;
+
+		spin_lock(&journal->j_state_lock);
+		transaction = journal->j_running_transaction;
+		if (!transaction)
+			transaction = journal->j_committing_transaction;
+		ei->i_sync_tid = transaction ? transaction->t_tid :
+					       journal->j_commit_sequence;
+		spin_unlock(&journal->j_state_lock);
+	}
 	/* We now have enough fields to check if the inode was active or not.
 	 * This is needed because nfsd might try to access dead inodes
 	 * the test is that same one that e2fsck uses
@@ -4488,6 +4507,7 @@ static int ext4_do_update_inode(handle_t *handle,
 	if (!err)
 		err = rc;
 	ei->i_state &= ~EXT4_STATE_NEW;
+	ext4_update_inode_fsync_trans(handle, inode);
 
 out_brelse:
 	brelse(bh);
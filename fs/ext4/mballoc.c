@@ -670,6 +670,41 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 	}
 }
 
+/*
+ * Initialized groups are kept on per-order lists keyed by the largest
+ * free buddy they have, so that cr 0 can go straight to a group able
+ * to satisfy a 2^N request instead of walking all of them. Must be
+ * called with the group locked, after the buddy counters changed.
+ */
+static void
+mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int i;
+
+	for (i = sb->s_blocksize_bits + 1; i >= 0; i--)
+		if (grp->bb_counters[i] > 0)
+			break;
+	/* nothing to do if the order did not change */
+	if (i == grp->bb_largest_free_order)
+		return;
+
+	if (grp->bb_largest_free_order >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[
+					grp->bb_largest_free_order]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[
+					grp->bb_largest_free_order]);
+	}
+	grp->bb_largest_free_order = i;
+	if (i >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[i]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+}
+
 static void ext4_mb_generate_buddy(struct super_block *sb,
 				void *buddy, void *bitmap, ext4_group_t group)
 {
@@ -712,7 +747,10 @@ static void ext4_mb_generate_buddy(struct super_block *sb,
 		grp->bb_free = free;
 	}
 
-	clear_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &(grp->bb_state));
+	/* the order lists must only ever hold initialized groups */
+	if (test_and_clear_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &(grp->bb_state)))
+		atomic_dec(&EXT4_SB(sb)->s_mb_groups_need_init);
+	mb_set_largest_free_order(sb, grp);
 
 	period = get_cycles() - period;
 	spin_lock(&EXT4_SB(sb)->s_bal_lock);
@@ -1202,6 +1240,7 @@ static void mb_free_blocks(struct inode *inode, struct ext4_buddy *e4b,
 			buddy = buddy2;
 		} while (1);
 	}
+	mb_set_largest_free_order(sb, e4b->bd_info);
 	mb_check_buddy(e4b);
 }
 
@@ -1331,6 +1370,8 @@ static int mb_mark_used(struct ext4_buddy *e4b, struct ext4_free_extent *ex)
 		e4b->bd_info->bb_counters[ord]++;
 	}
 
+	mb_set_largest_free_order(e4b->bd_sb, e4b->bd_info);
+
 	mb_set_bits(sb_bgl_lock(EXT4_SB(e4b->bd_sb), ex->fe_group),
 			EXT4_MB_BITMAP(e4b), ex->fe_start, len0);
 	mb_check_buddy(e4b);
@@ -1725,7 +1766,6 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 				ext4_group_t group, int cr)
 {
 	unsigned free, fragments;
-	unsigned i, bits;
 	struct ext4_group_desc *desc;
 	struct ext4_group_info *grp = ext4_get_group_info(ac->ac_sb, group);
 
@@ -1747,10 +1787,8 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 		if (desc->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT))
 			return 0;
 
-		bits = ac->ac_sb->s_blocksize_bits + 1;
-		for (i = ac->ac_2order; i <= bits; i++)
-			if (grp->bb_counters[i] > 0)
-				return 1;
+		if (grp->bb_largest_free_order >= ac->ac_2order)
+			return 1;
 		break;
 	case 1:
 		if ((free / fragments) >= ac->ac_g_ex.fe_len)
@@ -1936,11 +1974,130 @@ err:
 	return ret;
 }
 
+/*
+ * Start reads of the block bitmaps of up to nr groups from the given
+ * one which still need their buddy built, so that initializing them
+ * later in the scan finds the bitmap in memory or at least in flight.
+ * ext4_mb_init_cache() waits on the locked buffer and picks it up.
+ */
+static void ext4_mb_prefetch(struct super_block *sb, ext4_group_t group,
+			     unsigned int nr)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_desc *desc;
+	struct ext4_group_info *grp;
+	struct buffer_head *bh;
+	unsigned int count = 0;
+
+	while (nr-- > 0) {
+		if (group >= sbi->s_groups_count)
+			group = 0;
+		grp = ext4_get_group_info(sb, group);
+		desc = ext4_get_group_desc(sb, group, NULL);
+		/* uninit groups are built in memory, nothing to read */
+		if (desc && grp->bb_free && EXT4_MB_GRP_NEED_INIT(grp) &&
+		    !(desc->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT))) {
+			bh = sb_getblk(sb, ext4_block_bitmap(sb, desc));
+			if (bh) {
+				if (!buffer_uptodate(bh) && !buffer_locked(bh)) {
+					ll_rw_block(READA, 1, &bh);
+					count++;
+				}
+				brelse(bh);
+			}
+		}
+		group++;
+	}
+	if (count && sbi->s_mb_stats)
+		atomic_add(count, &sbi->s_mb_prefetched);
+}
+
+/*
+ * Pick the first group from the largest free order lists which can
+ * satisfy the 2^N request at cr 0.
+ */
+static int ext4_mb_find_group_by_order(struct ext4_allocation_context *ac,
+				       ext4_group_t *group)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct ext4_group_info *grp;
+	int i, found = 0;
+
+	for (i = ac->ac_2order;
+	     i <= ac->ac_sb->s_blocksize_bits + 1 && !found; i++) {
+		if (list_empty(&sbi->s_mb_largest_free_orders[i]))
+			continue;
+		read_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_for_each_entry(grp, &sbi->s_mb_largest_free_orders[i],
+				    bb_largest_free_order_node) {
+			if (EXT4_MB_GRP_NEED_INIT(grp))
+				continue;
+			if (ext4_mb_good_group(ac, grp->bb_group, 0)) {
+				*group = grp->bb_group;
+				found = 1;
+				break;
+			}
+		}
+		read_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+	return found;
+}
+
+/*
+ * cr 0 driven by the largest free order lists. Returns 1 if the lists
+ * hold no suitable group, 0 if the caller should go on scanning, or a
+ * negative error.
+ */
+static noinline_for_stack int
+ext4_mb_scan_order_lists(struct ext4_allocation_context *ac,
+			 struct ext4_buddy *e4b)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	ext4_group_t group;
+	int tries;
+	int err;
+
+	ac->ac_criteria = 0;
+	for (tries = 0; tries < MB_MAX_ORDER_LIST_TRIES; tries++) {
+		if (!ext4_mb_find_group_by_order(ac, &group))
+			return 1;
+
+		err = ext4_mb_load_buddy(sb, group, e4b);
+		if (err)
+			return err;
+
+		ext4_lock_group(sb, group);
+		if (!ext4_mb_good_group(ac, group, 0)) {
+			/* someone did allocation from this group */
+			ext4_unlock_group(sb, group);
+			ext4_mb_release_desc(e4b);
+			continue;
+		}
+
+		ac->ac_groups_scanned++;
+		if (sbi->s_mb_stats)
+			atomic_inc(&sbi->s_bal_cr_groups[0]);
+		ext4_mb_simple_scan_group(ac, e4b);
+
+		ext4_unlock_group(sb, group);
+		ext4_mb_release_desc(e4b);
+
+		if (ac->ac_status != AC_STATUS_CONTINUE) {
+			if (sbi->s_mb_stats)
+				atomic_inc(&sbi->s_bal_list_hits);
+			break;
+		}
+	}
+	return 0;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
 	ext4_group_t group;
 	ext4_group_t i;
+	unsigned int prefetch_left = 0;
 	int cr;
 	int err = 0;
 	int bsbits;
@@ -1998,6 +2155,21 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 	}
 	/* Let's just scan groups to find more-less suitable blocks */
 	cr = ac->ac_2order ? 0 : 1;
+	if (cr == 0 && sbi->s_mb_optimize_scan) {
+		err = ext4_mb_scan_order_lists(ac, &e4b);
+		if (err < 0)
+			goto out;
+		/*
+		 * groups still needing init are not on the lists yet,
+		 * so only skip the cr 0 scan once they all are
+		 */
+		if (err > 0 && !atomic_read(&sbi->s_mb_groups_need_init)) {
+			if (sbi->s_mb_stats)
+				atomic_inc(&sbi->s_bal_cr0_skipped);
+			cr = 1;
+		}
+		err = 0;
+	}
 	/*
 	 * cr == 0 try to get exact allocation,
 	 * cr == 3  try to get anything
@@ -2017,6 +2189,8 @@ repeat:
 
 			if (group == EXT4_SB(sb)->s_groups_count)
 				group = 0;
+			if (prefetch_left)
+				prefetch_left--;
 
 			/* quick check to skip empty groups */
 			grp = ext4_get_group_info(sb, group);
@@ -2028,6 +2202,19 @@ repeat:
 			 * a good group and if not we don't load the buddy
 			 */
 			if (EXT4_MB_GRP_NEED_INIT(grp)) {
+				/*
+				 * cold buddy cache: get the bitmaps of the
+				 * next groups on their way before we block
+				 * reading this one
+				 */
+				if (prefetch_left == 0 && sbi->s_mb_prefetch) {
+					/* the tunable may exceed the groups */
+					prefetch_left = min_t(unsigned int,
+							sbi->s_mb_prefetch,
+							sbi->s_groups_count);
+					ext4_mb_prefetch(sb, group,
+							 prefetch_left);
+				}
 				/*
 				 * we need full data about the group
 				 * to make a good selection
@@ -2057,6 +2244,8 @@ repeat:
 			}
 
 			ac->ac_groups_scanned++;
+			if (sbi->s_mb_stats)
+				atomic_inc(&sbi->s_bal_cr_groups[cr]);
 			desc = ext4_get_group_desc(sb, group, NULL);
 			if (cr == 0 || (desc->bg_flags &
 					cpu_to_le16(EXT4_BG_BLOCK_UNINIT) &&
@@ -2074,6 +2263,8 @@ repeat:
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
 		}
+		if (ac->ac_status == AC_STATUS_CONTINUE && sbi->s_mb_stats)
+			atomic_inc(&sbi->s_bal_cr_failed[cr]);
 	}
 
 	if (ac->ac_b_ex.fe_len > 0 && ac->ac_status != AC_STATUS_FOUND &&
@@ -2101,6 +2292,8 @@ repeat:
 			goto repeat;
 		}
 	}
+	if (ac->ac_status == AC_STATUS_FOUND && sbi->s_mb_stats)
+		atomic_inc(&sbi->s_bal_cr_hits[ac->ac_criteria]);
 out:
 	return err;
 }
@@ -2543,6 +2736,10 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	}
 
 	INIT_LIST_HEAD(&meta_group_info[i]->bb_prealloc_list);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
+	meta_group_info[i]->bb_largest_free_order = -1;
+	meta_group_info[i]->bb_group = group;
+	atomic_inc(&sbi->s_mb_groups_need_init);
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root.rb_node = NULL;;
 
@@ -2579,6 +2776,31 @@ void ext4_mb_update_group_info(struct ext4_group_info *grp, ext4_grpblk_t add)
 	grp->bb_free += add;
 }
 
+/*
+ * Request a reload of the buddy from the bitmap, e.g. after online resize
+ * extended the group. The group is taken off the largest free order lists
+ * before it is marked, so that a cr 0 lookup never sees it uninitialized.
+ * Called with the group's alloc_sem held for writing.
+ */
+void ext4_mb_group_need_init(struct super_block *sb, ext4_group_t group)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp = ext4_get_group_info(sb, group);
+	int order;
+
+	ext4_lock_group(sb, group);
+	order = grp->bb_largest_free_order;
+	if (order >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[order]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+		grp->bb_largest_free_order = -1;
+	}
+	if (!test_and_set_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &(grp->bb_state)))
+		atomic_inc(&sbi->s_mb_groups_need_init);
+	ext4_unlock_group(sb, group);
+}
+
 static int ext4_mb_init_backend(struct super_block *sb)
 {
 	ext4_group_t i;
@@ -2712,13 +2934,26 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 		i++;
 	} while (i <= sb->s_blocksize_bits + 1);
 
+	i = sb->s_blocksize_bits + 2;
+	sbi->s_mb_largest_free_orders =
+		kmalloc(i * sizeof(struct list_head), GFP_KERNEL);
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc(i * sizeof(rwlock_t), GFP_KERNEL);
+	if (sbi->s_mb_largest_free_orders == NULL ||
+	    sbi->s_mb_largest_free_orders_locks == NULL) {
+		ret = -ENOMEM;
+		goto out_free_orders;
+	}
+	for (i = 0; i < sb->s_blocksize_bits + 2; i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+	atomic_set(&sbi->s_mb_groups_need_init, 0);
+
 	/* init file for buddy data */
 	ret = ext4_mb_init_backend(sb);
-	if (ret != 0) {
-		kfree(sbi->s_mb_offsets);
-		kfree(sbi->s_mb_maxs);
-		return ret;
-	}
+	if (ret != 0)
+		goto out_free_orders;
 
 	spin_lock_init(&sbi->s_md_lock);
 	spin_lock_init(&sbi->s_bal_lock);
@@ -2730,12 +2965,13 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
 	sbi->s_mb_history_filter = EXT4_MB_HISTORY_DEFAULT;
 	sbi->s_mb_group_prealloc = MB_DEFAULT_GROUP_PREALLOC;
+	sbi->s_mb_prefetch = MB_DEFAULT_PREFETCH;
+	sbi->s_mb_optimize_scan = 1;
 
 	sbi->s_locality_groups = alloc_percpu(struct ext4_locality_group);
 	if (sbi->s_locality_groups == NULL) {
-		kfree(sbi->s_mb_offsets);
-		kfree(sbi->s_mb_maxs);
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto out_free_orders;
 	}
 	for_each_possible_cpu(i) {
 		struct ext4_locality_group *lg;
@@ -2754,6 +2990,13 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 
 	printk(KERN_INFO "EXT4-fs: mballoc enabled\n");
 	return 0;
+
+out_free_orders:
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	kfree(sbi->s_mb_offsets);
+	kfree(sbi->s_mb_maxs);
+	return ret;
 }
 
 /* need to called with ext4 group lock (ext4_lock_group) */
@@ -2801,6 +3044,8 @@ int ext4_mb_release(struct super_block *sb)
 	}
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	if (sbi->s_buddy_cache)
 		iput(sbi->s_buddy_cache);
 	if (sbi->s_mb_stats) {
@@ -2896,6 +3141,75 @@ static void release_blocks_on_commit(journal_t *journal, transaction_t *txn)
 #define EXT4_MB_ORDER2_REQ		"order2_req"
 #define EXT4_MB_STREAM_REQ		"stream_req"
 #define EXT4_MB_GROUP_PREALLOC		"group_prealloc"
+#define EXT4_MB_PREFETCH		"prefetch"
+#define EXT4_MB_OPTIMIZE_SCAN		"optimize_scan"
+#define EXT4_MB_STATS_FILE		"mb_stats"
+
+#ifdef CONFIG_PROC_FS
+static int ext4_mb_seq_stats_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int i;
+
+	if (!sbi->s_mb_stats) {
+		seq_printf(seq, "mballoc stats are disabled, see %s\n",
+			   EXT4_MB_STATS_NAME);
+		return 0;
+	}
+
+	seq_printf(seq, "reqs:\t\t\t%u\n", atomic_read(&sbi->s_bal_reqs));
+	seq_printf(seq, "success:\t\t%u\n",
+		   atomic_read(&sbi->s_bal_success));
+	seq_printf(seq, "blocks:\t\t\t%u\n",
+		   atomic_read(&sbi->s_bal_allocated));
+	seq_printf(seq, "extents_scanned:\t%u\n",
+		   atomic_read(&sbi->s_bal_ex_scanned));
+	seq_printf(seq, "goal_hits:\t\t%u\n", atomic_read(&sbi->s_bal_goals));
+	seq_printf(seq, "2^n_hits:\t\t%u\n",
+		   atomic_read(&sbi->s_bal_2orders));
+	seq_printf(seq, "breaks:\t\t\t%u\n", atomic_read(&sbi->s_bal_breaks));
+	seq_printf(seq, "lost:\t\t\t%u\n",
+		   atomic_read(&sbi->s_mb_lost_chunks));
+	for (i = 0; i < 4; i++)
+		seq_printf(seq, "cr%d:\t\t\t%u hits %u groups %u failed\n", i,
+			   atomic_read(&sbi->s_bal_cr_hits[i]),
+			   atomic_read(&sbi->s_bal_cr_groups[i]),
+			   atomic_read(&sbi->s_bal_cr_failed[i]));
+	seq_printf(seq, "cr0_list_hits:\t\t%u\n",
+		   atomic_read(&sbi->s_bal_list_hits));
+	seq_printf(seq, "cr0_skipped:\t\t%u\n",
+		   atomic_read(&sbi->s_bal_cr0_skipped));
+	seq_printf(seq, "groups_need_init:\t%u\n",
+		   atomic_read(&sbi->s_mb_groups_need_init));
+	seq_printf(seq, "bitmaps_prefetched:\t%u\n",
+		   atomic_read(&sbi->s_mb_prefetched));
+	spin_lock(&sbi->s_bal_lock);
+	seq_printf(seq, "buddies_generated:\t%lu\n",
+		   sbi->s_mb_buddies_generated);
+	seq_printf(seq, "buddies_time_used:\t%llu\n",
+		   sbi->s_mb_generation_time);
+	spin_unlock(&sbi->s_bal_lock);
+	seq_printf(seq, "preallocated:\t\t%u\n",
+		   atomic_read(&sbi->s_mb_preallocated));
+	seq_printf(seq, "discarded:\t\t%u\n",
+		   atomic_read(&sbi->s_mb_discarded));
+	return 0;
+}
+
+static int ext4_mb_seq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ext4_mb_seq_stats_show, PDE(inode)->data);
+}
+
+static struct file_operations ext4_mb_seq_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_mb_seq_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
 
 static int ext4_mb_init_per_dev_proc(struct super_block *sb)
 {
@@ -2913,9 +3227,21 @@ static int ext4_mb_init_per_dev_proc(struct super_block *sb)
 	EXT4_PROC_HANDLER(EXT4_MB_ORDER2_REQ, mb_order2_reqs);
 	EXT4_PROC_HANDLER(EXT4_MB_STREAM_REQ, mb_stream_request);
 	EXT4_PROC_HANDLER(EXT4_MB_GROUP_PREALLOC, mb_group_prealloc);
+	EXT4_PROC_HANDLER(EXT4_MB_PREFETCH, mb_prefetch);
+	EXT4_PROC_HANDLER(EXT4_MB_OPTIMIZE_SCAN, mb_optimize_scan);
+	proc = proc_create_data(EXT4_MB_STATS_FILE, S_IRUGO, sbi->s_proc,
+				&ext4_mb_seq_stats_fops, sb);
+	if (proc == NULL) {
+		printk(KERN_ERR "EXT4-fs: can't create %s\n",
+		       EXT4_MB_STATS_FILE);
+		goto err_out;
+	}
 	return 0;
 
 err_out:
+	remove_proc_entry(EXT4_MB_STATS_FILE, sbi->s_proc);
+	remove_proc_entry(EXT4_MB_OPTIMIZE_SCAN, sbi->s_proc);
+	remove_proc_entry(EXT4_MB_PREFETCH, sbi->s_proc);
 	remove_proc_entry(EXT4_MB_GROUP_PREALLOC, sbi->s_proc);
 	remove_proc_entry(EXT4_MB_STREAM_REQ, sbi->s_proc);
 	remove_proc_entry(EXT4_MB_ORDER2_REQ, sbi->s_proc);
@@ -2936,6 +3262,9 @@ static int ext4_mb_destroy_per_dev_proc(struct super_block *sb)
 	if (sbi->s_proc == NULL)
 		return -EINVAL;
 
+	remove_proc_entry(EXT4_MB_STATS_FILE, sbi->s_proc);
+	remove_proc_entry(EXT4_MB_OPTIMIZE_SCAN, sbi->s_proc);
+	remove_proc_entry(EXT4_MB_PREFETCH, sbi->s_proc);
 	remove_proc_entry(EXT4_MB_GROUP_PREALLOC, sbi->s_proc);
 	remove_proc_entry(EXT4_MB_STREAM_REQ, sbi->s_proc);
 	remove_proc_entry(EXT4_MB_ORDER2_REQ, sbi->s_proc);
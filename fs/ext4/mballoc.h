@@ -99,6 +99,19 @@
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * how many groups ahead of the scan mballoc reads block bitmaps for,
+ * so that a cold buddy cache is not loaded one synchronous read at
+ * a time. We can tune it via /proc/fs/ext4/<partition>/prefetch
+ */
+#define MB_DEFAULT_PREFETCH		16
+
+/*
+ * number of groups taken from the largest free order lists before
+ * cr 0 falls back to the linear group scan
+ */
+#define MB_MAX_ORDER_LIST_TRIES		4
+
 
 struct ext4_free_data {
 	/* this links the free block information from group_info */
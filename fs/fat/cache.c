@@ -10,13 +10,22 @@
 
 #include <linux/fs.h>
 #include <linux/buffer_head.h>
+#include <linux/rbtree.h>
+#include <linux/mm.h>
 #include "fat.h"
 
+/*
+ * The cache is a per-inode tree of extents, each mapping a range of file
+ * clusters to a contiguous run of disk clusters.  It is filled in lazily
+ * by fat_get_cluster() as it walks the chain, so once a file has been
+ * walked a seek costs a tree lookup instead of a walk from the start.
+ */
+
 /* this must be > 0. */
-#define FAT_MAX_CACHE	8
+#define FAT_MAX_CACHE	1024
 
 struct fat_cache {
-	struct list_head cache_list;
+	struct rb_node rb_node;
 	int nr_contig;	/* number of contiguous clusters */
 	int fcluster;	/* cluster number in the file. */
 	int dcluster;	/* cluster number on disk. */
@@ -36,26 +45,36 @@ static inline int fat_max_cache(struct inode *inode)
 
 static struct kmem_cache *fat_cache_cachep;
 
-static void init_once(void *foo)
-{
-	struct fat_cache *cache = (struct fat_cache *)foo;
+/*
+ * Inodes that have extents cached, oldest first, for the shrinker.
+ * Lock order is ->cache_lru_lock, then fat_cache_lru_lock.
+ */
+static LIST_HEAD(fat_cache_lru);
+static DEFINE_SPINLOCK(fat_cache_lru_lock);
+static atomic_t fat_cache_count = ATOMIC_INIT(0);
 
-	INIT_LIST_HEAD(&cache->cache_list);
-}
+static int fat_cache_shrink(int nr_to_scan, gfp_t gfp_mask);
+
+static struct shrinker fat_cache_shrinker = {
+	.shrink = fat_cache_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
 
 int __init fat_cache_init(void)
 {
 	fat_cache_cachep = kmem_cache_create("fat_cache",
 				sizeof(struct fat_cache),
 				0, SLAB_RECLAIM_ACCOUNT|SLAB_MEM_SPREAD,
-				init_once);
+				NULL);
 	if (fat_cache_cachep == NULL)
 		return -ENOMEM;
+	register_shrinker(&fat_cache_shrinker);
 	return 0;
 }
 
 void fat_cache_destroy(void)
 {
+	unregister_shrinker(&fat_cache_shrinker);
 	kmem_cache_destroy(fat_cache_cachep);
 }
 
@@ -66,43 +85,33 @@ static inline struct fat_cache *fat_cache_alloc(struct inode *inode)
 
 static inline void fat_cache_free(struct fat_cache *cache)
 {
-	BUG_ON(!list_empty(&cache->cache_list));
 	kmem_cache_free(fat_cache_cachep, cache);
 }
 
-static inline void fat_cache_update_lru(struct inode *inode,
-					struct fat_cache *cache)
-{
-	if (MSDOS_I(inode)->cache_lru.next != &cache->cache_list)
-		list_move(&cache->cache_list, &MSDOS_I(inode)->cache_lru);
-}
-
 static int fat_cache_lookup(struct inode *inode, int fclus,
 			    struct fat_cache_id *cid,
 			    int *cached_fclus, int *cached_dclus)
 {
-	static struct fat_cache nohit = { .fcluster = 0, };
-
-	struct fat_cache *hit = &nohit, *p;
+	struct fat_cache *hit = NULL, *p;
+	struct rb_node *n;
 	int offset = -1;
 
 	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the cache of "fclus" or nearest cache. */
-		if (p->fcluster <= fclus && hit->fcluster < p->fcluster) {
+	/* Find the cache of "fclus" or nearest cache before it. */
+	n = MSDOS_I(inode)->cache_tree.rb_node;
+	while (n) {
+		p = rb_entry(n, struct fat_cache, rb_node);
+		if (p->fcluster <= fclus) {
 			hit = p;
-			if ((hit->fcluster + hit->nr_contig) < fclus) {
-				offset = hit->nr_contig;
-			} else {
-				offset = fclus - hit->fcluster;
+			if (p->fcluster == fclus)
 				break;
-			}
-		}
+			n = n->rb_right;
+		} else
+			n = n->rb_left;
 	}
-	if (hit != &nohit) {
-		fat_cache_update_lru(inode, hit);
-
-		cid->id = MSDOS_I(inode)->cache_valid_id;
+	cid->id = MSDOS_I(inode)->cache_valid_id;
+	if (hit) {
+		offset = min(fclus - hit->fcluster, hit->nr_contig);
 		cid->nr_contig = hit->nr_contig;
 		cid->fcluster = hit->fcluster;
 		cid->dcluster = hit->dcluster;
@@ -114,14 +123,28 @@ static int fat_cache_lookup(struct inode *inode, int fclus,
 	return offset;
 }
 
+/*
+ * Find the same part as "new" in cluster-chain, or the place to insert
+ * it.  Extents always start where the chain stops being contiguous, so
+ * they never overlap except at the same fcluster.
+ */
 static struct fat_cache *fat_cache_merge(struct inode *inode,
-					 struct fat_cache_id *new)
+					 struct fat_cache_id *new,
+					 struct rb_node ***link,
+					 struct rb_node **parent)
 {
 	struct fat_cache *p;
 
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the same part as "new" in cluster-chain. */
-		if (p->fcluster == new->fcluster) {
+	*link = &MSDOS_I(inode)->cache_tree.rb_node;
+	*parent = NULL;
+	while (**link) {
+		*parent = **link;
+		p = rb_entry(*parent, struct fat_cache, rb_node);
+		if (new->fcluster < p->fcluster)
+			*link = &(*parent)->rb_left;
+		else if (new->fcluster > p->fcluster)
+			*link = &(*parent)->rb_right;
+		else {
 			BUG_ON(p->dcluster != new->dcluster);
 			if (new->nr_contig > p->nr_contig)
 				p->nr_contig = new->nr_contig;
@@ -133,60 +156,79 @@ static struct fat_cache *fat_cache_merge(struct inode *inode,
 
 static void fat_cache_add(struct inode *inode, struct fat_cache_id *new)
 {
+	struct msdos_inode_info *i = MSDOS_I(inode);
 	struct fat_cache *cache, *tmp;
+	struct rb_node **link, *parent;
 
 	if (new->fcluster == -1) /* dummy cache */
 		return;
 
-	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
-	if (new->id != FAT_CACHE_VALID &&
-	    new->id != MSDOS_I(inode)->cache_valid_id)
+	spin_lock(&i->cache_lru_lock);
+	if (new->id != i->cache_valid_id)
 		goto out;	/* this cache was invalidated */
 
-	cache = fat_cache_merge(inode, new);
+	cache = fat_cache_merge(inode, new, &link, &parent);
 	if (cache == NULL) {
-		if (MSDOS_I(inode)->nr_caches < fat_max_cache(inode)) {
-			MSDOS_I(inode)->nr_caches++;
-			spin_unlock(&MSDOS_I(inode)->cache_lru_lock);
-
-			tmp = fat_cache_alloc(inode);
-			spin_lock(&MSDOS_I(inode)->cache_lru_lock);
-			cache = fat_cache_merge(inode, new);
-			if (cache != NULL) {
-				MSDOS_I(inode)->nr_caches--;
+		if (i->nr_caches >= fat_max_cache(inode))
+			goto out;
+
+		i->nr_caches++;
+		spin_unlock(&i->cache_lru_lock);
+
+		tmp = fat_cache_alloc(inode);
+		spin_lock(&i->cache_lru_lock);
+		if (new->id != i->cache_valid_id) {
+			/* invalidated, and nr_caches was reset with it */
+			if (tmp)
 				fat_cache_free(tmp);
-				goto out_update_lru;
-			}
-			cache = tmp;
-		} else {
-			struct list_head *p = MSDOS_I(inode)->cache_lru.prev;
-			cache = list_entry(p, struct fat_cache, cache_list);
+			goto out;
 		}
+		cache = fat_cache_merge(inode, new, &link, &parent);
+		if (cache != NULL || tmp == NULL) {
+			i->nr_caches--;
+			if (tmp)
+				fat_cache_free(tmp);
+			goto out;
+		}
+		cache = tmp;
 		cache->fcluster = new->fcluster;
 		cache->dcluster = new->dcluster;
 		cache->nr_contig = new->nr_contig;
+		rb_link_node(&cache->rb_node, parent, link);
+		rb_insert_color(&cache->rb_node, &i->cache_tree);
+		atomic_inc(&fat_cache_count);
+
+		/*
+		 * nr_caches was raised before the allocation, so it doesn't
+		 * tell whether we are the first extent: check the list.
+		 */
+		spin_lock(&fat_cache_lru_lock);
+		if (list_empty(&i->cache_lru))
+			list_add_tail(&i->cache_lru, &fat_cache_lru);
+		spin_unlock(&fat_cache_lru_lock);
 	}
-out_update_lru:
-	fat_cache_update_lru(inode, cache);
 out:
-	spin_unlock(&MSDOS_I(inode)->cache_lru_lock);
+	spin_unlock(&i->cache_lru_lock);
 }
 
 /*
- * Cache invalidation occurs rarely, thus the LRU chain is not updated. It
- * fixes itself after a while.
+ * Drops all the extents of the inode.  Called with ->cache_lru_lock and
+ * fat_cache_lru_lock held.
  */
-static void __fat_cache_inval_inode(struct inode *inode)
+static void __fat_cache_drop(struct msdos_inode_info *i)
 {
-	struct msdos_inode_info *i = MSDOS_I(inode);
 	struct fat_cache *cache;
+	struct rb_node *n;
 
-	while (!list_empty(&i->cache_lru)) {
-		cache = list_entry(i->cache_lru.next, struct fat_cache, cache_list);
-		list_del_init(&cache->cache_list);
-		i->nr_caches--;
+	while ((n = rb_first(&i->cache_tree)) != NULL) {
+		cache = rb_entry(n, struct fat_cache, rb_node);
+		rb_erase(n, &i->cache_tree);
 		fat_cache_free(cache);
+		atomic_dec(&fat_cache_count);
 	}
+	i->nr_caches = 0;
+	list_del_init(&i->cache_lru);
+
 	/* Update. The copy of caches before this id is discarded. */
 	i->cache_valid_id++;
 	if (i->cache_valid_id == FAT_CACHE_VALID)
@@ -195,9 +237,37 @@ static void __fat_cache_inval_inode(struct inode *inode)
 
 void fat_cache_inval_inode(struct inode *inode)
 {
-	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
-	__fat_cache_inval_inode(inode);
-	spin_unlock(&MSDOS_I(inode)->cache_lru_lock);
+	struct msdos_inode_info *i = MSDOS_I(inode);
+
+	spin_lock(&i->cache_lru_lock);
+	spin_lock(&fat_cache_lru_lock);
+	__fat_cache_drop(i);
+	spin_unlock(&fat_cache_lru_lock);
+	spin_unlock(&i->cache_lru_lock);
+}
+
+/*
+ * Under memory pressure drop whole trees, starting with the inodes which
+ * cached something first.  Inodes that are busy are skipped.
+ */
+static int fat_cache_shrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	struct msdos_inode_info *i, *tmp;
+
+	if (nr_to_scan) {
+		spin_lock(&fat_cache_lru_lock);
+		list_for_each_entry_safe(i, tmp, &fat_cache_lru, cache_lru) {
+			if (nr_to_scan <= 0)
+				break;
+			if (!spin_trylock(&i->cache_lru_lock))
+				continue;
+			nr_to_scan -= i->nr_caches;
+			__fat_cache_drop(i);
+			spin_unlock(&i->cache_lru_lock);
+		}
+		spin_unlock(&fat_cache_lru_lock);
+	}
+	return (atomic_read(&fat_cache_count) / 100) * sysctl_vfs_cache_pressure;
 }
 
 static inline int cache_contiguous(struct fat_cache_id *cid, int dclus)
@@ -208,7 +278,6 @@ static inline int cache_contiguous(struct fat_cache_id *cid, int dclus)
 
 static inline void cache_init(struct fat_cache_id *cid, int fclus, int dclus)
 {
-	cid->id = FAT_CACHE_VALID;
 	cid->fcluster = fclus;
 	cid->dcluster = dclus;
 	cid->nr_contig = 0;
@@ -230,11 +299,8 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 		return 0;
 
 	if (fat_cache_lookup(inode, cluster, &cid, fclus, dclus) < 0) {
-		/*
-		 * dummy, always not contiguous
-		 * This is reinitialized by cache_init(), later.
-		 */
-		cache_init(&cid, -1, -1);
+		/* nothing cached, start from the first cluster */
+		cache_init(&cid, 0, MSDOS_I(inode)->i_start);
 	}
 
 	fatent_init(&fatent);
@@ -263,8 +329,12 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 		}
 		(*fclus)++;
 		*dclus = nr;
-		if (!cache_contiguous(&cid, *dclus))
+		if (!cache_contiguous(&cid, *dclus)) {
+			/* remember each run we pass, not just the last */
+			cid.nr_contig--;
+			fat_cache_add(inode, &cid);
 			cache_init(&cid, *fclus, *dclus);
+		}
 	}
 	nr = 0;
 	fat_cache_add(inode, &cid);
@@ -6,6 +6,8 @@
 #include <linux/nls.h>
 #include <linux/fs.h>
 #include <linux/mutex.h>
+#include <linux/completion.h>
+#include <linux/rbtree.h>
 #include <linux/msdos_fs.h>
 
 /*
@@ -70,6 +72,10 @@ struct msdos_sb_info {
 	unsigned int prev_free;      /* previously allocated cluster number */
 	unsigned int free_clusters;  /* -1 if undefined */
 	unsigned int free_clus_valid; /* is free_clusters valid? */
+	unsigned long *free_bitmap;  /* set bit = free cluster, or NULL */
+	unsigned int free_bitmap_valid; /* is free_bitmap built? */
+	int free_bitmap_abort;	     /* stop building free_bitmap */
+	struct completion free_bitmap_done; /* free_bitmap builder exited */
 	struct fat_mount_options options;
 	struct nls_table *nls_disk;  /* Codepage used on disk */
 	struct nls_table *nls_io;    /* Charset used for input and display */
@@ -92,7 +98,8 @@ struct msdos_sb_info {
  */
 struct msdos_inode_info {
 	spinlock_t cache_lru_lock;
-	struct list_head cache_lru;
+	struct rb_root cache_tree;	/* cached extents of the chain */
+	struct list_head cache_lru;	/* on the shrinker's list */
 	int nr_caches;
 	/* for avoiding the race between fat_free() and fat_get_cluster() */
 	unsigned int cache_valid_id;
@@ -292,6 +299,8 @@ extern int fat_alloc_clusters(struct inode *inode, int *cluster,
 			      int nr_cluster);
 extern int fat_free_clusters(struct inode *inode, int cluster);
 extern int fat_count_free_clusters(struct super_block *sb);
+extern void fat_free_bitmap_start(struct super_block *sb);
+extern void fat_free_bitmap_stop(struct super_block *sb);
 
 /* fat/file.c */
 extern int fat_generic_ioctl(struct inode *inode, struct file *filp,
@@ -7,6 +7,8 @@
 #include <linux/fs.h>
 #include <linux/msdos_fs.h>
 #include <linux/blkdev.h>
+#include <linux/kthread.h>
+#include <linux/vmalloc.h>
 #include "fat.h"
 
 struct fatent_operations {
@@ -449,6 +451,74 @@ static void fat_collect_bhs(struct buffer_head **bhs, int *nr_bhs,
 	}
 }
 
+/*
+ * Free cluster bitmap.  Once it is valid, a set bit means the cluster is
+ * free, and fat_alloc_clusters() can find free clusters without reading
+ * the FAT.  All of it is protected by fat_lock.
+ */
+
+/* Find the next free cluster at or after @start, wrapping around */
+static int fat_bitmap_next_free(struct msdos_sb_info *sbi, int start)
+{
+	unsigned long max = sbi->max_cluster;
+	unsigned long n;
+
+	if (start < FAT_START_ENT || start >= max)
+		start = FAT_START_ENT;
+	n = find_next_bit(sbi->free_bitmap, max, start);
+	if (n >= max)
+		n = find_next_bit(sbi->free_bitmap, max, FAT_START_ENT);
+	return n < max ? n : -1;
+}
+
+/*
+ * Find the first run of @nr free clusters at or after @start.  If there
+ * is no such run, just return the next free cluster.
+ */
+static int fat_bitmap_find_extent(struct msdos_sb_info *sbi, int start,
+				  int nr)
+{
+	unsigned long max = sbi->max_cluster;
+	unsigned long n, end;
+	int wrapped = 0;
+
+	if (start < FAT_START_ENT || start >= max)
+		start = FAT_START_ENT;
+	n = start;
+	while (nr > 1) {
+		n = find_next_bit(sbi->free_bitmap, max, n);
+		if (n >= max) {
+			if (wrapped)
+				break;
+			wrapped = 1;
+			n = FAT_START_ENT;
+			continue;
+		}
+		if (wrapped && n >= start)
+			break;
+		end = find_next_zero_bit(sbi->free_bitmap, max, n);
+		if (end - n >= nr)
+			return n;
+		n = end;
+	}
+	return fat_bitmap_next_free(sbi, start);
+}
+
+/*
+ * Returns the cluster just after the last one of @inode.  Allocating there
+ * keeps the file contiguous, even when several files grow at once.
+ */
+static int fat_alloc_goal(struct inode *inode)
+{
+	int fclus, dclus;
+
+	if (!MSDOS_I(inode)->i_start)
+		return 0;
+	if (fat_get_cluster(inode, FAT_ENT_EOF, &fclus, &dclus) < 0)
+		return 0;
+	return dclus + 1;
+}
+
 int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 {
 	struct super_block *sb = inode->i_sb;
@@ -456,10 +526,12 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	struct fatent_operations *ops = sbi->fatent_ops;
 	struct fat_entry fatent, prev_ent;
 	struct buffer_head *bhs[MAX_BUF_PER_PAGE];
-	int i, count, err, nr_bhs, idx_clus;
+	int i, count, err, nr_bhs, idx_clus, goal, entry;
 
 	BUG_ON(nr_cluster > (MAX_BUF_PER_PAGE / 2));	/* fixed limit */
 
+	goal = sbi->free_bitmap_valid ? fat_alloc_goal(inode) : 0;
+
 	lock_fat(sbi);
 	if (sbi->free_clusters != -1 && sbi->free_clus_valid &&
 	    sbi->free_clusters < nr_cluster) {
@@ -471,6 +543,49 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	count = FAT_START_ENT;
 	fatent_init(&prev_ent);
 	fatent_init(&fatent);
+
+	if (sbi->free_bitmap_valid) {
+		if (goal >= FAT_START_ENT && goal < sbi->max_cluster &&
+		    test_bit(goal, sbi->free_bitmap))
+			entry = goal;
+		else
+			entry = fat_bitmap_find_extent(sbi, sbi->prev_free + 1,
+						       nr_cluster);
+		while (entry >= 0) {
+			err = fat_ent_read(inode, &fatent, entry);
+			if (err < 0)
+				goto out;
+			if (err != FAT_ENT_FREE) {
+				fat_fs_error(sb, "%s: free cluster bitmap is"
+					     " out of sync (entry 0x%08x)",
+					     __func__, entry);
+				err = -EIO;
+				goto out;
+			}
+			err = 0;
+
+			ops->ent_put(&fatent, FAT_ENT_EOF);
+			if (prev_ent.nr_bhs)
+				ops->ent_put(&prev_ent, entry);
+
+			fat_collect_bhs(bhs, &nr_bhs, &fatent);
+
+			clear_bit(entry, sbi->free_bitmap);
+			sbi->prev_free = entry;
+			sbi->free_clusters--;
+			sb->s_dirt = 1;
+
+			cluster[idx_clus] = entry;
+			idx_clus++;
+			if (idx_clus == nr_cluster)
+				goto out;
+
+			prev_ent = fatent;
+			entry = fat_bitmap_next_free(sbi, entry + 1);
+		}
+		goto out_nospc;
+	}
+
 	fatent_set_entry(&fatent, sbi->prev_free + 1);
 	while (count < sbi->max_cluster) {
 		if (fatent.entry >= sbi->max_cluster)
@@ -483,7 +598,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 		/* Find the free entries in a block */
 		do {
 			if (ops->ent_get(&fatent) == FAT_ENT_FREE) {
-				int entry = fatent.entry;
+				entry = fatent.entry;
 
 				/* make the cluster chain */
 				ops->ent_put(&fatent, FAT_ENT_EOF);
@@ -492,6 +607,8 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 
 				fat_collect_bhs(bhs, &nr_bhs, &fatent);
 
+				if (sbi->free_bitmap)
+					clear_bit(entry, sbi->free_bitmap);
 				sbi->prev_free = entry;
 				if (sbi->free_clusters != -1)
 					sbi->free_clusters--;
@@ -514,6 +631,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 		} while (fat_ent_next(sbi, &fatent));
 	}
 
+out_nospc:
 	/* Couldn't allocate the free entries */
 	sbi->free_clusters = 0;
 	sbi->free_clus_valid = 1;
@@ -576,6 +694,8 @@ int fat_free_clusters(struct inode *inode, int cluster)
 		}
 
 		ops->ent_put(&fatent, FAT_ENT_FREE);
+		if (sbi->free_bitmap)
+			set_bit(fatent.entry, sbi->free_bitmap);
 		if (sbi->free_clusters != -1) {
 			sbi->free_clusters++;
 			sb->s_dirt = 1;
@@ -662,15 +782,131 @@ int fat_count_free_clusters(struct super_block *sb)
 			goto out;
 
 		do {
-			if (ops->ent_get(&fatent) == FAT_ENT_FREE)
+			if (ops->ent_get(&fatent) == FAT_ENT_FREE) {
 				free++;
+				if (sbi->free_bitmap)
+					set_bit(fatent.entry,
+						sbi->free_bitmap);
+			} else if (sbi->free_bitmap)
+				clear_bit(fatent.entry, sbi->free_bitmap);
 		} while (fat_ent_next(sbi, &fatent));
 	}
 	sbi->free_clusters = free;
 	sbi->free_clus_valid = 1;
+	if (sbi->free_bitmap)
+		sbi->free_bitmap_valid = 1;
 	sb->s_dirt = 1;
 	fatent_brelse(&fatent);
 out:
 	unlock_fat(sbi);
 	return err;
 }
+
+/* Don't use more than this for the free cluster bitmap */
+#define FAT_MAX_BITMAP_SIZE	(4 * 1024 * 1024)
+
+/*
+ * Build the free cluster bitmap, taking fat_lock for one FAT block at a
+ * time so that allocations aren't held off for the whole scan.  Clusters
+ * allocated or freed meanwhile update the bitmap themselves, and the
+ * blocks not yet scanned are read after their changes.
+ */
+static int fat_free_bitmap_thread(void *arg)
+{
+	struct super_block *sb = arg;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct fatent_operations *ops = sbi->fatent_ops;
+	struct fat_entry fatent;
+	unsigned long reada_blocks, reada_mask, cur_block;
+	int err = 0, entry = FAT_START_ENT;
+
+	reada_blocks = FAT_READA_SIZE >> sb->s_blocksize_bits;
+	reada_mask = reada_blocks - 1;
+	cur_block = 0;
+
+	fatent_init(&fatent);
+	while (entry < sbi->max_cluster && !sbi->free_bitmap_abort) {
+		fatent_set_entry(&fatent, entry);
+		if ((cur_block & reada_mask) == 0) {
+			unsigned long rest = sbi->fat_length - cur_block;
+			fat_ent_reada(sb, &fatent, min(reada_blocks, rest));
+		}
+		cur_block++;
+
+		lock_fat(sbi);
+		if (sbi->free_bitmap_valid) {
+			/* fat_count_free_clusters() did it for us */
+			unlock_fat(sbi);
+			break;
+		}
+		err = fat_ent_read_block(sb, &fatent);
+		if (err) {
+			unlock_fat(sbi);
+			break;
+		}
+		do {
+			if (ops->ent_get(&fatent) == FAT_ENT_FREE)
+				set_bit(fatent.entry, sbi->free_bitmap);
+			else
+				clear_bit(fatent.entry, sbi->free_bitmap);
+		} while (fat_ent_next(sbi, &fatent));
+		entry = fatent.entry;
+		unlock_fat(sbi);
+
+		cond_resched();
+	}
+	fatent_brelse(&fatent);
+
+	lock_fat(sbi);
+	if (!err && !sbi->free_bitmap_abort && !sbi->free_bitmap_valid) {
+		sbi->free_clusters = bitmap_weight(sbi->free_bitmap,
+						   sbi->max_cluster);
+		sbi->free_clus_valid = 1;
+		sbi->free_bitmap_valid = 1;
+		sb->s_dirt = 1;
+	}
+	unlock_fat(sbi);
+
+	complete_and_exit(&sbi->free_bitmap_done, 0);
+}
+
+/*
+ * Allocates the free cluster bitmap and starts building it in the
+ * background.  Without it everything still works, just by reading the FAT.
+ */
+void fat_free_bitmap_start(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	unsigned long size = BITS_TO_LONGS(sbi->max_cluster) * sizeof(long);
+	struct task_struct *task;
+
+	init_completion(&sbi->free_bitmap_done);
+	sbi->free_bitmap_abort = 0;
+	sbi->free_bitmap_valid = 0;
+	sbi->free_bitmap = NULL;
+
+	if (size <= FAT_MAX_BITMAP_SIZE)
+		sbi->free_bitmap = vmalloc(size);
+	if (!sbi->free_bitmap) {
+		complete(&sbi->free_bitmap_done);
+		return;
+	}
+	memset(sbi->free_bitmap, 0, size);
+
+	task = kthread_run(fat_free_bitmap_thread, sb, "fat-bitmap/%s",
+			   sb->s_id);
+	if (IS_ERR(task))
+		complete(&sbi->free_bitmap_done);
+}
+
+void fat_free_bitmap_stop(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	sbi->free_bitmap_abort = 1;
+	wait_for_completion(&sbi->free_bitmap_done);
+
+	sbi->free_bitmap_valid = 0;
+	vfree(sbi->free_bitmap);
+	sbi->free_bitmap = NULL;
+}
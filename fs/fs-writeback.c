@@ -23,45 +23,59 @@
 #include <linux/blkdev.h>
 #include <linux/backing-dev.h>
 #include <linux/buffer_head.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
+/*
+ * The maximum number of pages to writeout in a single flusher pass.  We do
+ * this so we don't hold I_SYNC against an inode for enormous amounts of
+ * time, which would block a userspace task which has been forced to
+ * throttle against that inode.  Also, the code reevaluates the dirty each
+ * time it has written this many pages.
+ */
+#define MAX_WRITEBACK_PAGES	1024
 
-/**
- * writeback_acquire - attempt to get exclusive writeback access to a device
- * @bdi: the device's backing_dev_info structure
- *
- * It is a waste of resources to have more than one pdflush thread blocked on
- * a single request queue.  Exclusion at the request_queue level is obtained
- * via a flag in the request_queue's backing_dev_info.state.
- *
- * Non-request_queue-backed address_spaces will share default_backing_dev_info,
- * unless they implement their own.  Which is somewhat inefficient, as this
- * may prevent concurrent writeback against multiple devices.
+/*
+ * A flusher thread that found nothing to write for this long exits.  It is
+ * started again as soon as its device has dirty inodes.
  */
-static int writeback_acquire(struct backing_dev_info *bdi)
-{
-	return !test_and_set_bit(BDI_pdflush, &bdi->state);
-}
+#define BDI_IDLE_EXIT		(5 * 60 * HZ)
 
 /**
  * writeback_in_progress - determine whether there is writeback in progress
  * @bdi: the device's backing_dev_info structure.
  *
- * Determine whether there is writeback in progress against a backing device.
+ * Determine whether the flusher thread of a backing device is writing it
+ * back.
  */
 int writeback_in_progress(struct backing_dev_info *bdi)
 {
-	return test_bit(BDI_pdflush, &bdi->state);
+	return test_bit(BDI_writeback_running, &bdi->state);
 }
 
-/**
- * writeback_release - relinquish exclusive writeback access against a device.
- * @bdi: the device's backing_dev_info structure
+/*
+ * The bdi whose lists hold the dirty inodes of @bdi.  Filesystems that
+ * never registered their bdi are written back through the default one.
  */
-static void writeback_release(struct backing_dev_info *bdi)
+static struct backing_dev_info *wb_owner(struct backing_dev_info *bdi)
+{
+	if (bdi_cap_writeback_dirty(bdi) &&
+	    !test_bit(BDI_registered, &bdi->state))
+		return &default_backing_dev_info;
+	return bdi;
+}
+
+static inline struct backing_dev_info *inode_to_bdi(struct inode *inode)
+{
+	return wb_owner(inode->i_mapping->backing_dev_info);
+}
+
+int bdi_has_dirty_io(struct backing_dev_info *bdi)
 {
-	BUG_ON(!writeback_in_progress(bdi));
-	clear_bit(BDI_pdflush, &bdi->state);
+	return !list_empty(&bdi->b_dirty) ||
+	       !list_empty(&bdi->b_io) ||
+	       !list_empty(&bdi->b_more_io);
 }
 
 /**
@@ -71,7 +85,7 @@ static void writeback_release(struct backing_dev_info *bdi)
  *	Mark an inode as dirty. Callers should use mark_inode_dirty or
  *  	mark_inode_dirty_sync.
  *
- * Put the inode on the super block's dirty list.
+ * Put the inode on the dirty list of its backing device.
  *
  * CAREFUL! We mark it dirty unconditionally, but move it onto the
  * dirty list only if it is hashed or if it refers to a blockdev.
@@ -141,14 +155,14 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 		/*
 		 * If the inode is being synced, just update its dirty state.
 		 * The unlocker will place the inode on the appropriate
-		 * superblock list, based upon its state.
+		 * bdi list, based upon its state.
 		 */
 		if (inode->i_state & I_SYNC)
 			goto out;
 
 		/*
-		 * Only add valid (hashed) inodes to the superblock's
-		 * dirty list.  Add blockdev inodes as well.
+		 * Only add valid (hashed) inodes to the bdi's dirty list.
+		 * Add blockdev inodes as well.
 		 */
 		if (!S_ISBLK(inode->i_mode)) {
 			if (hlist_unhashed(&inode->i_hash))
@@ -158,12 +172,18 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 			goto out;
 
 		/*
-		 * If the inode was already on s_dirty/s_io/s_more_io, don't
-		 * reposition it (that would break s_dirty time-ordering).
+		 * If the inode was already on b_dirty/b_io/b_more_io, don't
+		 * reposition it (that would break b_dirty time-ordering).
 		 */
 		if (!was_dirty) {
+			struct backing_dev_info *bdi = inode_to_bdi(inode);
+
 			inode->dirtied_when = jiffies;
-			list_move(&inode->i_list, &sb->s_dirty);
+			list_move(&inode->i_list, &bdi->b_dirty);
+
+			/* Have a flusher started if the device has none */
+			if (!bdi->task && bdi_cap_writeback_dirty(bdi))
+				bdi_start_writeback(bdi, 0);
 		}
 	}
 out:
@@ -181,34 +201,34 @@ static int write_inode(struct inode *inode, int sync)
 
 /*
  * Redirty an inode: set its when-it-was dirtied timestamp and move it to the
- * furthest end of its superblock's dirty-inode list.
+ * furthest end of its bdi's dirty-inode list.
  *
  * Before stamping the inode's ->dirtied_when, we check to see whether it is
- * already the most-recently-dirtied inode on the s_dirty list.  If that is
+ * already the most-recently-dirtied inode on the b_dirty list.  If that is
  * the case then the inode must have been redirtied while it was being written
  * out and we don't reset its dirtied_when.
  */
 static void redirty_tail(struct inode *inode)
 {
-	struct super_block *sb = inode->i_sb;
+	struct backing_dev_info *bdi = inode_to_bdi(inode);
 
-	if (!list_empty(&sb->s_dirty)) {
+	if (!list_empty(&bdi->b_dirty)) {
 		struct inode *tail_inode;
 
-		tail_inode = list_entry(sb->s_dirty.next, struct inode, i_list);
+		tail_inode = list_entry(bdi->b_dirty.next, struct inode, i_list);
 		if (!time_after_eq(inode->dirtied_when,
 				tail_inode->dirtied_when))
 			inode->dirtied_when = jiffies;
 	}
-	list_move(&inode->i_list, &sb->s_dirty);
+	list_move(&inode->i_list, &bdi->b_dirty);
 }
 
 /*
- * requeue inode for re-scanning after sb->s_io list is exhausted.
+ * requeue inode for re-scanning after bdi->b_io list is exhausted.
  */
 static void requeue_io(struct inode *inode)
 {
-	list_move(&inode->i_list, &inode->i_sb->s_more_io);
+	list_move(&inode->i_list, &inode_to_bdi(inode)->b_more_io);
 }
 
 static void inode_sync_complete(struct inode *inode)
@@ -221,18 +241,22 @@ static void inode_sync_complete(struct inode *inode)
 }
 
 /*
- * Move expired dirty inodes from @delaying_queue to @dispatch_queue.
+ * Move expired dirty inodes from @delaying_queue to @dispatch_queue.  If @sb
+ * is given, inodes of other superblocks are left where they are.
  */
 static void move_expired_inodes(struct list_head *delaying_queue,
 			       struct list_head *dispatch_queue,
-				unsigned long *older_than_this)
+				unsigned long *older_than_this,
+				struct super_block *sb)
 {
-	while (!list_empty(delaying_queue)) {
-		struct inode *inode = list_entry(delaying_queue->prev,
-						struct inode, i_list);
+	struct inode *inode, *prev;
+
+	list_for_each_entry_safe_reverse(inode, prev, delaying_queue, i_list) {
 		if (older_than_this &&
 			time_after(inode->dirtied_when, *older_than_this))
 			break;
+		if (sb && inode->i_sb != sb)
+			continue;
 		list_move(&inode->i_list, dispatch_queue);
 	}
 }
@@ -240,18 +264,28 @@ static void move_expired_inodes(struct list_head *delaying_queue,
 /*
  * Queue all expired dirty inodes for io, eldest first.
  */
-static void queue_io(struct super_block *sb,
-				unsigned long *older_than_this)
+static void queue_io(struct backing_dev_info *bdi,
+				unsigned long *older_than_this,
+				struct super_block *sb)
 {
-	list_splice_init(&sb->s_more_io, sb->s_io.prev);
-	move_expired_inodes(&sb->s_dirty, &sb->s_io, older_than_this);
+	list_splice_init(&bdi->b_more_io, bdi->b_io.prev);
+	move_expired_inodes(&bdi->b_dirty, &bdi->b_io, older_than_this, sb);
 }
 
 int sb_has_dirty_inodes(struct super_block *sb)
 {
-	return !list_empty(&sb->s_dirty) ||
-	       !list_empty(&sb->s_io) ||
-	       !list_empty(&sb->s_more_io);
+	struct inode *inode;
+	int ret = 0;
+
+	spin_lock(&inode_lock);
+	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
+		if (inode->i_state & I_DIRTY) {
+			ret = 1;
+			break;
+		}
+	}
+	spin_unlock(&inode_lock);
+	return ret;
 }
 EXPORT_SYMBOL(sb_has_dirty_inodes);
 
@@ -307,11 +341,11 @@ __sync_single_inode(struct inode *inode, struct writeback_control *wbc)
 			/*
 			 * We didn't write back all the pages.  nfs_writepages()
 			 * sometimes bales out without doing anything. Redirty
-			 * the inode; Move it from s_io onto s_more_io/s_dirty.
+			 * the inode; Move it from b_io onto b_more_io/b_dirty.
 			 */
 			/*
 			 * akpm: if the caller was the kupdate function we put
-			 * this inode at the head of s_dirty so it gets first
+			 * this inode at the head of b_dirty so it gets first
 			 * consideration.  Otherwise, move it to the tail, for
 			 * the reasons described there.  I'm not really sure
 			 * how much sense this makes.  Presumably I had a good
@@ -321,7 +355,7 @@ __sync_single_inode(struct inode *inode, struct writeback_control *wbc)
 			if (wbc->for_kupdate) {
 				/*
 				 * For the kupdate function we move the inode
-				 * to s_more_io so it will get more writeout as
+				 * to b_more_io so it will get more writeout as
 				 * soon as the queue becomes uncongested.
 				 */
 				inode->i_state |= I_DIRTY_PAGES;
@@ -339,7 +373,7 @@ __sync_single_inode(struct inode *inode, struct writeback_control *wbc)
 			} else {
 				/*
 				 * Otherwise fully redirty the inode so that
-				 * other inodes on this superblock will get some
+				 * other inodes on this device will get some
 				 * writeout.  Otherwise heavy writing to one
 				 * file would indefinitely suspend writeout of
 				 * all the other files.
@@ -362,7 +396,8 @@ __sync_single_inode(struct inode *inode, struct writeback_control *wbc)
 			/*
 			 * The inode is clean, unused
 			 */
-			list_move(&inode->i_list, &inode_unused);
+			list_move(&inode->i_list,
+				  &inode->i_sb->s_inode_unused);
 		}
 	}
 	inode_sync_complete(inode);
@@ -387,10 +422,10 @@ __writeback_single_inode(struct inode *inode, struct writeback_control *wbc)
 	if ((wbc->sync_mode != WB_SYNC_ALL) && (inode->i_state & I_SYNC)) {
 		/*
 		 * We're skipping this inode because it's locked, and we're not
-		 * doing writeback-for-data-integrity.  Move it to s_more_io so
-		 * that writeback can proceed with the other inodes on s_io.
+		 * doing writeback-for-data-integrity.  Move it to b_more_io so
+		 * that writeback can proceed with the other inodes on b_io.
 		 * We'll have another go at writing back this inode when we
-		 * completed a full scan of s_io.
+		 * completed a full scan of b_io.
 		 */
 		requeue_io(inode);
 		return 0;
@@ -414,62 +449,91 @@ __writeback_single_inode(struct inode *inode, struct writeback_control *wbc)
 }
 
 /*
- * Write out a superblock's list of dirty inodes.  A wait will be performed
- * upon no inodes, all inodes or the final one, depending upon sync_mode.
+ * Flusher threads write back inodes of many superblocks.  Hold s_umount
+ * of the superblock an inode belongs to while writing it, so that it
+ * isn't unmounted under us; skip superblocks that are being mounted or
+ * unmounted.  The pin is kept across consecutive inodes of the same
+ * superblock.  Callers that pass a superblock in wbc->sb hold s_umount
+ * already.
+ *
+ * Called under inode_lock.  Returns nonzero if @inode has to be skipped.
+ */
+static int pin_sb_for_writeback(struct writeback_control *wbc,
+				struct inode *inode, struct super_block **psb)
+{
+	struct super_block *sb = inode->i_sb;
+
+	if (wbc->sb)
+		return 0;
+	if (sb == *psb)
+		return 0;
+	if (*psb) {
+		drop_super(*psb);
+		*psb = NULL;
+	}
+
+	spin_lock(&sb_lock);
+	sb->s_count++;
+	if (down_read_trylock(&sb->s_umount)) {
+		if (sb->s_root) {
+			spin_unlock(&sb_lock);
+			*psb = sb;
+			return 0;
+		}
+		up_read(&sb->s_umount);
+	}
+	sb->s_count--;
+	spin_unlock(&sb_lock);
+	return 1;
+}
+
+/*
+ * Write out a bdi's list of dirty inodes.
  *
  * If older_than_this is non-NULL, then only write out inodes which
  * had their first dirtying at a time earlier than *older_than_this.
  *
- * If we're a pdlfush thread, then implement pdflush collision avoidance
- * against the entire list.
+ * If wbc->sb is non-NULL, only inodes of that superblock are written.  If
+ * wbc->bdi is non-NULL, only inodes whose mapping is backed by it are
+ * written: this matters for the default bdi, whose lists also carry the
+ * inodes of filesystems that never registered their own bdi.
  *
- * If `bdi' is non-zero then we're being asked to writeback a specific queue.
- * This function assumes that the blockdev superblock's inodes are backed by
- * a variety of queues, so all inodes are searched.  For other superblocks,
- * assume that all inodes are backed by the same queue.
- *
- * FIXME: this linear search could get expensive with many fileystems.  But
- * how to fix?  We need to go from an address_space to all inodes which share
- * a queue with that address_space.  (Easy: have a global "dirty superblocks"
- * list).
- *
- * The inodes to be written are parked on sb->s_io.  They are moved back onto
- * sb->s_dirty as they are selected for writing.  This way, none can be missed
+ * The inodes to be written are parked on bdi->b_io.  They are moved back onto
+ * bdi->b_dirty as they are selected for writing.  This way, none can be missed
  * on the writer throttling path, and we get decent balancing between many
  * throttled threads: we don't want them all piling up on inode_sync_wait.
  */
-void generic_sync_sb_inodes(struct super_block *sb,
-				struct writeback_control *wbc)
+static void writeback_bdi_inodes(struct backing_dev_info *bdi,
+				 struct writeback_control *wbc)
 {
 	const unsigned long start = jiffies;	/* livelock avoidance */
-	int sync = wbc->sync_mode == WB_SYNC_ALL;
+	struct super_block *pinned = NULL;
 
 	spin_lock(&inode_lock);
-	if (!wbc->for_kupdate || list_empty(&sb->s_io))
-		queue_io(sb, wbc->older_than_this);
+	if (!wbc->for_kupdate || list_empty(&bdi->b_io))
+		queue_io(bdi, wbc->older_than_this, wbc->sb);
 
-	while (!list_empty(&sb->s_io)) {
-		struct inode *inode = list_entry(sb->s_io.prev,
+	while (!list_empty(&bdi->b_io)) {
+		struct inode *inode = list_entry(bdi->b_io.prev,
 						struct inode, i_list);
 		struct address_space *mapping = inode->i_mapping;
-		struct backing_dev_info *bdi = mapping->backing_dev_info;
+		struct backing_dev_info *ibdi = mapping->backing_dev_info;
 		long pages_skipped;
 
-		if (!bdi_cap_writeback_dirty(bdi)) {
-			redirty_tail(inode);
-			if (sb_is_blkdev_sb(sb)) {
-				/*
-				 * Dirty memory-backed blockdev: the ramdisk
-				 * driver does this.  Skip just this inode
-				 */
-				continue;
-			}
+		if ((wbc->sb && inode->i_sb != wbc->sb) ||
+		    (wbc->bdi && ibdi != wbc->bdi)) {
+			/* Left on b_io by another pass, or not ours */
+			requeue_io(inode);
+			continue;
+		}
+
+		if (!bdi_cap_writeback_dirty(ibdi)) {
 			/*
-			 * Dirty memory-backed inode against a filesystem other
-			 * than the kernel-internal bdev filesystem.  Skip the
-			 * entire superblock.
+			 * Dirty memory-backed inode, e.g. a ramdisk whose
+			 * bdev inode was dirtied against another queue.
 			 */
-			break;
+			redirty_tail(inode);
+			continue;
 		}
 
 		if (inode->i_state & I_NEW) {
@@ -477,35 +541,27 @@ void generic_sync_sb_inodes(struct super_block *sb,
 			continue;
 		}
 
-		if (wbc->nonblocking && bdi_write_congested(bdi)) {
+		if (wbc->nonblocking && bdi_write_congested(ibdi)) {
 			wbc->encountered_congestion = 1;
-			if (!sb_is_blkdev_sb(sb))
-				break;		/* Skip a congested fs */
+			if (ibdi == bdi)
+				break;		/* Skip a congested device */
 			requeue_io(inode);
-			continue;		/* Skip a congested blockdev */
-		}
-
-		if (wbc->bdi && bdi != wbc->bdi) {
-			if (!sb_is_blkdev_sb(sb))
-				break;		/* fs has the wrong queue */
-			requeue_io(inode);
-			continue;		/* blockdev has wrong queue */
+			continue;
 		}
 
-		/* Was this inode dirtied after sync_sb_inodes was called? */
+		/* Was this inode dirtied after we started? */
 		if (time_after(inode->dirtied_when, start))
 			break;
 
-		/* Is another pdflush already flushing this queue? */
-		if (current_is_pdflush() && !writeback_acquire(bdi))
-			break;
+		if (pin_sb_for_writeback(wbc, inode, &pinned)) {
+			requeue_io(inode);
+			continue;
+		}
 
 		BUG_ON(inode->i_state & I_FREEING);
 		__iget(inode);
 		pages_skipped = wbc->pages_skipped;
 		__writeback_single_inode(inode, wbc);
-		if (current_is_pdflush())
-			writeback_release(bdi);
 		if (wbc->pages_skipped != pages_skipped) {
 			/*
 			 * writeback is not making progress due to locked
@@ -521,11 +577,62 @@ void generic_sync_sb_inodes(struct super_block *sb,
 			wbc->more_io = 1;
 			break;
 		}
-		if (!list_empty(&sb->s_more_io))
+		if (!list_empty(&bdi->b_more_io))
 			wbc->more_io = 1;
 	}
+	spin_unlock(&inode_lock);
+
+	if (pinned)
+		drop_super(pinned);
+	/* Leave any unwritten inodes on b_io */
+}
+
+/*
+ * Write back the inodes of all registered bdis, for callers that don't
+ * have a particular device in mind.  Each bdi is written in turn, in the
+ * caller's context.
+ */
+static void bdi_writeback_all(struct writeback_control *wbc)
+{
+	struct backing_dev_info *bdi;
+
+	spin_lock(&bdi_list_lock);
+restart:
+	list_for_each_entry(bdi, &bdi_list, bdi_list) {
+		if (!bdi_has_dirty_io(bdi))
+			continue;
+		__bdi_pin(bdi);
+		spin_unlock(&bdi_list_lock);
+
+		writeback_bdi_inodes(bdi, wbc);
+
+		spin_lock(&bdi_list_lock);
+		if (__bdi_unpin(bdi))
+			goto restart;
+		if (wbc->nr_to_write <= 0)
+			break;
+	}
+	spin_unlock(&bdi_list_lock);
+}
+
+/*
+ * Write out a superblock's list of dirty inodes.  A wait will be performed
+ * upon no inodes, all inodes or the final one, depending upon sync_mode.
+ *
+ * The superblock's dirty inodes live on the lists of the bdis backing
+ * them, so all bdis are searched, writing only the inodes of @sb.  The
+ * caller holds s_umount.
+ */
+void generic_sync_sb_inodes(struct super_block *sb,
+				struct writeback_control *wbc)
+{
+	struct super_block *old_sb = wbc->sb;
+
+	wbc->sb = sb;
+	bdi_writeback_all(wbc);
+	wbc->sb = old_sb;
 
-	if (sync) {
+	if (wbc->sync_mode == WB_SYNC_ALL) {
 		struct inode *inode, *old_inode = NULL;
 
 		/*
@@ -535,6 +642,7 @@ void generic_sync_sb_inodes(struct super_block *sb,
 		 * In which case, the inode may not be on the dirty list, but
 		 * we still have to wait for that writeout.
 		 */
+		spin_lock(&inode_lock);
 		list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
 			struct address_space *mapping;
 
@@ -564,10 +672,7 @@ void generic_sync_sb_inodes(struct super_block *sb,
 		}
 		spin_unlock(&inode_lock);
 		iput(old_inode);
-	} else
-		spin_unlock(&inode_lock);
-
-	return;		/* Leave any unwritten inodes on s_io */
+	}
 }
 EXPORT_SYMBOL_GPL(generic_sync_sb_inodes);
 
@@ -580,53 +685,189 @@ static void sync_sb_inodes(struct super_block *sb,
 /*
  * Start writeback of dirty pagecache data against all unlocked inodes.
  *
- * Note:
- * We don't need to grab a reference to superblock here. If it has non-empty
- * ->s_dirty it's hadn't been killed yet and kill_super() won't proceed
- * past sync_inodes_sb() until the ->s_dirty/s_io/s_more_io lists are all
- * empty. Since __sync_single_inode() regains inode_lock before it finally moves
- * inode from superblock lists we are OK.
- *
  * If `older_than_this' is non-zero then only flush inodes which have a
  * flushtime older than *older_than_this.
  *
- * If `bdi' is non-zero then we will scan the first inode against each
- * superblock until we find the matching ones.  One group will be the dirty
- * inodes against a filesystem.  Then when we hit the dummy blockdev superblock,
- * sync_sb_inodes will seekout the blockdev which matches `bdi'.  Maybe not
- * super-efficient but we're about to do a ton of I/O...
+ * If `bdi' is non-zero then only the inodes backed by it are written,
+ * straight from its dirty lists.  This is what a task throttled in
+ * balance_dirty_pages() does, so it never waits on another device.
  */
 void
 writeback_inodes(struct writeback_control *wbc)
 {
-	struct super_block *sb;
-
 	might_sleep();
-	spin_lock(&sb_lock);
-restart:
-	list_for_each_entry_reverse(sb, &super_blocks, s_list) {
-		if (sb_has_dirty_inodes(sb)) {
-			/* we're making our own get_super here */
-			sb->s_count++;
-			spin_unlock(&sb_lock);
-			/*
-			 * If we can't get the readlock, there's no sense in
-			 * waiting around, most of the time the FS is going to
-			 * be unmounted by the time it is released.
-			 */
-			if (down_read_trylock(&sb->s_umount)) {
-				if (sb->s_root)
-					sync_sb_inodes(sb, wbc);
-				up_read(&sb->s_umount);
-			}
-			spin_lock(&sb_lock);
-			if (__put_super_and_need_restart(sb))
-				goto restart;
+	if (wbc->bdi)
+		writeback_bdi_inodes(wb_owner(wbc->bdi), wbc);
+	else
+		bdi_writeback_all(wbc);
+}
+
+/*
+ * Flusher threads.
+ *
+ * Each registered bdi with dirty inodes has a thread of its own, so that
+ * a slow device can't hold up writeback of a fast one.  The flusher of the
+ * default bdi also starts the others (see mm/backing-dev.c).
+ */
+
+/*
+ * Write back the dirty data of one bdi for its flusher: at least @nr_pages
+ * pages, and for as long as the system is over the background dirty
+ * threshold.  For kupdate, only inodes dirtied more than
+ * dirty_expire_interval ago are written, @nr_pages at most.
+ */
+static long wb_writeback(struct backing_dev_info *bdi, long nr_pages,
+			 int for_kupdate)
+{
+	unsigned long oldest_jif;
+	long wrote = 0;
+	struct writeback_control wbc = {
+		.bdi		= NULL,
+		.sync_mode	= WB_SYNC_NONE,
+		.older_than_this = NULL,
+		.for_kupdate	= for_kupdate,
+		.range_cyclic	= 1,
+	};
+
+	if (for_kupdate) {
+		oldest_jif = jiffies - dirty_expire_interval;
+		wbc.older_than_this = &oldest_jif;
+	}
+
+	for ( ; ; ) {
+		if (nr_pages <= 0 && (for_kupdate || !over_bground_thresh()))
+			break;
+		if (kthread_should_stop())
+			break;
+
+		wbc.more_io = 0;
+		wbc.encountered_congestion = 0;
+		wbc.nr_to_write = MAX_WRITEBACK_PAGES;
+		wbc.pages_skipped = 0;
+		writeback_bdi_inodes(bdi, &wbc);
+		nr_pages -= MAX_WRITEBACK_PAGES - wbc.nr_to_write;
+		wrote += MAX_WRITEBACK_PAGES - wbc.nr_to_write;
+
+		if (wbc.nr_to_write > 0 || wbc.pages_skipped > 0) {
+			/* Wrote less than expected */
+			if (wbc.encountered_congestion || wbc.more_io)
+				congestion_wait(WRITE, HZ/10);
+			else
+				break;
 		}
-		if (wbc->nr_to_write <= 0)
+	}
+
+	return wrote;
+}
+
+/*
+ * One round of flusher work: the writeback asked for by
+ * bdi_start_writeback(), background writeback if we are over the
+ * threshold, and kupdate-style writeback of old data every
+ * dirty_writeback_interval.  Returns the number of pages written.
+ */
+long bdi_do_writeback(struct backing_dev_info *bdi)
+{
+	long nr_pages, wrote = 0;
+
+	spin_lock(&bdi_list_lock);
+	nr_pages = bdi->wb_pages;
+	bdi->wb_pages = 0;
+	spin_unlock(&bdi_list_lock);
+
+	set_bit(BDI_writeback_running, &bdi->state);
+
+	if (nr_pages || over_bground_thresh())
+		wrote += wb_writeback(bdi, nr_pages, 0);
+
+	if (dirty_writeback_interval &&
+	    time_after_eq(jiffies,
+			  bdi->last_old_flush + dirty_writeback_interval)) {
+		bdi->last_old_flush = jiffies;
+		nr_pages = global_page_state(NR_FILE_DIRTY) +
+				global_page_state(NR_UNSTABLE_NFS) +
+				(inodes_stat.nr_inodes - inodes_stat.nr_unused);
+		wrote += wb_writeback(bdi, nr_pages, 1);
+	}
+
+	clear_bit(BDI_writeback_running, &bdi->state);
+
+	return wrote;
+}
+
+/*
+ * Give up the flusher thread of an idle bdi.  Fails if the bdi got work
+ * meanwhile, or if bdi_unregister() is about to stop us.
+ */
+static int bdi_flusher_exit(struct backing_dev_info *bdi)
+{
+	int ret = 0;
+
+	spin_lock(&inode_lock);
+	spin_lock(&bdi_list_lock);
+	if (bdi->task == current && !bdi->wb_pages && !bdi_has_dirty_io(bdi)) {
+		bdi->task = NULL;
+		ret = 1;
+	}
+	spin_unlock(&bdi_list_lock);
+	spin_unlock(&inode_lock);
+
+	return ret;
+}
+
+/*
+ * The main loop of a bdi's flusher thread.
+ */
+int bdi_writeback_task(struct backing_dev_info *bdi)
+{
+	unsigned long last_active = jiffies;
+
+	while (!kthread_should_stop()) {
+		long wait = MAX_SCHEDULE_TIMEOUT;
+
+		if (bdi_do_writeback(bdi))
+			last_active = jiffies;
+		else if (time_after(jiffies, last_active + BDI_IDLE_EXIT) &&
+			 bdi_flusher_exit(bdi))
 			break;
+
+		/*
+		 * Wake up for kupdate while there is dirty data, otherwise
+		 * only to see whether we have been idle long enough to exit.
+		 */
+		if (!bdi_has_dirty_io(bdi))
+			wait = BDI_IDLE_EXIT;
+		else if (dirty_writeback_interval)
+			wait = dirty_writeback_interval;
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!bdi->wb_pages && !kthread_should_stop())
+			schedule_timeout(wait);
+		__set_current_state(TASK_RUNNING);
+		try_to_freeze();
 	}
-	spin_unlock(&sb_lock);
+
+	return 0;
+}
+
+/*
+ * Start writeback of `nr_pages' pages on every device with dirty data.  If
+ * `nr_pages' is zero, write back the whole world.
+ */
+void wakeup_flusher_threads(long nr_pages)
+{
+	struct backing_dev_info *bdi;
+
+	if (nr_pages == 0)
+		nr_pages = global_page_state(NR_FILE_DIRTY) +
+				global_page_state(NR_UNSTABLE_NFS);
+
+	spin_lock(&bdi_list_lock);
+	list_for_each_entry(bdi, &bdi_list, bdi_list) {
+		if (bdi_has_dirty_io(bdi))
+			__bdi_start_writeback(bdi, nr_pages);
+	}
+	spin_unlock(&bdi_list_lock);
 }
 
 /*
@@ -16,6 +16,8 @@
 #include <linux/pagemap.h>
 #include <linux/file.h>
 #include <linux/slab.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 
@@ -496,6 +498,9 @@ struct fuse_copy_state {
 	unsigned long seglen;
 	unsigned long addr;
 	struct page *pg;
+	struct pipe_buffer *pipebufs;
+	struct pipe_buffer *currbuf;
+	struct pipe_inode_info *pipe;
 	void *mapaddr;
 	void *buf;
 	unsigned len;
@@ -513,10 +518,26 @@ static void fuse_copy_init(struct fuse_copy_state *cs, struct fuse_conn *fc,
 	cs->nr_segs = nr_segs;
 }
 
-/* Unmap and put previous page of userspace buffer */
+/*
+ * Unmap and put previous page of userspace buffer.  The unused rest of
+ * the page is given back, so that another request can be copied after
+ * this one.
+ */
 static void fuse_copy_finish(struct fuse_copy_state *cs)
 {
-	if (cs->mapaddr) {
+	if (cs->currbuf) {
+		struct pipe_buffer *buf = cs->currbuf;
+
+		if (!cs->write) {
+			buf->ops->unmap(cs->pipe, buf, cs->mapaddr);
+		} else {
+			kunmap_atomic(cs->mapaddr, KM_USER0);
+			buf->len = PAGE_SIZE - cs->len;
+		}
+		cs->currbuf = NULL;
+		cs->mapaddr = NULL;
+		cs->len = 0;
+	} else if (cs->mapaddr) {
 		kunmap_atomic(cs->mapaddr, KM_USER0);
 		if (cs->write) {
 			flush_dcache_page(cs->pg);
@@ -524,7 +545,55 @@ static void fuse_copy_finish(struct fuse_copy_state *cs)
 		}
 		put_page(cs->pg);
 		cs->mapaddr = NULL;
+		cs->seglen += cs->len;
+		cs->addr -= cs->len;
+		cs->len = 0;
+	}
+}
+
+/*
+ * Get the next pipe buffer to copy from, or allocate a new page for the
+ * pipe to copy to.
+ */
+static int fuse_copy_fill_pipe(struct fuse_copy_state *cs)
+{
+	struct pipe_buffer *buf = cs->pipebufs;
+	int err;
+
+	if (!cs->write) {
+		BUG_ON(!cs->nr_segs);
+		err = buf->ops->confirm(cs->pipe, buf);
+		if (err)
+			return err;
+
+		cs->currbuf = buf;
+		cs->mapaddr = buf->ops->map(cs->pipe, buf, 1);
+		cs->buf = cs->mapaddr + buf->offset;
+		cs->len = buf->len;
+		cs->pipebufs++;
+		cs->nr_segs--;
+	} else {
+		struct page *page;
+
+		if (cs->nr_segs == PIPE_BUFFERS)
+			return -EIO;
+
+		page = alloc_page(GFP_HIGHUSER);
+		if (!page)
+			return -ENOMEM;
+
+		buf->page = page;
+		buf->offset = 0;
+		buf->len = 0;
+		cs->currbuf = buf;
+		cs->mapaddr = kmap_atomic(page, KM_USER0);
+		cs->buf = cs->mapaddr;
+		cs->len = PAGE_SIZE;
+		cs->pipebufs++;
+		cs->nr_segs++;
 	}
+
+	return lock_request(cs->fc, cs->req);
 }
 
 /*
@@ -538,6 +607,8 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 
 	unlock_request(cs->fc, cs->req);
 	fuse_copy_finish(cs);
+	if (cs->pipebufs)
+		return fuse_copy_fill_pipe(cs);
 	if (!cs->seglen) {
 		BUG_ON(!cs->nr_segs);
 		cs->seglen = cs->iov[0].iov_len;
@@ -699,10 +770,9 @@ __acquires(&fc->lock)
  * Called with fc->lock held, releases it
  */
 static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_req *req,
-			       const struct iovec *iov, unsigned long nr_segs)
+			       struct fuse_copy_state *cs, size_t nbytes)
 __releases(&fc->lock)
 {
-	struct fuse_copy_state cs;
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
 	unsigned reqsize = sizeof(ih) + sizeof(arg);
@@ -718,18 +788,23 @@ __releases(&fc->lock)
 	arg.unique = req->in.h.unique;
 
 	spin_unlock(&fc->lock);
-	if (iov_length(iov, nr_segs) < reqsize)
+	if (nbytes < reqsize)
 		return -EINVAL;
 
-	fuse_copy_init(&cs, fc, 1, NULL, iov, nr_segs);
-	err = fuse_copy_one(&cs, &ih, sizeof(ih));
+	err = fuse_copy_one(cs, &ih, sizeof(ih));
 	if (!err)
-		err = fuse_copy_one(&cs, &arg, sizeof(arg));
-	fuse_copy_finish(&cs);
+		err = fuse_copy_one(cs, &arg, sizeof(arg));
+	fuse_copy_finish(cs);
 
 	return err ? err : reqsize;
 }
 
+/* Number of bytes that fit into the free slots of the pipe */
+static size_t fuse_pipe_room(struct pipe_inode_info *pipe)
+{
+	return (PIPE_BUFFERS - pipe->nrbufs) << PAGE_SHIFT;
+}
+
 /*
  * Read a single request into the userspace filesystem's buffer.  This
  * function waits until a request is available, then removes it from
@@ -738,19 +813,19 @@ __releases(&fc->lock)
  * was an error during the copying then it's finished by calling
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
+ *
+ * If the filesystem asked for FUSE_BATCH_REQUESTS, further pending
+ * requests are packed behind the first one for as long as they fit
+ * in the buffer.
  */
-static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
-			      unsigned long nr_segs, loff_t pos)
+static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
 	struct fuse_req *req;
 	struct fuse_in *in;
-	struct fuse_copy_state cs;
 	unsigned reqsize;
-	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
-		return -EPERM;
+	ssize_t done = 0;
 
  restart:
 	spin_lock(&fc->lock);
@@ -770,58 +845,187 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 	if (!list_empty(&fc->interrupts)) {
 		req = list_entry(fc->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fc, req, iov, nr_segs);
+		return fuse_read_interrupt(fc, req, cs, nbytes);
 	}
 
 	req = list_entry(fc->pending.next, struct fuse_req, list);
-	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	for (;;) {
+		in = &req->in;
+		reqsize = in->h.len;
+		/*
+		 * A request that doesn't fit into the pipe stays pending.
+		 * If the pipe is merely too full, the filesystem can drain
+		 * it and try again; if not even an empty pipe would do, the
+		 * filesystem has to read the request with read() instead.
+		 */
+		if (cs->pipebufs &&
+		    reqsize > min(nbytes, fuse_pipe_room(cs->pipe))) {
+			err = -E2BIG;
+			if (reqsize <= nbytes &&
+			    reqsize <= (PIPE_BUFFERS << PAGE_SHIFT))
+				err = -EAGAIN;
+			goto err_unlock;
+		}
 
-	in = &req->in;
-	reqsize = in->h.len;
-	/* If request is too large, reply with an error and restart the read */
-	if (iov_length(iov, nr_segs) < reqsize) {
-		req->out.h.error = -EIO;
-		/* SETXATTR is special, since it may contain too large data */
-		if (in->h.opcode == FUSE_SETXATTR)
-			req->out.h.error = -E2BIG;
-		request_end(fc, req);
-		goto restart;
-	}
-	spin_unlock(&fc->lock);
-	fuse_copy_init(&cs, fc, 1, req, iov, nr_segs);
-	err = fuse_copy_one(&cs, &in->h, sizeof(in->h));
-	if (!err)
-		err = fuse_copy_args(&cs, in->numargs, in->argpages,
-				     (struct fuse_arg *) in->args, 0);
-	fuse_copy_finish(&cs);
-	spin_lock(&fc->lock);
-	req->locked = 0;
-	if (req->aborted) {
-		request_end(fc, req);
-		return -ENODEV;
-	}
-	if (err) {
-		req->out.h.error = -EIO;
-		request_end(fc, req);
-		return err;
-	}
-	if (!req->isreply)
-		request_end(fc, req);
-	else {
-		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
-		if (req->interrupted)
-			queue_interrupt(fc, req);
+		req->state = FUSE_REQ_READING;
+		list_move(&req->list, &fc->io);
+
+		/*
+		 * If request is too large, reply with an error and restart
+		 * the read
+		 */
+		if (nbytes < reqsize) {
+			req->out.h.error = -EIO;
+			/* SETXATTR is special, since it may contain too large data */
+			if (in->h.opcode == FUSE_SETXATTR)
+				req->out.h.error = -E2BIG;
+			request_end(fc, req);
+			goto restart;
+		}
 		spin_unlock(&fc->lock);
+		cs->req = req;
+		err = fuse_copy_one(cs, &in->h, sizeof(in->h));
+		if (!err)
+			err = fuse_copy_args(cs, in->numargs, in->argpages,
+					     (struct fuse_arg *) in->args, 0);
+		fuse_copy_finish(cs);
+		spin_lock(&fc->lock);
+		req->locked = 0;
+		if (req->aborted) {
+			request_end(fc, req);
+			return done ? done : -ENODEV;
+		}
+		if (err) {
+			req->out.h.error = -EIO;
+			request_end(fc, req);
+			return done ? done : err;
+		}
+		if (!req->isreply)
+			request_end(fc, req);
+		else {
+			req->state = FUSE_REQ_SENT;
+			list_move_tail(&req->list, &fc->processing);
+			if (req->interrupted)
+				queue_interrupt(fc, req);
+			spin_unlock(&fc->lock);
+		}
+		done += reqsize;
+		nbytes -= reqsize;
+
+		if (!fc->batch_requests || cs->pipebufs)
+			break;
+
+		/* Interrupts are always sent first, leave them for next time */
+		spin_lock(&fc->lock);
+		if (!fc->connected || !list_empty(&fc->interrupts) ||
+		    list_empty(&fc->pending)) {
+			spin_unlock(&fc->lock);
+			break;
+		}
+		req = list_entry(fc->pending.next, struct fuse_req, list);
+		if (req->in.h.len > nbytes) {
+			spin_unlock(&fc->lock);
+			break;
+		}
 	}
-	return reqsize;
+	return done;
 
  err_unlock:
 	spin_unlock(&fc->lock);
 	return err;
 }
 
+static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
+			      unsigned long nr_segs, loff_t pos)
+{
+	struct fuse_copy_state cs;
+	struct file *file = iocb->ki_filp;
+	struct fuse_conn *fc = fuse_get_conn(file);
+	if (!fc)
+		return -EPERM;
+
+	fuse_copy_init(&cs, fc, 1, NULL, iov, nr_segs);
+
+	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+}
+
+static void fuse_dev_pipe_buf_release(struct pipe_inode_info *pipe,
+				      struct pipe_buffer *buf)
+{
+	page_cache_release(buf->page);
+}
+
+static const struct pipe_buf_operations fuse_dev_pipe_buf_ops = {
+	.can_merge = 0,
+	.map = generic_pipe_buf_map,
+	.unmap = generic_pipe_buf_unmap,
+	.confirm = generic_pipe_buf_confirm,
+	.release = fuse_dev_pipe_buf_release,
+	.steal = generic_pipe_buf_steal,
+	.get = generic_pipe_buf_get,
+};
+
+static void fuse_dev_spd_release(struct splice_pipe_desc *spd, unsigned int i)
+{
+	page_cache_release(spd->pages[i]);
+}
+
+/*
+ * Read a single request into freshly allocated pages and hand those to
+ * the pipe.  The filesystem can then move the payload of a WRITE on to
+ * its backing file with splice(), without copying it to userspace.
+ *
+ * The request must fit into the free slots of the pipe.  If it doesn't,
+ * it is left pending and -EAGAIN is returned, or -E2BIG if it would not
+ * fit even into an empty pipe.
+ */
+static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
+				    struct pipe_inode_info *pipe,
+				    size_t len, unsigned int flags)
+{
+	ssize_t ret;
+	int page_nr;
+	struct page *pages[PIPE_BUFFERS];
+	struct partial_page partial[PIPE_BUFFERS];
+	struct pipe_buffer *bufs;
+	struct fuse_copy_state cs;
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.flags = flags,
+		.ops = &fuse_dev_pipe_buf_ops,
+		.spd_release = fuse_dev_spd_release,
+	};
+	struct fuse_conn *fc = fuse_get_conn(in);
+	if (!fc)
+		return -EPERM;
+
+	bufs = kmalloc(PIPE_BUFFERS * sizeof(struct pipe_buffer), GFP_KERNEL);
+	if (!bufs)
+		return -ENOMEM;
+
+	fuse_copy_init(&cs, fc, 1, NULL, NULL, 0);
+	cs.pipebufs = bufs;
+	cs.pipe = pipe;
+	ret = fuse_dev_do_read(fc, in, &cs, len);
+	if (ret < 0) {
+		for (page_nr = 0; page_nr < cs.nr_segs; page_nr++)
+			page_cache_release(bufs[page_nr].page);
+		goto out;
+	}
+
+	for (page_nr = 0; page_nr < cs.nr_segs; page_nr++) {
+		pages[page_nr] = bufs[page_nr].page;
+		partial[page_nr].offset = 0;
+		partial[page_nr].len = bufs[page_nr].len;
+	}
+	spd.nr_pages = cs.nr_segs;
+	ret = splice_to_pipe(pipe, &spd);
+ out:
+	kfree(bufs);
+	return ret;
+}
+
 static int fuse_notify_poll(struct fuse_conn *fc, unsigned int size,
 			    struct fuse_copy_state *cs)
 {
@@ -893,43 +1097,64 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
 			      out->page_zeroing);
 }
 
+/*
+ * The request a reply belongs to is gone, most likely it was aborted or
+ * interrupted.  On its own such a reply fails with -ENOENT, but in a
+ * batch the rest of it is skipped, so that the replies behind it still
+ * reach their requests.
+ */
+static ssize_t fuse_skip_reply(struct fuse_conn *fc,
+			       struct fuse_copy_state *cs, size_t nbytes)
+{
+	int err = -ENOENT;
+
+	if (fc->batch_requests && !cs->pipebufs)
+		err = fuse_copy_page(cs, NULL, 0,
+				     nbytes - sizeof(struct fuse_out_header), 0);
+	fuse_copy_finish(cs);
+	return err ? err : nbytes;
+}
+
 /*
  * Write a single reply to a request.  First the header is copied from
  * the write buffer.  The request is then searched on the processing
  * list by the unique ID found in the header.  If found, then remove
  * it from the list and copy the rest of the buffer to the request.
  * The request is finished by calling request_end()
+ *
+ * With FUSE_BATCH_REQUESTS the reply may be followed by more replies
+ * in the same buffer.  The length of the reply is returned, so that
+ * the caller can carry on with the next one, even if the request the
+ * reply was meant for is gone.
  */
-static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
-			       unsigned long nr_segs, loff_t pos)
+static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
+				 struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
-	unsigned nbytes = iov_length(iov, nr_segs);
 	struct fuse_req *req;
 	struct fuse_out_header oh;
-	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(iocb->ki_filp);
-	if (!fc)
-		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 0, NULL, iov, nr_segs);
+	cs->req = NULL;
 	if (nbytes < sizeof(struct fuse_out_header))
 		return -EINVAL;
 
-	err = fuse_copy_one(&cs, &oh, sizeof(oh));
+	err = fuse_copy_one(cs, &oh, sizeof(oh));
 	if (err)
 		goto err_finish;
 
 	err = -EINVAL;
-	if (oh.len != nbytes)
+	if (oh.len < sizeof(struct fuse_out_header) || oh.len > nbytes)
 		goto err_finish;
+	if (oh.len != nbytes && (!fc->batch_requests || cs->pipebufs))
+		goto err_finish;
+	nbytes = oh.len;
 
 	/*
 	 * Zero oh.unique indicates unsolicited notification message
 	 * and error contains notification code.
 	 */
 	if (!oh.unique) {
-		err = fuse_notify(fc, oh.error, nbytes - sizeof(oh), &cs);
+		err = fuse_notify(fc, oh.error, nbytes - sizeof(oh), cs);
 		return err ? err : nbytes;
 	}
 
@@ -943,15 +1168,14 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 		goto err_unlock;
 
 	req = request_find(fc, oh.unique);
-	if (!req)
-		goto err_unlock;
+	if (!req) {
+		spin_unlock(&fc->lock);
+		return fuse_skip_reply(fc, cs, nbytes);
+	}
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
-		fuse_copy_finish(&cs);
-		spin_lock(&fc->lock);
 		request_end(fc, req);
-		return -ENOENT;
+		return fuse_skip_reply(fc, cs, nbytes);
 	}
 	/* Is it an interrupt reply? */
 	if (req->intr_unique == oh.unique) {
@@ -965,7 +1189,7 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 			queue_interrupt(fc, req);
 
 		spin_unlock(&fc->lock);
-		fuse_copy_finish(&cs);
+		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
@@ -973,16 +1197,17 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 	list_move(&req->list, &fc->io);
 	req->out.h = oh;
 	req->locked = 1;
-	cs.req = req;
+	cs->req = req;
 	spin_unlock(&fc->lock);
 
-	err = copy_out_args(&cs, &req->out, nbytes);
-	fuse_copy_finish(&cs);
+	err = copy_out_args(cs, &req->out, nbytes);
+	fuse_copy_finish(cs);
 
 	spin_lock(&fc->lock);
 	req->locked = 0;
 	if (!err) {
-		if (req->aborted)
+		/* The reply was consumed, a batch goes on with the next one */
+		if (req->aborted && (!fc->batch_requests || cs->pipebufs))
 			err = -ENOENT;
 	} else if (!req->aborted)
 		req->out.h.error = -EIO;
@@ -993,10 +1218,118 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
  err_unlock:
 	spin_unlock(&fc->lock);
  err_finish:
-	fuse_copy_finish(&cs);
+	fuse_copy_finish(cs);
 	return err;
 }
 
+static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
+			       unsigned long nr_segs, loff_t pos)
+{
+	ssize_t ret;
+	size_t done = 0;
+	size_t nbytes = iov_length(iov, nr_segs);
+	struct fuse_copy_state cs;
+	struct fuse_conn *fc = fuse_get_conn(iocb->ki_filp);
+	if (!fc)
+		return -EPERM;
+
+	fuse_copy_init(&cs, fc, 0, NULL, iov, nr_segs);
+	do {
+		ret = fuse_dev_do_write(fc, &cs, nbytes - done);
+		if (ret < 0)
+			return done ? done : ret;
+		done += ret;
+	} while (done < nbytes);
+
+	return done;
+}
+
+/*
+ * Write a reply from the pipe.  The pipe buffers are copied straight
+ * into the request, so the filesystem can splice the data of a READ
+ * from its backing file without copying it to userspace.
+ */
+static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
+				     struct file *out, loff_t *ppos,
+				     size_t len, unsigned int flags)
+{
+	unsigned nbuf;
+	unsigned idx;
+	size_t rem;
+	ssize_t ret;
+	struct pipe_buffer *bufs;
+	struct fuse_copy_state cs;
+	struct fuse_conn *fc = fuse_get_conn(out);
+	if (!fc)
+		return -EPERM;
+
+	bufs = kmalloc(PIPE_BUFFERS * sizeof(struct pipe_buffer), GFP_KERNEL);
+	if (!bufs)
+		return -ENOMEM;
+
+	if (pipe->inode)
+		mutex_lock(&pipe->inode->i_mutex);
+
+	nbuf = 0;
+	rem = 0;
+	for (idx = 0; idx < pipe->nrbufs && rem < len; idx++)
+		rem += pipe->bufs[(pipe->curbuf + idx) & (PIPE_BUFFERS - 1)].len;
+
+	ret = -EINVAL;
+	if (rem < len) {
+		if (pipe->inode)
+			mutex_unlock(&pipe->inode->i_mutex);
+		goto out;
+	}
+
+	rem = len;
+	while (rem) {
+		struct pipe_buffer *ibuf = pipe->bufs + pipe->curbuf;
+		struct pipe_buffer *obuf = bufs + nbuf;
+
+		if (rem >= ibuf->len) {
+			*obuf = *ibuf;
+			ibuf->ops = NULL;
+			pipe->curbuf = (pipe->curbuf + 1) & (PIPE_BUFFERS - 1);
+			pipe->nrbufs--;
+		} else {
+			ibuf->ops->get(pipe, ibuf);
+			*obuf = *ibuf;
+			obuf->flags &= ~PIPE_BUF_FLAG_GIFT;
+			obuf->len = rem;
+			ibuf->offset += obuf->len;
+			ibuf->len -= obuf->len;
+		}
+		nbuf++;
+		rem -= obuf->len;
+	}
+
+	if (pipe->inode)
+		mutex_unlock(&pipe->inode->i_mutex);
+
+	smp_mb();
+	if (waitqueue_active(&pipe->wait))
+		wake_up_interruptible(&pipe->wait);
+	kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
+
+	fuse_copy_init(&cs, fc, 0, NULL, NULL, nbuf);
+	cs.pipebufs = bufs;
+	cs.pipe = pipe;
+	ret = fuse_dev_do_write(fc, &cs, len);
+
+	if (pipe->inode)
+		mutex_lock(&pipe->inode->i_mutex);
+	for (idx = 0; idx < nbuf; idx++) {
+		struct pipe_buffer *buf = &bufs[idx];
+		buf->ops->release(pipe, buf);
+	}
+	if (pipe->inode)
+		mutex_unlock(&pipe->inode->i_mutex);
+ out:
+	kfree(bufs);
+	return ret;
+}
+
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
@@ -1138,6 +1471,8 @@ const struct file_operations fuse_dev_operations = {
 	.aio_read	= fuse_dev_read,
 	.write		= do_sync_write,
 	.aio_write	= fuse_dev_write,
+	.splice_read	= fuse_dev_splice_read,
+	.splice_write	= fuse_dev_splice_write,
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
@@ -433,6 +433,9 @@ struct fuse_conn {
 	/** Do multi-page cached writes */
 	unsigned big_writes:1;
 
+	/** Pass several requests and replies per read and write */
+	unsigned batch_requests:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
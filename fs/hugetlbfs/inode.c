@@ -395,8 +395,9 @@ static void hugetlbfs_forget_inode(struct inode *inode) __releases(inode_lock)
 
 	if (!hlist_unhashed(&inode->i_hash)) {
 		if (!(inode->i_state & (I_DIRTY|I_SYNC)))
-			list_move(&inode->i_list, &inode_unused);
+			list_move(&inode->i_list, &sb->s_inode_unused);
 		inodes_stat.nr_unused++;
+		sb->s_nr_inodes_unused++;
 		if (!sb || (sb->s_flags & MS_ACTIVE)) {
 			spin_unlock(&inode_lock);
 			return;
@@ -411,6 +412,7 @@ static void hugetlbfs_forget_inode(struct inode *inode) __releases(inode_lock)
 		spin_lock(&inode_lock);
 		inode->i_state &= ~I_WILL_FREE;
 		inodes_stat.nr_unused--;
+		sb->s_nr_inodes_unused--;
 		hlist_del_init(&inode->i_hash);
 	}
 	list_del_init(&inode->i_list);
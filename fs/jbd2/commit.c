@@ -983,6 +983,7 @@ restart_loop:
 	stats.ts_type = JBD2_STATS_RUN;
 	stats.ts_tid = commit_transaction->t_tid;
 	stats.u.run.rs_handle_count = commit_transaction->t_handle_count;
+	stats.u.run.rs_sync_waiters = commit_transaction->t_sync_waiters;
 	spin_lock(&journal->j_history_lock);
 	memcpy(journal->j_history + journal->j_history_cur, &stats,
 			sizeof(stats));
@@ -999,6 +1000,7 @@ restart_loop:
 	journal->j_stats.u.run.rs_flushing += stats.u.run.rs_flushing;
 	journal->j_stats.u.run.rs_logging += stats.u.run.rs_logging;
 	journal->j_stats.u.run.rs_handle_count += stats.u.run.rs_handle_count;
+	journal->j_stats.u.run.rs_sync_waiters += stats.u.run.rs_sync_waiters;
 	journal->j_stats.u.run.rs_blocks += stats.u.run.rs_blocks;
 	journal->j_stats.u.run.rs_blocks_logged += stats.u.run.rs_blocks_logged;
 	spin_unlock(&journal->j_history_lock);
@@ -1018,6 +1020,8 @@ restart_loop:
 				journal->j_average_commit_time*3) / 4;
 	else
 		journal->j_average_commit_time = commit_time;
+	if (commit_transaction->t_sync_waiters)
+		journal->j_last_sync_batch = commit_transaction->t_sync_waiters;
 	spin_unlock(&journal->j_state_lock);
 
 	if (commit_transaction->t_checkpoint_list == NULL &&
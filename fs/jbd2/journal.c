@@ -38,6 +38,7 @@
 #include <linux/debugfs.h>
 #include <linux/seq_file.h>
 #include <linux/math64.h>
+#include <linux/hrtimer.h>
 
 #include <asm/uaccess.h>
 #include <asm/page.h>
@@ -74,6 +75,7 @@ EXPORT_SYMBOL(jbd2_journal_errno);
 EXPORT_SYMBOL(jbd2_journal_ack_err);
 EXPORT_SYMBOL(jbd2_journal_clear_err);
 EXPORT_SYMBOL(jbd2_log_wait_commit);
+EXPORT_SYMBOL(jbd2_complete_transaction);
 EXPORT_SYMBOL(jbd2_journal_start_commit);
 EXPORT_SYMBOL(jbd2_journal_force_commit_nested);
 EXPORT_SYMBOL(jbd2_journal_wipe);
@@ -584,6 +586,86 @@ int jbd2_log_wait_commit(journal_t *journal, tid_t tid)
 	return err;
 }
 
+/*
+ * How long the first fsync of a transaction holds back its commit so that
+ * other fsyncs can join it.  We wait for about as long as a commit takes on
+ * this device: fsyncs arriving in that time would otherwise have to queue
+ * behind our commit and then issue one of their own.  A single task doing a
+ * stream of fsyncs has nobody to wait for, unless the last commit showed
+ * that others were piggy-backing on it.
+ *
+ * Called under j_state_lock.  Returns the window in nanoseconds.
+ */
+static u64 jbd2_group_commit_window(journal_t *journal)
+{
+	pid_t pid = current->pid;
+	u64 window;
+
+	if (journal->j_last_sync_writer == pid &&
+	    journal->j_last_sync_batch <= 1)
+		return 0;
+	journal->j_last_sync_writer = pid;
+
+	window = journal->j_average_commit_time;
+	window = max_t(u64, window, 1000*journal->j_min_batch_time);
+	window = min_t(u64, window, 1000*journal->j_max_batch_time);
+	return window;
+}
+
+/**
+ * int jbd2_complete_transaction() - make sure a transaction is on disk
+ * @journal: journal the transaction belongs to
+ * @tid: transaction to wait for
+ *
+ * This is the fsync path: commit transaction @tid if that has not happened
+ * yet, and wait for it.  The first caller to ask for a still running
+ * transaction waits for the group commit window before kicking the commit
+ * thread; callers arriving meanwhile just wait along with it, so a burst of
+ * fsyncs costs one commit and one cache flush.
+ *
+ * Returns 1 if @tid was still running, so that its commit record is issued
+ * after all IO the caller has submitted; 0 if it was already committing or
+ * committed; or -EIO if the journal has aborted.
+ */
+int jbd2_complete_transaction(journal_t *journal, tid_t tid)
+{
+	transaction_t *transaction;
+	int ret = 1;
+	int err;
+
+	spin_lock(&journal->j_state_lock);
+	transaction = journal->j_running_transaction;
+	if (transaction && transaction->t_tid == tid) {
+		if (!transaction->t_sync_waiters++ &&
+		    !tid_geq(journal->j_commit_request, tid)) {
+			u64 window = jbd2_group_commit_window(journal);
+
+			if (window) {
+				ktime_t expires = ktime_add_ns(ktime_get(),
+							       window);
+
+				spin_unlock(&journal->j_state_lock);
+				set_current_state(TASK_UNINTERRUPTIBLE);
+				schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+				spin_lock(&journal->j_state_lock);
+			}
+			__jbd2_log_start_commit(journal, tid);
+		}
+	} else {
+		transaction = journal->j_committing_transaction;
+		if (!transaction || transaction->t_tid != tid) {
+			/* Committed already */
+			spin_unlock(&journal->j_state_lock);
+			return is_journal_aborted(journal) ? -EIO : 0;
+		}
+		ret = 0;
+	}
+	spin_unlock(&journal->j_state_lock);
+
+	err = jbd2_log_wait_commit(journal, tid);
+	return err ? err : ret;
+}
+
 /*
  * Log buffer allocation routines:
  */
@@ -855,6 +937,8 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 		   div_u64(s->journal->j_average_commit_time, 1000));
 	seq_printf(seq, "  %lu handles per transaction\n",
 	    s->stats->u.run.rs_handle_count / s->stats->ts_tid);
+	seq_printf(seq, "  %lu fsyncs per transaction\n",
+	    s->stats->u.run.rs_sync_waiters / s->stats->ts_tid);
 	seq_printf(seq, "  %lu blocks per transaction\n",
 	    s->stats->u.run.rs_blocks / s->stats->ts_tid);
 	seq_printf(seq, "  %lu logged blocks per transaction\n",
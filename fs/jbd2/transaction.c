@@ -1309,7 +1309,7 @@ int jbd2_journal_stop(handle_t *handle)
 
 		if (trans_time < commit_time) {
 			ktime_t expires = ktime_add_ns(ktime_get(),
-						       commit_time);
+						commit_time - trans_time);
 			set_current_state(TASK_UNINTERRUPTIBLE);
 			schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
 		}
@@ -35,7 +35,8 @@
 static uint32_t pseudo_random;
 
 static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
-				  unsigned char *buf, uint32_t buf_size, struct jffs2_summary *s);
+				  unsigned char *buf, uint32_t buf_size, struct jffs2_summary *s,
+				  uint32_t *sum_read_len);
 
 /* These helper functions _must_ increase ofs and also do the dirty/used space accounting.
  * Returning an error will abort the mount - bad checksums etc. should just mark the space
@@ -92,6 +93,7 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 	uint32_t empty_blocks = 0, bad_blocks = 0;
 	unsigned char *flashbuf = NULL;
 	uint32_t buf_size = 0;
+	uint32_t sum_read_len = 0;
 	struct jffs2_summary *s = NULL; /* summary info collected by the scan process */
 #ifndef __ECOS
 	size_t pointlen;
@@ -145,7 +147,7 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 		jffs2_sum_reset_collected(s);
 
 		ret = jffs2_scan_eraseblock(c, jeb, buf_size?flashbuf:(flashbuf+jeb->offset),
-						buf_size, s);
+						buf_size, s, &sum_read_len);
 
 		if (ret < 0)
 			goto out;
@@ -428,9 +430,15 @@ static int jffs2_scan_xref_node(struct jffs2_sb_info *c, struct jffs2_eraseblock
 #endif
 
 /* Called with 'buf_size == 0' if buf is in fact a pointer _directly_ into
-   the flash, XIP-style */
+   the flash, XIP-style.
+
+   On NAND, '*sum_read_len' is how much of the end of the block to read
+   when looking for the summary. It starts at one page and grows to the
+   largest summary seen so far, so that each summary is normally picked
+   up by a single read. */
 static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
-				  unsigned char *buf, uint32_t buf_size, struct jffs2_summary *s) {
+				  unsigned char *buf, uint32_t buf_size, struct jffs2_summary *s,
+				  uint32_t *sum_read_len) {
 	struct jffs2_unknown_node *node;
 	struct jffs2_unknown_node crcnode;
 	uint32_t ofs, prevofs;
@@ -449,24 +457,9 @@ static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblo
 	D1(printk(KERN_DEBUG "jffs2_scan_eraseblock(): Scanning block at 0x%x\n", ofs));
 
 #ifdef CONFIG_JFFS2_FS_WRITEBUFFER
-	if (jffs2_cleanmarker_oob(c)) {
-		int ret;
-
-		if (c->mtd->block_isbad(c->mtd, jeb->offset))
-			return BLK_STATE_BADBLOCK;
-
-		ret = jffs2_check_nand_cleanmarker(c, jeb);
-		D2(printk(KERN_NOTICE "jffs_check_nand_cleanmarker returned %d\n",ret));
-
-		/* Even if it's not found, we still scan to see
-		   if the block is empty. We use this information
-		   to decide whether to erase it or not. */
-		switch (ret) {
-		case 0:		cleanmarkerfound = 1; break;
-		case 1: 	break;
-		default: 	return ret;
-		}
-	}
+	if (jffs2_cleanmarker_oob(c) &&
+	    c->mtd->block_isbad(c->mtd, jeb->offset))
+		return BLK_STATE_BADBLOCK;
 #endif
 
 	if (jffs2_sum_active()) {
@@ -482,9 +475,9 @@ static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblo
 				sumlen = c->sector_size - je32_to_cpu(sm->offset);
 			}
 		} else {
-			/* If NAND flash, read a whole page of it. Else just the end */
+			/* If NAND flash, read at least a whole page of it. Else just the end */
 			if (c->wbuf_pagesize)
-				buf_len = c->wbuf_pagesize;
+				buf_len = max(c->wbuf_pagesize, *sum_read_len);
 			else
 				buf_len = sizeof(*sm);
 
@@ -500,6 +493,11 @@ static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblo
 				sumlen = c->sector_size - je32_to_cpu(sm->offset);
 				sumptr = buf + buf_size - sumlen;
 
+				/* Read the whole of summaries this big next time */
+				if (c->wbuf_pagesize && sumlen > *sum_read_len)
+					*sum_read_len = min_t(uint32_t, buf_size,
+						roundup(sumlen, c->wbuf_pagesize));
+
 				/* Now, make sure the summary itself is available */
 				if (sumlen > buf_size) {
 					/* Need to kmalloc for this. */
@@ -534,6 +532,26 @@ static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblo
 		}
 	}
 
+#ifdef CONFIG_JFFS2_FS_WRITEBUFFER
+	/* A summarized block is classified by its summary alone, so the
+	   cleanmarker is only looked for when the block has to be scanned. */
+	if (jffs2_cleanmarker_oob(c)) {
+		int ret;
+
+		ret = jffs2_check_nand_cleanmarker(c, jeb);
+		D2(printk(KERN_NOTICE "jffs_check_nand_cleanmarker returned %d\n",ret));
+
+		/* Even if it's not found, we still scan to see
+		   if the block is empty. We use this information
+		   to decide whether to erase it or not. */
+		switch (ret) {
+		case 0:		cleanmarkerfound = 1; break;
+		case 1: 	break;
+		default: 	return ret;
+		}
+	}
+#endif
+
 	buf_ofs = jeb->offset;
 
 	if (!buf_size) {
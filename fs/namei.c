@@ -427,8 +427,11 @@ static struct dentry * cached_lookup(struct dentry * parent, struct qstr * name,
  * If appropriate, check DAC only.  If not appropriate, or
  * short-cut DAC fails, then call permission() to do more
  * complete permission check.
+ *
+ * exec_permission_dac() leaves out the security hook, for callers
+ * that hold spinlocks.
  */
-static int exec_permission_lite(struct inode *inode)
+static int exec_permission_dac(struct inode *inode)
 {
 	umode_t	mode = inode->i_mode;
 
@@ -454,6 +457,15 @@ static int exec_permission_lite(struct inode *inode)
 
 	return -EACCES;
 ok:
+	return 0;
+}
+
+static int exec_permission_lite(struct inode *inode)
+{
+	int err = exec_permission_dac(inode);
+
+	if (err)
+		return err;
 	return security_inode_permission(inode, MAY_EXEC);
 }
 
@@ -815,6 +827,114 @@ fail:
 	return PTR_ERR(dentry);
 }
 
+/*
+ * Lazy walk over the cached part of a path.
+ *
+ * do_lookup() takes a reference on every component, and dropping it again
+ * takes dcache_lock whenever an unused dentry's count falls back to zero.
+ * For the intermediate components of a path all we need to know is that
+ * the child exists and may be searched, so walk those under rcu_read_lock()
+ * and the d_lock of one dentry at a time (which keeps its inode around),
+ * and only take a reference on the directory we end up in.  Anything that
+ * needs more care - "." and "..", d_hash/d_compare/d_revalidate,
+ * ->permission, negative dentries, symlinks and mountpoints - stops the
+ * lazy walk and is left to the ordinary code, which calls us again for
+ * the components after it.  The last component is always left to the
+ * caller.
+ *
+ * A rename anywhere in the meantime, or the dentry we reached having been
+ * unhashed, throws the lazy walk away; the ordinary walk then redoes it.
+ *
+ * Only DAC is checked under d_lock.  Security module hooks may sleep or
+ * take dcache_lock, so with a module registered there is no lazy walk.
+ */
+static void lazy_walk(const char **pname, struct nameidata *nd)
+{
+	struct dentry *parent = nd->path.dentry;
+	const char *name = *pname;
+	const char *done = name;
+	unsigned long seq;
+
+	if ((nd->flags & LOOKUP_REVAL) || security_module_registered())
+		return;
+
+	rcu_read_lock();
+	seq = read_seqbegin(&rename_lock);
+	for (;;) {
+		struct dentry *dentry;
+		struct inode *inode;
+		unsigned long hash;
+		struct qstr this;
+		unsigned int c;
+		int err;
+
+		this.name = name;
+		c = *(const unsigned char *)name;
+
+		hash = init_name_hash();
+		do {
+			name++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)name;
+		} while (c && (c != '/'));
+		this.len = name - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		if (!c)
+			break;
+		while (*++name == '/');
+		if (!*name)
+			break;
+		if (this.name[0] == '.' && (this.len == 1 ||
+		    (this.len == 2 && this.name[1] == '.')))
+			break;
+		if (parent->d_op &&
+		    (parent->d_op->d_hash || parent->d_op->d_compare))
+			break;
+
+		spin_lock(&parent->d_lock);
+		inode = parent->d_inode;
+		err = inode ? exec_permission_dac(inode) : -ENOENT;
+		spin_unlock(&parent->d_lock);
+		if (err)
+			break;
+
+		dentry = __d_lookup_rcu(parent, &this);
+		if (!dentry)
+			break;
+		inode = dentry->d_inode;
+		if ((dentry->d_op && dentry->d_op->d_revalidate) || !inode ||
+		    inode->i_op->follow_link || !inode->i_op->lookup ||
+		    d_mountpoint(dentry)) {
+			spin_unlock(&dentry->d_lock);
+			break;
+		}
+		spin_unlock(&dentry->d_lock);
+
+		parent = dentry;
+		done = name;
+	}
+
+	if (parent == nd->path.dentry) {
+		rcu_read_unlock();
+		return;
+	}
+
+	spin_lock(&parent->d_lock);
+	if (d_unhashed(parent) || read_seqretry(&rename_lock, seq)) {
+		spin_unlock(&parent->d_lock);
+		rcu_read_unlock();
+		return;
+	}
+	atomic_inc(&parent->d_count);
+	spin_unlock(&parent->d_lock);
+	rcu_read_unlock();
+
+	dput(nd->path.dentry);
+	nd->path.dentry = parent;
+	*pname = done;
+}
+
 /*
  * Name resolution.
  * This is the basic name resolution function, turning a pathname into
@@ -845,6 +965,9 @@ static int __link_path_walk(const char *name, struct nameidata *nd)
 		struct qstr this;
 		unsigned int c;
 
+		lazy_walk(&name, nd);
+		inode = nd->path.dentry->d_inode;
+
 		nd->flags |= LOOKUP_CONTINUE;
 		err = exec_permission_lite(inode);
 		if (err == -EAGAIN)
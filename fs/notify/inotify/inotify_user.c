@@ -32,6 +32,8 @@
 #include <linux/inotify.h>
 #include <linux/syscalls.h>
 #include <linux/magic.h>
+#include <linux/workqueue.h>
+#include <linux/mm.h>
 
 #include <asm/ioctls.h>
 
@@ -44,6 +46,7 @@ static struct vfsmount *inotify_mnt __read_mostly;
 static int inotify_max_user_instances __read_mostly;
 static int inotify_max_user_watches __read_mostly;
 static int inotify_max_queued_events __read_mostly;
+static int inotify_coalesce_delay_ms __read_mostly;
 
 /*
  * Lock ordering:
@@ -83,6 +86,11 @@ struct inotify_device {
 	unsigned int		queue_size;	/* size of the queue (bytes) */
 	unsigned int		event_count;	/* number of pending events */
 	unsigned int		max_events;	/* maximum number of events */
+	struct list_head	held;		/* IN_MODIFY events held back */
+	unsigned int		held_count;	/* number of held events */
+	int			coalesce;	/* opened with IN_COALESCE */
+	unsigned long		coalesce_delay;	/* jiffies to hold events */
+	struct delayed_work	flush_work;	/* releases held events */
 };
 
 /*
@@ -145,6 +153,15 @@ ctl_table inotify_table[] = {
 		.strategy	= &sysctl_intvec,
 		.extra1		= &zero
 	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "coalesce_delay_ms",
+		.data		= &inotify_coalesce_delay_ms,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec_minmax,
+		.extra1		= &zero
+	},
 	{ .ctl_name = 0 }
 };
 #endif /* CONFIG_SYSCTL */
@@ -261,6 +278,106 @@ inotify_dev_get_last_event(struct inotify_device *dev)
 	return list_entry(dev->events.prev, struct inotify_kernel_event, list);
 }
 
+/*
+ * free_kevent - frees the given kevent.
+ */
+static void free_kevent(struct inotify_kernel_event *kevent)
+{
+	kfree(kevent->name);
+	kmem_cache_free(event_cachep, kevent);
+}
+
+/*
+ * inotify_dev_flush_held - move the held back IN_MODIFY events to the queue
+ *
+ * Caller must hold dev->ev_mutex.
+ */
+static void inotify_dev_flush_held(struct inotify_device *dev)
+{
+	struct inotify_kernel_event *kevent, *next;
+
+	if (list_empty(&dev->held))
+		return;
+
+	list_for_each_entry_safe(kevent, next, &dev->held, list) {
+		list_del(&kevent->list);
+
+		/* same overflow handling as in inotify_dev_queue_event() */
+		if (unlikely(dev->event_count >= dev->max_events)) {
+			bool overflow = dev->event_count == dev->max_events;
+
+			free_kevent(kevent);
+			count_vm_event(INOTIFY_DROPPED);
+			if (!overflow)
+				continue;
+			kevent = kernel_event(-1, IN_Q_OVERFLOW, 0, NULL);
+			if (unlikely(!kevent))
+				continue;
+		}
+
+		dev->event_count++;
+		dev->queue_size += sizeof(struct inotify_event) +
+				   kevent->event.len;
+		list_add_tail(&kevent->list, &dev->events);
+		count_vm_event(INOTIFY_QUEUED);
+	}
+	dev->held_count = 0;
+
+	wake_up_interruptible(&dev->wq);
+	kill_fasync(&dev->fa, SIGIO, POLL_IN);
+}
+
+static void inotify_dev_flush_work(struct work_struct *work)
+{
+	struct inotify_device *dev;
+
+	dev = container_of(work, struct inotify_device, flush_work.work);
+
+	mutex_lock(&dev->ev_mutex);
+	inotify_dev_flush_held(dev);
+	mutex_unlock(&dev->ev_mutex);
+}
+
+/*
+ * inotify_dev_hold_event - hold back an IN_MODIFY event on an IN_COALESCE
+ * device, merging it with one already held for the same file.  The held
+ * events are queued together once the coalescing delay has passed, or
+ * before any other event, so that they keep their order with respect to
+ * those.
+ *
+ * Caller must hold dev->ev_mutex.
+ */
+static void inotify_dev_hold_event(struct inotify_device *dev, s32 wd,
+				   u32 mask, const char *name)
+{
+	struct inotify_kernel_event *kevent;
+
+	list_for_each_entry(kevent, &dev->held, list) {
+		const char *heldname = kevent->name;
+
+		if (kevent->event.wd != wd)
+			continue;
+		if ((!name && !heldname) ||
+		    (name && heldname && !strcmp(heldname, name))) {
+			count_vm_event(INOTIFY_MERGED);
+			return;
+		}
+	}
+
+	if (unlikely(dev->held_count >= dev->max_events))
+		inotify_dev_flush_held(dev);
+
+	kevent = kernel_event(wd, mask, 0, name);
+	if (unlikely(!kevent)) {
+		count_vm_event(INOTIFY_DROPPED);
+		return;
+	}
+
+	list_add_tail(&kevent->list, &dev->held);
+	if (!dev->held_count++)
+		schedule_delayed_work(&dev->flush_work, dev->coalesce_delay);
+}
+
 /*
  * inotify_dev_queue_event - event handler registered with core inotify, adds
  * a new event to the given device
@@ -286,35 +403,50 @@ static void inotify_dev_queue_event(struct inotify_watch *w, u32 wd, u32 mask,
 	if (mask & IN_IGNORED || w->mask & IN_ONESHOT)
 		put_inotify_watch(w); /* final put */
 
+	if (dev->coalesce) {
+		if (mask == IN_MODIFY) {
+			inotify_dev_hold_event(dev, wd, mask, name);
+			goto out;
+		}
+		inotify_dev_flush_held(dev);
+	}
+
 	/* coalescing: drop this event if it is a dupe of the previous */
 	last = inotify_dev_get_last_event(dev);
 	if (last && last->event.mask == mask && last->event.wd == wd &&
 			last->event.cookie == cookie) {
 		const char *lastname = last->name;
 
-		if (!name && !lastname)
-			goto out;
-		if (name && lastname && !strcmp(lastname, name))
+		if ((!name && !lastname) ||
+		    (name && lastname && !strcmp(lastname, name))) {
+			count_vm_event(INOTIFY_MERGED);
 			goto out;
+		}
 	}
 
 	/* the queue overflowed and we already sent the Q_OVERFLOW event */
-	if (unlikely(dev->event_count > dev->max_events))
+	if (unlikely(dev->event_count > dev->max_events)) {
+		count_vm_event(INOTIFY_DROPPED);
 		goto out;
+	}
 
 	/* if the queue overflows, we need to notify user space */
-	if (unlikely(dev->event_count == dev->max_events))
+	if (unlikely(dev->event_count == dev->max_events)) {
+		count_vm_event(INOTIFY_DROPPED);
 		kevent = kernel_event(-1, IN_Q_OVERFLOW, cookie, NULL);
-	else
+	} else
 		kevent = kernel_event(wd, mask, cookie, name);
 
-	if (unlikely(!kevent))
+	if (unlikely(!kevent)) {
+		count_vm_event(INOTIFY_DROPPED);
 		goto out;
+	}
 
 	/* queue the event and wake up anyone waiting */
 	dev->event_count++;
 	dev->queue_size += sizeof(struct inotify_event) + kevent->event.len;
 	list_add_tail(&kevent->list, &dev->events);
+	count_vm_event(INOTIFY_QUEUED);
 	wake_up_interruptible(&dev->wq);
 	kill_fasync(&dev->fa, SIGIO, POLL_IN);
 
@@ -336,15 +468,6 @@ static void remove_kevent(struct inotify_device *dev,
 	dev->queue_size -= sizeof(struct inotify_event) + kevent->event.len;
 }
 
-/*
- * free_kevent - frees the given kevent.
- */
-static void free_kevent(struct inotify_kernel_event *kevent)
-{
-	kfree(kevent->name);
-	kmem_cache_free(event_cachep, kevent);
-}
-
 /*
  * inotify_dev_event_dequeue - destroy an event on the given device
  *
@@ -543,11 +666,20 @@ static int inotify_release(struct inode *ignored, struct file *file)
 	struct inotify_device *dev = file->private_data;
 
 	inotify_destroy(dev->ih);
+	cancel_delayed_work_sync(&dev->flush_work);
 
 	/* destroy all of the events on this device */
 	mutex_lock(&dev->ev_mutex);
 	while (!list_empty(&dev->events))
 		inotify_dev_event_dequeue(dev);
+	while (!list_empty(&dev->held)) {
+		struct inotify_kernel_event *kevent;
+
+		kevent = list_first_entry(&dev->held,
+					  struct inotify_kernel_event, list);
+		list_del(&kevent->list);
+		free_kevent(kevent);
+	}
 	mutex_unlock(&dev->ev_mutex);
 
 	/* free this device: the put matching the get in inotify_init() */
@@ -601,7 +733,7 @@ SYSCALL_DEFINE1(inotify_init1, int, flags)
 	BUILD_BUG_ON(IN_CLOEXEC != O_CLOEXEC);
 	BUILD_BUG_ON(IN_NONBLOCK != O_NONBLOCK);
 
-	if (flags & ~(IN_CLOEXEC | IN_NONBLOCK))
+	if (flags & ~(IN_CLOEXEC | IN_NONBLOCK | IN_COALESCE))
 		return -EINVAL;
 
 	fd = get_unused_fd_flags(flags & O_CLOEXEC);
@@ -650,6 +782,11 @@ SYSCALL_DEFINE1(inotify_init1, int, flags)
 	dev->event_count = 0;
 	dev->queue_size = 0;
 	dev->max_events = inotify_max_queued_events;
+	INIT_LIST_HEAD(&dev->held);
+	dev->held_count = 0;
+	dev->coalesce = !!(flags & IN_COALESCE);
+	dev->coalesce_delay = msecs_to_jiffies(inotify_coalesce_delay_ms);
+	INIT_DELAYED_WORK(&dev->flush_work, inotify_dev_flush_work);
 	dev->user = user;
 	atomic_set(&dev->count, 0);
 
@@ -778,6 +915,7 @@ static int __init inotify_user_setup(void)
 	inotify_max_queued_events = 16384;
 	inotify_max_user_instances = 128;
 	inotify_max_user_watches = 8192;
+	inotify_coalesce_delay_ms = 100;
 
 	watch_cachep = kmem_cache_create("inotify_watch_cache",
 					 sizeof(struct inotify_user_watch),
@@ -24,6 +24,8 @@
 /*
  * Blocks in Squashfs are compressed.  To avoid repeatedly decompressing
  * recently accessed data Squashfs uses two small metadata and fragment caches.
+ * Their size can be set with the metadata_cache and fragment_cache mount
+ * options, and unused entries are replaced in least recently used order.
  *
  * This file implements a generic cache implementation used for both caches,
  * plus functions layered ontop of the generic cache implementation to
@@ -51,6 +53,7 @@
 #include <linux/sched.h>
 #include <linux/spinlock.h>
 #include <linux/wait.h>
+#include <linux/list.h>
 #include <linux/zlib.h>
 #include <linux/pagemap.h>
 
@@ -66,7 +69,7 @@
 struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 	struct squashfs_cache *cache, u64 block, int length)
 {
-	int i, n;
+	int i;
 	struct squashfs_cache_entry *entry;
 
 	spin_lock(&cache->lock);
@@ -91,19 +94,18 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			}
 
 			/*
-			 * At least one unused cache entry.  A simple
-			 * round-robin strategy is used to choose the entry to
-			 * be evicted from the cache.
+			 * At least one unused cache entry.  Unused entries are
+			 * kept on the LRU list in order of release, so the
+			 * least recently used entry is at the head.
 			 */
-			i = cache->next_blk;
-			for (n = 0; n < cache->entries; n++) {
-				if (cache->entry[i].refcount == 0)
-					break;
-				i = (i + 1) % cache->entries;
-			}
+			entry = list_first_entry(&cache->lru,
+				struct squashfs_cache_entry, lru);
+			list_del_init(&entry->lru);
+			i = entry - cache->entry;
 
-			cache->next_blk = (i + 1) % cache->entries;
-			entry = &cache->entry[i];
+			cache->misses++;
+			if (entry->block != SQUASHFS_INVALID_BLK)
+				cache->evictions++;
 
 			/*
 			 * Initialise choosen cache entry, and fill it in from
@@ -149,8 +151,11 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		 * for reuse.
 		 */
 		entry = &cache->entry[i];
-		if (entry->refcount == 0)
+		cache->hits++;
+		if (entry->refcount == 0) {
 			cache->unused--;
+			list_del_init(&entry->lru);
+		}
 		entry->refcount++;
 
 		/*
@@ -189,6 +194,14 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
 	entry->refcount--;
 	if (entry->refcount == 0) {
 		cache->unused++;
+		/*
+		 * Entries which failed to read are of no further use, put
+		 * them at the head of the LRU so they're reused first.
+		 */
+		if (entry->error)
+			list_add(&entry->lru, &cache->lru);
+		else
+			list_add_tail(&entry->lru, &cache->lru);
 		/*
 		 * If there's any processes waiting for a block to become
 		 * available, wake one up.
@@ -247,7 +260,6 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		goto cleanup;
 	}
 
-	cache->next_blk = 0;
 	cache->unused = entries;
 	cache->entries = entries;
 	cache->block_size = block_size;
@@ -256,6 +268,7 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 	cache->num_waiters = 0;
 	spin_lock_init(&cache->lock);
 	init_waitqueue_head(&cache->wait_queue);
+	INIT_LIST_HEAD(&cache->lru);
 
 	for (i = 0; i < entries; i++) {
 		struct squashfs_cache_entry *entry = &cache->entry[i];
@@ -263,6 +276,7 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		init_waitqueue_head(&cache->entry[i].wait_queue);
 		entry->cache = cache;
 		entry->block = SQUASHFS_INVALID_BLK;
+		list_add_tail(&entry->lru, &cache->lru);
 		entry->data = kcalloc(cache->pages, sizeof(void *), GFP_KERNEL);
 		if (entry->data == NULL) {
 			ERROR("Failed to allocate %s cache entry\n", name);
@@ -36,6 +36,16 @@ static inline struct squashfs_inode_info *squashfs_i(struct inode *inode)
 extern int squashfs_read_data(struct super_block *, void **, u64, int, u64 *,
 				int, int);
 
+/* decompressor_xxx.c */
+extern void *squashfs_decompressor_create(struct squashfs_sb_info *);
+extern void squashfs_decompressor_destroy(struct squashfs_sb_info *);
+extern int squashfs_decompress(struct squashfs_sb_info *, void **,
+				struct buffer_head **, int, int, int, int, int);
+extern int squashfs_max_decompressors(void);
+
+/* decompressor.c */
+extern const struct squashfs_decompressor *squashfs_lookup_decompressor(int);
+
 /* cache.c */
 extern struct squashfs_cache *squashfs_cache_init(char *, int, int);
 extern void squashfs_cache_delete(struct squashfs_cache *);
@@ -51,6 +61,19 @@ extern struct squashfs_cache_entry *squashfs_get_datablock(struct super_block *,
 				u64, int);
 extern int squashfs_read_table(struct super_block *, void *, u64, int);
 
+/* sysfs.c */
+extern int squashfs_sysfs_register(struct super_block *);
+extern void squashfs_sysfs_unregister(struct super_block *);
+extern int __init squashfs_sysfs_init(void);
+extern void squashfs_sysfs_exit(void);
+
+/* file.c */
+extern void squashfs_copy_cache(struct page *, struct squashfs_cache_entry *,
+				int, int);
+
+/* file_xxx.c */
+extern int squashfs_readpage_block(struct page *, u64, int);
+
 /* export.c */
 extern __le64 *squashfs_read_inode_lookup_table(struct super_block *, u64,
 				unsigned int);
@@ -28,13 +28,16 @@
 struct squashfs_cache {
 	char			*name;
 	int			entries;
-	int			next_blk;
 	int			num_waiters;
 	int			unused;
 	int			block_size;
 	int			pages;
 	spinlock_t		lock;
 	wait_queue_head_t	wait_queue;
+	struct list_head	lru;
+	unsigned long		hits;
+	unsigned long		misses;
+	unsigned long		evictions;
 	struct squashfs_cache_entry *entry;
 };
 
@@ -48,12 +51,14 @@ struct squashfs_cache_entry {
 	int			num_waiters;
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache	*cache;
+	struct list_head	lru;
 	void			**data;
 };
 
 struct squashfs_sb_info {
 	int			devblksize;
 	int			devblksize_log2;
+	const struct squashfs_decompressor *decompressor;
 	struct squashfs_cache	*block_cache;
 	struct squashfs_cache	*fragment_cache;
 	struct squashfs_cache	*read_page;
@@ -61,10 +66,9 @@ struct squashfs_sb_info {
 	__le64			*id_table;
 	__le64			*fragment_index;
 	unsigned int		*fragment_index_2;
-	struct mutex		read_data_mutex;
 	struct mutex		meta_index_mutex;
 	struct meta_index	*meta_index;
-	z_stream		stream;
+	void			*stream;
 	__le64			*inode_lookup_table;
 	u64			inode_table;
 	u64			directory_table;
@@ -72,5 +76,9 @@ struct squashfs_sb_info {
 	unsigned short		block_log;
 	long long		bytes_used;
 	unsigned int		inodes;
+	int			metadata_cache_entries;
+	int			fragment_cache_entries;
+	struct kobject		s_kobj;
+	struct completion	s_kobj_unregister;
 };
 #endif
@@ -34,32 +34,104 @@
 #include <linux/pagemap.h>
 #include <linux/init.h>
 #include <linux/module.h>
-#include <linux/zlib.h>
 #include <linux/magic.h>
+#include <linux/parser.h>
+#include <linux/seq_file.h>
+#include <linux/mount.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "decompressor.h"
 
 static struct file_system_type squashfs_fs_type;
 static struct super_operations squashfs_super_ops;
 
-static int supported_squashfs_filesystem(short major, short minor, short comp)
+static const struct squashfs_decompressor *supported_squashfs_filesystem(
+	short major, short minor, short id)
 {
+	const struct squashfs_decompressor *decompressor;
+
 	if (major < SQUASHFS_MAJOR) {
 		ERROR("Major/Minor mismatch, older Squashfs %d.%d "
 			"filesystems are unsupported\n", major, minor);
-		return -EINVAL;
+		return NULL;
 	} else if (major > SQUASHFS_MAJOR || minor > SQUASHFS_MINOR) {
 		ERROR("Major/Minor mismatch, trying to mount newer "
 			"%d.%d filesystem\n", major, minor);
 		ERROR("Please update your kernel\n");
-		return -EINVAL;
+		return NULL;
+	}
+
+	decompressor = squashfs_lookup_decompressor(id);
+	if (!decompressor->supported) {
+		ERROR("Filesystem uses \"%s\" compression. This is not "
+			"supported\n", decompressor->name);
+		return NULL;
 	}
 
-	if (comp != ZLIB_COMPRESSION)
-		return -EINVAL;
+	return decompressor;
+}
+
+
+enum {
+	Opt_metadata_cache, Opt_fragment_cache, Opt_err
+};
+
+static const match_table_t tokens = {
+	{Opt_metadata_cache, "metadata_cache=%u"},
+	{Opt_fragment_cache, "fragment_cache=%u"},
+	{Opt_err, NULL}
+};
+
+
+/*
+ * Parse the cache sizing mount options.  The caches are allocated at mount
+ * time, so these are ignored on remount.
+ */
+static int squashfs_parse_options(struct squashfs_sb_info *msblk, char *options)
+{
+	char *p;
+	int option;
+	substring_t args[MAX_OPT_ARGS];
+
+	if (!options)
+		return 0;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		int token;
+
+		if (!*p)
+			continue;
+
+		token = match_token(p, tokens, args);
+		switch (token) {
+		case Opt_metadata_cache:
+			if (match_int(&args[0], &option) ||
+					option < SQUASHFS_CACHED_BLKS ||
+					option > SQUASHFS_MAX_CACHED_BLKS) {
+				ERROR("metadata_cache must be between %d and "
+					"%d\n", SQUASHFS_CACHED_BLKS,
+					SQUASHFS_MAX_CACHED_BLKS);
+				return -EINVAL;
+			}
+			msblk->metadata_cache_entries = option;
+			break;
+		case Opt_fragment_cache:
+			if (match_int(&args[0], &option) || option < 1 ||
+					option > SQUASHFS_MAX_CACHED_BLKS) {
+				ERROR("fragment_cache must be between 1 and "
+					"%d\n", SQUASHFS_MAX_CACHED_BLKS);
+				return -EINVAL;
+			}
+			msblk->fragment_cache_entries = option;
+			break;
+		default:
+			ERROR("Unrecognized mount option \"%s\"\n", p);
+			return -EINVAL;
+		}
+	}
 
 	return 0;
 }
@@ -86,13 +158,6 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	}
 	msblk = sb->s_fs_info;
 
-	msblk->stream.workspace = kmalloc(zlib_inflate_workspacesize(),
-		GFP_KERNEL);
-	if (msblk->stream.workspace == NULL) {
-		ERROR("Failed to allocate zlib workspace\n");
-		goto failure;
-	}
-
 	sblk = kzalloc(sizeof(*sblk), GFP_KERNEL);
 	if (sblk == NULL) {
 		ERROR("Failed to allocate squashfs_super_block\n");
@@ -102,9 +167,14 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	msblk->devblksize = sb_min_blocksize(sb, BLOCK_SIZE);
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
-	mutex_init(&msblk->read_data_mutex);
 	mutex_init(&msblk->meta_index_mutex);
 
+	msblk->metadata_cache_entries = SQUASHFS_CACHED_BLKS;
+	msblk->fragment_cache_entries = SQUASHFS_CACHED_FRAGMENTS;
+	err = squashfs_parse_options(msblk, data);
+	if (err)
+		goto failed_mount;
+
 	/*
 	 * msblk->bytes_used is checked in squashfs_read_table to ensure reads
 	 * are not beyond filesystem end.  But as we're using
@@ -129,15 +199,16 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 		goto failed_mount;
 	}
 
-	/* Check the MAJOR & MINOR versions and compression type */
-	err = supported_squashfs_filesystem(le16_to_cpu(sblk->s_major),
+	err = -EINVAL;
+
+	/* Check the MAJOR & MINOR versions and lookup compression type */
+	msblk->decompressor = supported_squashfs_filesystem(
+			le16_to_cpu(sblk->s_major),
 			le16_to_cpu(sblk->s_minor),
 			le16_to_cpu(sblk->compression));
-	if (err < 0)
+	if (msblk->decompressor == NULL)
 		goto failed_mount;
 
-	err = -EINVAL;
-
 	/*
 	 * Check if there's xattrs in the filesystem.  These are not
 	 * supported in this version, so warn that they will be ignored.
@@ -172,6 +243,7 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	flags = le16_to_cpu(sblk->flags);
 
 	TRACE("Found valid superblock on %s\n", bdevname(sb->s_bdev, b));
+	TRACE("Compression type %s\n", msblk->decompressor->name);
 	TRACE("Inodes are %scompressed\n", SQUASHFS_UNCOMPRESSED_INODES(flags)
 				? "un" : "");
 	TRACE("Data is %scompressed\n", SQUASHFS_UNCOMPRESSED_DATA(flags)
@@ -192,15 +264,26 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	sb->s_flags |= MS_RDONLY;
 	sb->s_op = &squashfs_super_ops;
 
+	msblk->stream = squashfs_decompressor_create(msblk);
+	if (IS_ERR(msblk->stream)) {
+		err = PTR_ERR(msblk->stream);
+		msblk->stream = NULL;
+		goto failed_mount;
+	}
+
 	err = -ENOMEM;
 
 	msblk->block_cache = squashfs_cache_init("metadata",
-			SQUASHFS_CACHED_BLKS, SQUASHFS_METADATA_SIZE);
+			msblk->metadata_cache_entries, SQUASHFS_METADATA_SIZE);
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
-	/* Allocate read_page block */
-	msblk->read_page = squashfs_cache_init("data", 1, msblk->block_size);
+	/*
+	 * Allocate read_page blocks, one per decompressor so that readers
+	 * going through the cache are not serialised on it
+	 */
+	msblk->read_page = squashfs_cache_init("data",
+		squashfs_max_decompressors(), msblk->block_size);
 	if (msblk->read_page == NULL) {
 		ERROR("Failed to allocate read_page block\n");
 		goto failed_mount;
@@ -220,7 +303,7 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 		goto allocate_lookup_table;
 
 	msblk->fragment_cache = squashfs_cache_init("fragment",
-		SQUASHFS_CACHED_FRAGMENTS, msblk->block_size);
+		msblk->fragment_cache_entries, msblk->block_size);
 	if (msblk->fragment_cache == NULL) {
 		err = -ENOMEM;
 		goto failed_mount;
@@ -273,6 +356,14 @@ allocate_root:
 		goto failed_mount;
 	}
 
+	err = squashfs_sysfs_register(sb);
+	if (err) {
+		ERROR("Failed to register %s in sysfs\n", sb->s_id);
+		dput(sb->s_root);
+		sb->s_root = NULL;
+		goto failed_mount;
+	}
+
 	TRACE("Leaving squashfs_fill_super\n");
 	kfree(sblk);
 	return 0;
@@ -284,14 +375,13 @@ failed_mount:
 	kfree(msblk->inode_lookup_table);
 	kfree(msblk->fragment_index);
 	kfree(msblk->id_table);
-	kfree(msblk->stream.workspace);
+	squashfs_decompressor_destroy(msblk);
 	kfree(sb->s_fs_info);
 	sb->s_fs_info = NULL;
 	kfree(sblk);
 	return err;
 
 failure:
-	kfree(msblk->stream.workspace);
 	kfree(sb->s_fs_info);
 	sb->s_fs_info = NULL;
 	return -ENOMEM;
@@ -323,17 +413,33 @@ static int squashfs_remount(struct super_block *sb, int *flags, char *data)
 }
 
 
+static int squashfs_show_options(struct seq_file *seq, struct vfsmount *vfs)
+{
+	struct squashfs_sb_info *msblk = vfs->mnt_sb->s_fs_info;
+
+	if (msblk->metadata_cache_entries != SQUASHFS_CACHED_BLKS)
+		seq_printf(seq, ",metadata_cache=%d",
+			msblk->metadata_cache_entries);
+	if (msblk->fragment_cache_entries != SQUASHFS_CACHED_FRAGMENTS)
+		seq_printf(seq, ",fragment_cache=%d",
+			msblk->fragment_cache_entries);
+
+	return 0;
+}
+
+
 static void squashfs_put_super(struct super_block *sb)
 {
 	if (sb->s_fs_info) {
 		struct squashfs_sb_info *sbi = sb->s_fs_info;
+		squashfs_sysfs_unregister(sb);
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
 		kfree(sbi->id_table);
 		kfree(sbi->fragment_index);
 		kfree(sbi->meta_index);
-		kfree(sbi->stream.workspace);
+		squashfs_decompressor_destroy(sbi);
 		kfree(sb->s_fs_info);
 		sb->s_fs_info = NULL;
 	}
@@ -383,8 +489,15 @@ static int __init init_squashfs_fs(void)
 	if (err)
 		return err;
 
+	err = squashfs_sysfs_init();
+	if (err) {
+		destroy_inodecache();
+		return err;
+	}
+
 	err = register_filesystem(&squashfs_fs_type);
 	if (err) {
+		squashfs_sysfs_exit();
 		destroy_inodecache();
 		return err;
 	}
@@ -399,6 +512,7 @@ static int __init init_squashfs_fs(void)
 static void __exit exit_squashfs_fs(void)
 {
 	unregister_filesystem(&squashfs_fs_type);
+	squashfs_sysfs_exit();
 	destroy_inodecache();
 }
 
@@ -431,6 +545,7 @@ static struct super_operations squashfs_super_ops = {
 	.destroy_inode = squashfs_destroy_inode,
 	.statfs = squashfs_statfs,
 	.put_super = squashfs_put_super,
+	.show_options = squashfs_show_options,
 	.remount_fs = squashfs_remount
 };
 
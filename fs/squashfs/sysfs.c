@@ -0,0 +1,182 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * Copyright (c) 2002, 2003, 2004, 2005, 2006, 2007, 2008
+ * Phillip Lougher <phillip@lougher.demon.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * sysfs.c
+ */
+
+/*
+ * Each mounted filesystem exports the size and hit/miss/eviction counters of
+ * its metadata, fragment and data caches in /sys/fs/squashfs/<dev>/.  This
+ * allows the metadata_cache and fragment_cache mount options to be tuned
+ * against the measured hit rate of a workload.
+ */
+
+#include <linux/fs.h>
+#include <linux/vfs.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/kobject.h>
+#include <linux/completion.h>
+#include <linux/stringify.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs_fs_i.h"
+#include "squashfs.h"
+
+static struct kset *squashfs_kset;
+
+struct squashfs_attr {
+	struct attribute attr;
+	ssize_t (*show)(struct squashfs_sb_info *, char *);
+};
+
+static ssize_t cache_show(struct squashfs_cache *cache, char *buf,
+	int field)
+{
+	unsigned long val = 0;
+
+	if (cache) {
+		spin_lock(&cache->lock);
+		switch (field) {
+		case 0:
+			val = cache->entries;
+			break;
+		case 1:
+			val = cache->hits;
+			break;
+		case 2:
+			val = cache->misses;
+			break;
+		case 3:
+			val = cache->evictions;
+			break;
+		}
+		spin_unlock(&cache->lock);
+	}
+
+	return snprintf(buf, PAGE_SIZE, "%lu\n", val);
+}
+
+#define SQUASHFS_CACHE_ATTR(_member, _name, _field)			\
+static ssize_t _name##_show(struct squashfs_sb_info *msblk, char *buf)	\
+{									\
+	return cache_show(msblk->_member, buf, _field);			\
+}									\
+static struct squashfs_attr squashfs_attr_##_name = {			\
+	.attr = { .name = __stringify(_name), .mode = 0444 },		\
+	.show = _name##_show,						\
+}
+
+#define SQUASHFS_CACHE_ATTRS(_cache, _member)				\
+	SQUASHFS_CACHE_ATTR(_member, _cache##_entries, 0);		\
+	SQUASHFS_CACHE_ATTR(_member, _cache##_hits, 1);			\
+	SQUASHFS_CACHE_ATTR(_member, _cache##_misses, 2);		\
+	SQUASHFS_CACHE_ATTR(_member, _cache##_evictions, 3)
+
+SQUASHFS_CACHE_ATTRS(metadata, block_cache);
+SQUASHFS_CACHE_ATTRS(fragment, fragment_cache);
+SQUASHFS_CACHE_ATTRS(data, read_page);
+
+#define ATTR_LIST(_cache)						\
+	&squashfs_attr_##_cache##_entries.attr,				\
+	&squashfs_attr_##_cache##_hits.attr,				\
+	&squashfs_attr_##_cache##_misses.attr,				\
+	&squashfs_attr_##_cache##_evictions.attr
+
+static struct attribute *squashfs_attrs[] = {
+	ATTR_LIST(metadata),
+	ATTR_LIST(fragment),
+	ATTR_LIST(data),
+	NULL
+};
+
+static ssize_t squashfs_attr_show(struct kobject *kobj,
+	struct attribute *attr, char *buf)
+{
+	struct squashfs_sb_info *msblk = container_of(kobj,
+		struct squashfs_sb_info, s_kobj);
+	struct squashfs_attr *a = container_of(attr, struct squashfs_attr,
+		attr);
+
+	return a->show ? a->show(msblk, buf) : 0;
+}
+
+static void squashfs_sb_release(struct kobject *kobj)
+{
+	struct squashfs_sb_info *msblk = container_of(kobj,
+		struct squashfs_sb_info, s_kobj);
+
+	complete(&msblk->s_kobj_unregister);
+}
+
+static struct sysfs_ops squashfs_attr_ops = {
+	.show	= squashfs_attr_show,
+};
+
+static struct kobj_type squashfs_ktype = {
+	.default_attrs	= squashfs_attrs,
+	.sysfs_ops	= &squashfs_attr_ops,
+	.release	= squashfs_sb_release,
+};
+
+
+int squashfs_sysfs_register(struct super_block *sb)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	int err;
+
+	msblk->s_kobj.kset = squashfs_kset;
+	init_completion(&msblk->s_kobj_unregister);
+	err = kobject_init_and_add(&msblk->s_kobj, &squashfs_ktype, NULL,
+		"%s", sb->s_id);
+	if (err) {
+		kobject_put(&msblk->s_kobj);
+		wait_for_completion(&msblk->s_kobj_unregister);
+	}
+
+	return err;
+}
+
+
+/*
+ * Wait for the kobject to be released before the caller frees
+ * squashfs_sb_info, a sysfs reader may still hold a reference.
+ */
+void squashfs_sysfs_unregister(struct super_block *sb)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+
+	kobject_put(&msblk->s_kobj);
+	wait_for_completion(&msblk->s_kobj_unregister);
+}
+
+
+int __init squashfs_sysfs_init(void)
+{
+	squashfs_kset = kset_create_and_add("squashfs", NULL, fs_kobj);
+	return squashfs_kset ? 0 : -ENOMEM;
+}
+
+
+void squashfs_sysfs_exit(void)
+{
+	kset_unregister(squashfs_kset);
+}
@@ -28,6 +28,7 @@
  */
 
 #include <linux/crypto.h>
+#include <linux/workqueue.h>
 #include "ubifs.h"
 
 /* Fake description object for the "none" compressor */
@@ -74,6 +75,9 @@ static struct ubifs_compressor zlib_compr = {
 /* All UBIFS compressors */
 struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
 
+/* Compression workers used at write-back (see 'ubifs_writepages()') */
+struct workqueue_struct *ubifs_compr_wq;
+
 /**
  * ubifs_compress - compress data.
  * @in_buf: data to compress
@@ -233,9 +237,17 @@ int __init ubifs_compressors_init(void)
 	if (err)
 		goto out_lzo;
 
+	ubifs_compr_wq = create_workqueue("ubifs_compr");
+	if (!ubifs_compr_wq) {
+		err = -ENOMEM;
+		goto out_zlib;
+	}
+
 	ubifs_compressors[UBIFS_COMPR_NONE] = &none_compr;
 	return 0;
 
+out_zlib:
+	compr_exit(&zlib_compr);
 out_lzo:
 	compr_exit(&lzo_compr);
 	return err;
@@ -246,6 +258,7 @@ out_lzo:
  */
 void ubifs_compressors_exit(void)
 {
+	destroy_workqueue(ubifs_compr_wq);
 	compr_exit(&lzo_compr);
 	compr_exit(&zlib_compr);
 }
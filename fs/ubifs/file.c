@@ -54,6 +54,9 @@
 #include "ubifs.h"
 #include <linux/mount.h>
 #include <linux/namei.h>
+#include <linux/writeback.h>
+#include <linux/workqueue.h>
+#include <linux/cpu.h>
 
 static int read_block(struct inode *inode, void *addr, unsigned int block,
 		      struct ubifs_data_node *dn)
@@ -879,6 +882,41 @@ static int ubifs_readpage(struct file *file, struct page *page)
 	return 0;
 }
 
+/**
+ * finish_writepage - finish writing back a page.
+ * @page: the page which has been written
+ * @err: result of writing the page
+ *
+ * This function releases the budget of the page, unlocks it and ends its
+ * write-back. Returns @err.
+ */
+static int finish_writepage(struct page *page, int err)
+{
+	struct inode *inode = page->mapping->host;
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+
+	if (err) {
+		SetPageError(page);
+		ubifs_err("cannot write page %lu of inode %lu, error %d",
+			  page->index, inode->i_ino, err);
+		ubifs_ro_mode(c, err);
+	}
+
+	ubifs_assert(PagePrivate(page));
+	if (PageChecked(page))
+		release_new_page_budget(c);
+	else
+		release_existing_page_budget(c);
+
+	atomic_long_dec(&c->dirty_pg_cnt);
+	ClearPagePrivate(page);
+	ClearPageChecked(page);
+
+	unlock_page(page);
+	end_page_writeback(page);
+	return err;
+}
+
 static int do_writepage(struct page *page, int len)
 {
 	int err = 0, i, blen;
@@ -912,27 +950,166 @@ static int do_writepage(struct page *page, int len)
 		addr += blen;
 		len -= blen;
 	}
-	if (err) {
-		SetPageError(page);
-		ubifs_err("cannot write page %lu of inode %lu, error %d",
-			  page->index, inode->i_ino, err);
-		ubifs_ro_mode(c, err);
+	kunmap(page);
+
+	return finish_writepage(page, err);
+}
+
+/*
+ * Asynchronous compression.
+ *
+ * Compressing is the most CPU-expensive part of write-back, and writing to the
+ * flash is the slowest one. So 'ubifs_writepages()' collects up to
+ * %UBIFS_WB_BATCH pages, hands them to the compression workers (spread over
+ * the online CPUs), and then writes the compressed data nodes to the journal
+ * in page order, each page as soon as it has been compressed. This way the
+ * flash is written to while the following pages are being compressed, and
+ * on SMP the pages are compressed in parallel.
+ *
+ * The pages stay locked and under write-back until their data nodes have been
+ * written, exactly like with 'do_writepage()'.
+ */
+
+/**
+ * struct wb_page - a page queued for asynchronous compression.
+ * @work: compression work
+ * @done: completed when the page has been compressed
+ * @page: the page
+ * @len: how many bytes of the page to write
+ * @err: compression error code
+ * @dn: compressed data nodes
+ * @dlen: lengths of the data nodes
+ */
+struct wb_page {
+	struct work_struct work;
+	struct completion done;
+	struct page *page;
+	int len;
+	int err;
+	struct ubifs_data_node *dn[UBIFS_BLOCKS_PER_PAGE];
+	int dlen[UBIFS_BLOCKS_PER_PAGE];
+};
+
+/**
+ * struct wb_batch - pages collected by 'ubifs_writepages()'.
+ * @cnt: count of pages in @pages
+ * @pages: the pages
+ */
+struct wb_batch {
+	int cnt;
+	struct wb_page pages[UBIFS_WB_BATCH];
+};
+
+static void compress_page(struct work_struct *work)
+{
+	struct wb_page *wp = container_of(work, struct wb_page, work);
+	struct inode *inode = wp->page->mapping->host;
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	struct ubifs_data_node *dn;
+	union ubifs_key key;
+	unsigned int block;
+	int i, blen, len = wp->len;
+	void *addr;
+
+	addr = kmap(wp->page);
+	block = wp->page->index << UBIFS_BLOCKS_PER_PAGE_SHIFT;
+	for (i = 0; len && i < UBIFS_BLOCKS_PER_PAGE; i++) {
+		blen = min_t(int, len, UBIFS_BLOCK_SIZE);
+		data_key_init(c, &key, inode->i_ino, block + i);
+		dn = ubifs_prepare_data_node(c, inode, &key, addr, blen,
+					     &wp->dlen[i]);
+		if (IS_ERR(dn)) {
+			wp->err = PTR_ERR(dn);
+			break;
+		}
+		wp->dn[i] = dn;
+		addr += blen;
+		len -= blen;
 	}
+	kunmap(wp->page);
 
-	ubifs_assert(PagePrivate(page));
-	if (PageChecked(page))
-		release_new_page_budget(c);
-	else
-		release_existing_page_budget(c);
+	complete(&wp->done);
+}
 
-	atomic_long_dec(&c->dirty_pg_cnt);
-	ClearPagePrivate(page);
-	ClearPageChecked(page);
+/**
+ * flush_batch - compress and write the collected pages.
+ * @b: the batch
+ *
+ * Returns zero in case of success and a negative error code in case of
+ * failure. All the pages are finished in either case.
+ */
+static int flush_batch(struct wb_batch *b)
+{
+	int n, i, err, ret = 0, cpu;
 
-	kunmap(page);
-	unlock_page(page);
-	end_page_writeback(page);
-	return err;
+	if (!b->cnt)
+		return 0;
+
+	get_online_cpus();
+	cpu = raw_smp_processor_id();
+	for (n = 0; n < b->cnt; n++) {
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		queue_work_on(cpu, ubifs_compr_wq, &b->pages[n].work);
+	}
+	put_online_cpus();
+
+	for (n = 0; n < b->cnt; n++) {
+		struct wb_page *wp = &b->pages[n];
+		struct inode *inode = wp->page->mapping->host;
+		struct ubifs_info *c = inode->i_sb->s_fs_info;
+		union ubifs_key key;
+		unsigned int block;
+
+		wait_for_completion(&wp->done);
+
+		err = wp->err;
+		block = wp->page->index << UBIFS_BLOCKS_PER_PAGE_SHIFT;
+		for (i = 0; i < UBIFS_BLOCKS_PER_PAGE && wp->dn[i]; i++) {
+			if (!err) {
+				data_key_init(c, &key, inode->i_ino, block + i);
+				err = ubifs_jnl_write_data_node(c, &key,
+							wp->dn[i], wp->dlen[i]);
+			}
+			kfree(wp->dn[i]);
+		}
+
+		err = finish_writepage(wp->page, err);
+		if (err && !ret)
+			ret = err;
+	}
+
+	b->cnt = 0;
+	return ret;
+}
+
+/**
+ * queue_writepage - write a page, or add it to a batch.
+ * @page: page to write
+ * @len: how many bytes of the page to write
+ * @b: batch to add the page to, or %NULL to write it right away
+ */
+static int queue_writepage(struct page *page, int len, struct wb_batch *b)
+{
+	struct wb_page *wp;
+
+	if (!b)
+		return do_writepage(page, len);
+
+	/* Update radix tree tags */
+	set_page_writeback(page);
+
+	wp = &b->pages[b->cnt++];
+	memset(wp, 0, sizeof(struct wb_page));
+	INIT_WORK(&wp->work, compress_page);
+	init_completion(&wp->done);
+	wp->page = page;
+	wp->len = len;
+
+	if (b->cnt == UBIFS_WB_BATCH)
+		return flush_batch(b);
+	return 0;
 }
 
 /*
@@ -977,7 +1154,8 @@ static int do_writepage(struct page *page, int len)
  * on the page lock and it would not write the truncated inode node to the
  * journal before we have finished.
  */
-static int ubifs_writepage(struct page *page, struct writeback_control *wbc)
+static int __ubifs_writepage(struct page *page, struct writeback_control *wbc,
+			     struct wb_batch *b)
 {
 	struct inode *inode = page->mapping->host;
 	struct ubifs_inode *ui = ubifs_inode(inode);
@@ -1015,7 +1193,7 @@ static int ubifs_writepage(struct page *page, struct writeback_control *wbc)
 			 * with this.
 			 */
 		}
-		return do_writepage(page, PAGE_CACHE_SIZE);
+		return queue_writepage(page, PAGE_CACHE_SIZE, b);
 	}
 
 	/*
@@ -1036,13 +1214,45 @@ static int ubifs_writepage(struct page *page, struct writeback_control *wbc)
 			goto out_unlock;
 	}
 
-	return do_writepage(page, len);
+	return queue_writepage(page, len, b);
 
 out_unlock:
 	unlock_page(page);
 	return err;
 }
 
+static int ubifs_writepage(struct page *page, struct writeback_control *wbc)
+{
+	return __ubifs_writepage(page, wbc, NULL);
+}
+
+static int batch_writepage(struct page *page, struct writeback_control *wbc,
+			   void *data)
+{
+	return __ubifs_writepage(page, wbc, data);
+}
+
+static int ubifs_writepages(struct address_space *mapping,
+			    struct writeback_control *wbc)
+{
+	struct ubifs_info *c = mapping->host->i_sb->s_fs_info;
+	struct wb_batch *b;
+	int err, err1;
+
+	if (!c->async_compr)
+		return generic_writepages(mapping, wbc);
+
+	b = kmalloc(sizeof(struct wb_batch), GFP_NOFS);
+	if (!b)
+		return generic_writepages(mapping, wbc);
+	b->cnt = 0;
+
+	err = write_cache_pages(mapping, wbc, batch_writepage, b);
+	err1 = flush_batch(b);
+	kfree(b);
+	return err ? err : err1;
+}
+
 /**
  * do_attr_changes - change inode attributes.
  * @inode: inode to change attributes for
@@ -1543,6 +1753,7 @@ static int ubifs_file_mmap(struct file *file, struct vm_area_struct *vma)
 const struct address_space_operations ubifs_file_address_operations = {
 	.readpage       = ubifs_readpage,
 	.writepage      = ubifs_writepage,
+	.writepages     = ubifs_writepages,
 	.write_begin    = ubifs_write_begin,
 	.write_end      = ubifs_write_end,
 	.invalidatepage = ubifs_invalidatepage,
@@ -145,6 +145,52 @@ out_unlock:
 	return err;
 }
 
+/**
+ * setcompr - set the compressor of an inode.
+ * @inode: inode to change
+ * @compr_type: new compressor (%UBIFS_COMPR_NONE, etc)
+ *
+ * Data written from now on uses the new compressor, data which is already on
+ * the flash stays as it is. Returns zero in case of success and a negative
+ * error code in case of failure.
+ */
+static int setcompr(struct inode *inode, int compr_type)
+{
+	int err, release;
+	struct ubifs_inode *ui = ubifs_inode(inode);
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	struct ubifs_budget_req req = { .dirtied_ino = 1,
+					.dirtied_ino_d = ui->data_len };
+
+	if (compr_type < 0 || compr_type >= UBIFS_COMPR_TYPES_CNT ||
+	    !ubifs_compr_present(compr_type))
+		return -EINVAL;
+
+	err = ubifs_budget_space(c, &req);
+	if (err)
+		return err;
+
+	mutex_lock(&ui->ui_mutex);
+	ui->compr_type = compr_type;
+	if (compr_type == UBIFS_COMPR_NONE)
+		ui->flags &= ~UBIFS_COMPR_FL;
+	else
+		ui->flags |= UBIFS_COMPR_FL;
+	spin_lock(&ui->ui_lock);
+	ui->compr_fails = ui->compr_skip = 0;
+	spin_unlock(&ui->ui_lock);
+	inode->i_ctime = ubifs_current_time(inode);
+	release = ui->dirty;
+	mark_inode_dirty_sync(inode);
+	mutex_unlock(&ui->ui_mutex);
+
+	if (release)
+		ubifs_release_budget(c, &req);
+	if (IS_SYNC(inode))
+		err = write_inode_now(inode, 1);
+	return err;
+}
+
 long ubifs_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	int flags, err;
@@ -183,6 +229,33 @@ long ubifs_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		return err;
 	}
 
+	case UBIFS_IOC_GETCOMPR:
+		flags = ubifs_inode(inode)->compr_type;
+		if (!(ubifs_inode(inode)->flags & UBIFS_COMPR_FL))
+			flags = UBIFS_COMPR_NONE;
+		return put_user(flags, (int __user *) arg);
+
+	case UBIFS_IOC_SETCOMPR:
+		if (IS_RDONLY(inode))
+			return -EROFS;
+
+		if (!is_owner_or_cap(inode))
+			return -EACCES;
+
+		if (!S_ISREG(inode->i_mode))
+			return -EINVAL;
+
+		if (get_user(flags, (int __user *) arg))
+			return -EFAULT;
+
+		err = mnt_want_write(file->f_path.mnt);
+		if (err)
+			return err;
+		dbg_gen("set compressor: %d", flags);
+		err = setcompr(inode, flags);
+		mnt_drop_write(file->f_path.mnt);
+		return err;
+
 	default:
 		return -ENOTTY;
 	}
@@ -198,6 +271,9 @@ long ubifs_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case FS_IOC32_SETFLAGS:
 		cmd = FS_IOC_SETFLAGS;
 		break;
+	case UBIFS_IOC_GETCOMPR:
+	case UBIFS_IOC_SETCOMPR:
+		break;
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -672,32 +672,36 @@ out_ro:
 }
 
 /**
- * ubifs_jnl_write_data - write a data node to the journal.
+ * ubifs_prepare_data_node - build and compress a data node.
  * @c: UBIFS file-system description object
  * @inode: inode the data node belongs to
  * @key: node key
- * @buf: buffer to write
+ * @buf: data to put to the node
  * @len: data length (must not exceed %UBIFS_BLOCK_SIZE)
+ * @dlen: length of the resulting node is returned here
  *
- * This function writes a data node to the journal. Returns %0 if the data node
- * was successfully written, and a negative error code in case of failure.
+ * This function allocates a data node, compresses @buf into it using the
+ * compressor of @inode, and returns the node. It does not touch the journal,
+ * so it may be called from any context which may sleep, e.g., from the
+ * compression workers. Returns an error code in an error pointer in case of
+ * failure.
  */
-int ubifs_jnl_write_data(struct ubifs_info *c, const struct inode *inode,
-			 const union ubifs_key *key, const void *buf, int len)
+struct ubifs_data_node *ubifs_prepare_data_node(struct ubifs_info *c,
+						struct inode *inode,
+						const union ubifs_key *key,
+						const void *buf, int len,
+						int *dlen)
 {
 	struct ubifs_data_node *data;
-	int err, lnum, offs, compr_type, out_len;
-	int dlen = UBIFS_DATA_NODE_SZ + UBIFS_BLOCK_SIZE * WORST_COMPR_FACTOR;
+	int compr_type, out_len, trial = 0;
+	int sz = UBIFS_DATA_NODE_SZ + UBIFS_BLOCK_SIZE * WORST_COMPR_FACTOR;
 	struct ubifs_inode *ui = ubifs_inode(inode);
 
-	dbg_jnl("ino %lu, blk %u, len %d, key %s",
-		(unsigned long)key_inum(c, key), key_block(c, key), len,
-		DBGKEY(key));
 	ubifs_assert(len <= UBIFS_BLOCK_SIZE);
 
-	data = kmalloc(dlen, GFP_NOFS);
+	data = kmalloc(sz, GFP_NOFS);
 	if (!data)
-		return -ENOMEM;
+		return ERR_PTR(-ENOMEM);
 
 	data->ch.node_type = UBIFS_DATA_NODE;
 	key_write(c, key, &data->key);
@@ -707,20 +711,70 @@ int ubifs_jnl_write_data(struct ubifs_info *c, const struct inode *inode,
 	if (!(ui->flags & UBIFS_COMPR_FL))
 		/* Compression is disabled for this inode */
 		compr_type = UBIFS_COMPR_NONE;
-	else
+	else if (c->adaptive_compr && ui->compr_skip) {
+		/* Recent blocks of this inode did not compress */
+		spin_lock(&ui->ui_lock);
+		if (ui->compr_skip)
+			ui->compr_skip -= 1;
+		spin_unlock(&ui->ui_lock);
+		compr_type = UBIFS_COMPR_NONE;
+	} else {
 		compr_type = ui->compr_type;
+		/* Only blocks which are really compressed count as trials */
+		trial = c->adaptive_compr && len >= UBIFS_MIN_COMPR_LEN &&
+			compr_type != UBIFS_COMPR_NONE;
+	}
 
-	out_len = dlen - UBIFS_DATA_NODE_SZ;
+	out_len = sz - UBIFS_DATA_NODE_SZ;
 	ubifs_compress(buf, len, &data->data, &out_len, &compr_type);
 	ubifs_assert(out_len <= UBIFS_BLOCK_SIZE);
 
-	dlen = UBIFS_DATA_NODE_SZ + out_len;
+	if (trial) {
+		/*
+		 * Count the blocks which did not compress in a row, and once
+		 * there are enough of them, store the next ones uncompressed
+		 * before trying again.
+		 */
+		spin_lock(&ui->ui_lock);
+		if (compr_type != UBIFS_COMPR_NONE)
+			ui->compr_fails = 0;
+		else if (!ui->compr_skip &&
+			 ++ui->compr_fails >= UBIFS_COMPR_TRIAL_BLOCKS) {
+			ui->compr_fails = 0;
+			ui->compr_skip = UBIFS_COMPR_SKIP_BLOCKS;
+		}
+		spin_unlock(&ui->ui_lock);
+	}
+
+	*dlen = UBIFS_DATA_NODE_SZ + out_len;
 	data->compr_type = cpu_to_le16(compr_type);
+	return data;
+}
+
+/**
+ * ubifs_jnl_write_data_node - write a prepared data node to the journal.
+ * @c: UBIFS file-system description object
+ * @key: node key
+ * @data: data node prepared by 'ubifs_prepare_data_node()'
+ * @dlen: data node length
+ *
+ * This function writes a data node to the journal. The node is not freed.
+ * Returns %0 if the data node was successfully written, and a negative error
+ * code in case of failure.
+ */
+int ubifs_jnl_write_data_node(struct ubifs_info *c, const union ubifs_key *key,
+			      struct ubifs_data_node *data, int dlen)
+{
+	int err, lnum, offs;
+
+	dbg_jnl("ino %lu, blk %u, dlen %d, key %s",
+		(unsigned long)key_inum(c, key), key_block(c, key), dlen,
+		DBGKEY(key));
 
 	/* Make reservation before allocating sequence numbers */
 	err = make_reservation(c, DATAHD, dlen);
 	if (err)
-		goto out_free;
+		return err;
 
 	err = write_node(c, DATAHD, data, dlen, &lnum, &offs);
 	if (err)
@@ -733,7 +787,6 @@ int ubifs_jnl_write_data(struct ubifs_info *c, const struct inode *inode,
 		goto out_ro;
 
 	finish_reservation(c);
-	kfree(data);
 	return 0;
 
 out_release:
@@ -741,7 +794,33 @@ out_release:
 out_ro:
 	ubifs_ro_mode(c, err);
 	finish_reservation(c);
-out_free:
+	return err;
+}
+
+/**
+ * ubifs_jnl_write_data - write a data node to the journal.
+ * @c: UBIFS file-system description object
+ * @inode: inode the data node belongs to
+ * @key: node key
+ * @buf: buffer to write
+ * @len: data length (must not exceed %UBIFS_BLOCK_SIZE)
+ *
+ * This function compresses and writes a data node to the journal. Returns %0
+ * if the data node was successfully written, and a negative error code in
+ * case of failure.
+ */
+int ubifs_jnl_write_data(struct ubifs_info *c, const struct inode *inode,
+			 const union ubifs_key *key, const void *buf, int len)
+{
+	struct ubifs_data_node *data;
+	int err, dlen;
+
+	data = ubifs_prepare_data_node(c, (struct inode *)inode, key, buf, len,
+				       &dlen);
+	if (IS_ERR(data))
+		return PTR_ERR(data);
+
+	err = ubifs_jnl_write_data_node(c, key, data, dlen);
 	kfree(data);
 	return err;
 }
@@ -425,6 +425,16 @@ static int ubifs_show_options(struct seq_file *s, struct vfsmount *mnt)
 		seq_printf(s, ubifs_compr_name(c->mount_opts.compr_type));
 	}
 
+	if (c->mount_opts.adaptive_compr == 2)
+		seq_printf(s, ",adaptive_compr");
+	else if (c->mount_opts.adaptive_compr == 1)
+		seq_printf(s, ",no_adaptive_compr");
+
+	if (c->mount_opts.async_compr == 2)
+		seq_printf(s, ",async_compr");
+	else if (c->mount_opts.async_compr == 1)
+		seq_printf(s, ",no_async_compr");
+
 	return 0;
 }
 
@@ -907,6 +917,10 @@ static int check_volume_empty(struct ubifs_info *c)
  * Opt_chk_data_crc: check CRCs when reading data nodes
  * Opt_no_chk_data_crc: do not check CRCs when reading data nodes
  * Opt_override_compr: override default compressor
+ * Opt_adaptive_compr: store data uncompressed after it does not compress
+ * Opt_no_adaptive_compr: always try to compress data
+ * Opt_async_compr: compress data in the compression workers at write-back
+ * Opt_no_async_compr: compress data in the write-back thread
  * Opt_err: just end of array marker
  */
 enum {
@@ -917,6 +931,10 @@ enum {
 	Opt_chk_data_crc,
 	Opt_no_chk_data_crc,
 	Opt_override_compr,
+	Opt_adaptive_compr,
+	Opt_no_adaptive_compr,
+	Opt_async_compr,
+	Opt_no_async_compr,
 	Opt_err,
 };
 
@@ -928,6 +946,10 @@ static const match_table_t tokens = {
 	{Opt_chk_data_crc, "chk_data_crc"},
 	{Opt_no_chk_data_crc, "no_chk_data_crc"},
 	{Opt_override_compr, "compr=%s"},
+	{Opt_adaptive_compr, "adaptive_compr"},
+	{Opt_no_adaptive_compr, "no_adaptive_compr"},
+	{Opt_async_compr, "async_compr"},
+	{Opt_no_async_compr, "no_async_compr"},
 	{Opt_err, NULL},
 };
 
@@ -1006,6 +1028,22 @@ static int ubifs_parse_options(struct ubifs_info *c, char *options,
 			c->default_compr = c->mount_opts.compr_type;
 			break;
 		}
+		case Opt_adaptive_compr:
+			c->mount_opts.adaptive_compr = 2;
+			c->adaptive_compr = 1;
+			break;
+		case Opt_no_adaptive_compr:
+			c->mount_opts.adaptive_compr = 1;
+			c->adaptive_compr = 0;
+			break;
+		case Opt_async_compr:
+			c->mount_opts.async_compr = 2;
+			c->async_compr = 1;
+			break;
+		case Opt_no_async_compr:
+			c->mount_opts.async_compr = 1;
+			c->async_compr = 0;
+			break;
 		default:
 			ubifs_err("unrecognized mount option \"%s\" "
 				  "or missing value", p);
@@ -1912,6 +1950,7 @@ static int ubifs_fill_super(struct super_block *sb, void *data, int silent)
 	if (err)
 		goto out_close;
 
+	c->async_compr = 1;
 	err = ubifs_parse_options(c, data, 0);
 	if (err)
 		goto out_bdi;
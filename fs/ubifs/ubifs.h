@@ -35,6 +35,7 @@
 #include <linux/mtd/ubi.h>
 #include <linux/pagemap.h>
 #include <linux/backing-dev.h>
+#include <mtd/ubifs-user.h>
 #include "ubifs-media.h"
 
 /* Version of this UBIFS implementation */
@@ -147,6 +148,17 @@
  */
 #define WORST_COMPR_FACTOR 2
 
+/*
+ * Adaptive compression: after %UBIFS_COMPR_TRIAL_BLOCKS blocks of an inode in
+ * a row did not compress, the next %UBIFS_COMPR_SKIP_BLOCKS blocks are stored
+ * uncompressed without trying.
+ */
+#define UBIFS_COMPR_TRIAL_BLOCKS 8
+#define UBIFS_COMPR_SKIP_BLOCKS 256
+
+/* Maximum number of pages compressed at once by 'ubifs_writepages()' */
+#define UBIFS_WB_BATCH 16
+
 /* Maximum expected tree height for use by bottom_up_buf */
 #define BOTTOM_UP_HEIGHT 64
 
@@ -350,6 +362,10 @@ struct ubifs_gced_idx_leb {
  * @ui_size: inode size used by UBIFS when writing to flash
  * @flags: inode flags (@UBIFS_COMPR_FL, etc)
  * @compr_type: default compression type used for this inode
+ * @compr_fails: count of blocks in a row which did not compress (adaptive
+ *               compression)
+ * @compr_skip: count of following blocks to store uncompressed without
+ *              trying (adaptive compression)
  * @last_page_read: page number of last page read (for bulk read)
  * @read_in_a_row: number of consecutive pages read in a row (for bulk read)
  * @data_len: length of the data attached to the inode
@@ -400,6 +416,8 @@ struct ubifs_inode {
 	loff_t synced_i_size;
 	loff_t ui_size;
 	int flags;
+	int compr_fails;
+	int compr_skip;
 	pgoff_t last_page_read;
 	pgoff_t read_in_a_row;
 	int data_len;
@@ -911,6 +929,10 @@ struct ubifs_orphan {
  *                  specified in @compr_type)
  * @compr_type: compressor type to override the superblock compressor with
  *              (%UBIFS_COMPR_NONE, etc)
+ * @adaptive_compr: enable/disable adaptive compression (%0 default,
+ *                  %1 disable, %2 enable)
+ * @async_compr: enable/disable asynchronous compression (%0 default,
+ *               %1 disable, %2 enable)
  */
 struct ubifs_mount_opts {
 	unsigned int unmount_mode:2;
@@ -918,6 +940,8 @@ struct ubifs_mount_opts {
 	unsigned int chk_data_crc:2;
 	unsigned int override_compr:1;
 	unsigned int compr_type:2;
+	unsigned int adaptive_compr:2;
+	unsigned int async_compr:2;
 };
 
 struct ubifs_debug_info;
@@ -965,6 +989,9 @@ struct ubifs_debug_info;
  * @no_chk_data_crc: do not check CRCs when reading data nodes (except during
  *                   recovery)
  * @bulk_read: enable bulk-reads
+ * @adaptive_compr: store data uncompressed for a while after several blocks
+ *                  of an inode did not compress
+ * @async_compr: compress data nodes in the compression workers at write-back
  * @default_compr: default compression algorithm (%UBIFS_COMPR_LZO, etc)
  *
  * @tnc_mutex: protects the Tree Node Cache (TNC), @zroot, @cnext, @enext, and
@@ -1204,6 +1231,8 @@ struct ubifs_info {
 	unsigned int big_lpt:1;
 	unsigned int no_chk_data_crc:1;
 	unsigned int bulk_read:1;
+	unsigned int adaptive_compr:1;
+	unsigned int async_compr:1;
 	unsigned int default_compr:2;
 
 	struct mutex tnc_mutex;
@@ -1412,6 +1441,7 @@ extern const struct inode_operations ubifs_dir_inode_operations;
 extern const struct inode_operations ubifs_symlink_inode_operations;
 extern struct backing_dev_info ubifs_backing_dev_info;
 extern struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
+extern struct workqueue_struct *ubifs_compr_wq;
 
 /* io.c */
 void ubifs_ro_mode(struct ubifs_info *c, int err);
@@ -1466,6 +1496,13 @@ int ubifs_consolidate_log(struct ubifs_info *c);
 int ubifs_jnl_update(struct ubifs_info *c, const struct inode *dir,
 		     const struct qstr *nm, const struct inode *inode,
 		     int deletion, int xent);
+struct ubifs_data_node *ubifs_prepare_data_node(struct ubifs_info *c,
+						struct inode *inode,
+						const union ubifs_key *key,
+						const void *buf, int len,
+						int *dlen);
+int ubifs_jnl_write_data_node(struct ubifs_info *c, const union ubifs_key *key,
+			      struct ubifs_data_node *data, int dlen);
 int ubifs_jnl_write_data(struct ubifs_info *c, const struct inode *inode,
 			 const union ubifs_key *key, const void *buf, int len);
 int ubifs_jnl_write_inode(struct ubifs_info *c, const struct inode *inode);
@@ -51,6 +51,10 @@ extern const char *yaffs_guts_c_version;
 #include <linux/interrupt.h>
 #include <linux/string.h>
 #include <linux/ctype.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/mutex.h>
+#include <linux/mm.h>
 
 #include "asm/div64.h"
 
@@ -121,16 +125,19 @@ static uint32_t YCALCBLOCKS(uint64_t partition_size, uint32_t block_size)
 unsigned int yaffs_traceMask = YAFFS_TRACE_BAD_BLOCKS;
 unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
+unsigned int yaffs_bg_gc = 1;
 
 /* Module Parameters */
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 5, 0))
 module_param(yaffs_traceMask, uint, 0644);
 module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
+module_param(yaffs_bg_gc, uint, 0644);
 #else
 MODULE_PARM(yaffs_traceMask, "i");
 MODULE_PARM(yaffs_wr_attempts, "i");
 MODULE_PARM(yaffs_auto_checkpoint, "i");
+MODULE_PARM(yaffs_bg_gc, "i");
 #endif
 
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 25))
@@ -369,6 +376,7 @@ static void yaffs_GrossLock(yaffs_Device *dev)
 {
 	T(YAFFS_TRACE_OS, ("yaffs locking %p\n", current));
 	down(&dev->grossLock);
+	dev->lastActivity = jiffies;
 	T(YAFFS_TRACE_OS, ("yaffs locked %p\n", current));
 }
 
@@ -1845,6 +1853,78 @@ static void yaffs_read_inode(struct inode *inode)
 
 static YLIST_HEAD(yaffs_dev_list);
 
+/* The shrinker can't take lock_kernel(), so it walks yaffs_dev_list under
+ * this instead. Mount and umount take both.
+ */
+static DEFINE_MUTEX(yaffs_dev_list_lock);
+
+/* Background garbage collection.
+ * Once the device has been idle for YAFFS_BG_GC_IDLE the thread collects a
+ * block at a time, as long as there's something worth collecting and
+ * nobody else wants the device.
+ * There's no remount_fs, so a mount can change between read-only and
+ * read-write under the thread. It is always started and checks the flag
+ * each time round instead.
+ */
+#define YAFFS_BG_GC_IDLE	(HZ / 2)
+#define YAFFS_BG_GC_INTERVAL	HZ
+
+static int yaffs_BackgroundThread(void *data)
+{
+	struct super_block *sb = (struct super_block *)data;
+	yaffs_Device *dev = yaffs_SuperToDevice(sb);
+	unsigned long interval;
+
+	T(YAFFS_TRACE_BACKGROUND, ("yaffs_background starting for %p\n", dev));
+
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		interval = YAFFS_BG_GC_INTERVAL;
+
+		if (yaffs_bg_gc && !(sb->s_flags & MS_RDONLY) &&
+		    time_after(jiffies, dev->lastActivity + YAFFS_BG_GC_IDLE) &&
+		    !down_trylock(&dev->grossLock)) {
+			/* If we got a block keep going, it'll stop as soon
+			 * as there's nothing left to do or the fs gets used.
+			 */
+			if (yaffs_BackgroundGarbageCollect(dev) == YAFFS_OK)
+				interval = 1;
+			up(&dev->grossLock);
+		}
+
+		try_to_freeze();
+		schedule_timeout_interruptible(interval);
+	}
+
+	T(YAFFS_TRACE_BACKGROUND, ("yaffs_background stopping for %p\n", dev));
+
+	return 0;
+}
+
+static void yaffs_StartBackgroundThread(yaffs_Device *dev,
+					struct super_block *sb)
+{
+	struct task_struct *tsk;
+
+	tsk = kthread_run(yaffs_BackgroundThread, sb, "yaffs-bg-%s", sb->s_id);
+	if (IS_ERR(tsk)) {
+		T(YAFFS_TRACE_ALWAYS,
+		  ("yaffs: could not start background gc thread\n"));
+		return;
+	}
+
+	dev->bgThread = tsk;
+}
+
+static void yaffs_StopBackgroundThread(yaffs_Device *dev)
+{
+	if (dev->bgThread) {
+		kthread_stop(dev->bgThread);
+		dev->bgThread = NULL;
+	}
+}
+
 #if 0 /* not used */
 static int yaffs_remount_fs(struct super_block *sb, int *flags, char *data)
 {
@@ -1881,6 +1961,8 @@ static void yaffs_put_super(struct super_block *sb)
 
 	T(YAFFS_TRACE_OS, ("yaffs_put_super\n"));
 
+	yaffs_StopBackgroundThread(dev);
+
 	yaffs_GrossLock(dev);
 
 	yaffs_FlushEntireDeviceCache(dev);
@@ -1895,7 +1977,9 @@ static void yaffs_put_super(struct super_block *sb)
 	yaffs_GrossUnlock(dev);
 
 	/* we assume this is protected by lock_kernel() in mount/umount */
+	mutex_lock(&yaffs_dev_list_lock);
 	ylist_del(&dev->devList);
+	mutex_unlock(&yaffs_dev_list_lock);
 
 	if (dev->spareBuffer) {
 		YFREE(dev->spareBuffer);
@@ -2198,6 +2282,7 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 		    nandmtd2_ReadChunkWithTagsFromNAND;
 		dev->markNANDBlockBad = nandmtd2_MarkNANDBlockBad;
 		dev->queryNANDBlock = nandmtd2_QueryNANDBlock;
+		dev->readBlockTagsFromNAND = nandmtd2_ReadBlockTagsFromNAND;
 		dev->spareBuffer = YMALLOC(mtd->oobsize);
 		dev->isYaffs2 = 1;
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 17))
@@ -2248,7 +2333,9 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	dev->skipCheckpointWrite = options.skip_checkpoint_write;
 
 	/* we assume this is protected by lock_kernel() in mount/umount */
+	mutex_lock(&yaffs_dev_list_lock);
 	ylist_add_tail(&dev->devList, &yaffs_dev_list);
+	mutex_unlock(&yaffs_dev_list_lock);
 
         /* Directory search handling...*/
         YINIT_LIST_HEAD(&dev->searchContexts);
@@ -2290,6 +2377,8 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	}
 	sb->s_root = root;
 	sb->s_dirt = !dev->isCheckpointed;
+
+	yaffs_StartBackgroundThread(dev, sb);
 	T(YAFFS_TRACE_ALWAYS,
 	  ("yaffs_read_super: isCheckpointed %d\n", dev->isCheckpointed));
 
@@ -2394,6 +2483,23 @@ static DECLARE_FSTYPE(yaffs2_fs_type, "yaffs2", yaffs2_read_super,
 
 static struct proc_dir_entry *my_proc_entry;
 
+/* Write amplification: all chunks written over those written on behalf of
+ * the user, the rest being gc copies. Shown as a fixed point x.yy.
+ */
+static int yaffs_dump_write_amplification(char *buf, yaffs_Device *dev)
+{
+	unsigned userWrites = dev->nPageWrites - dev->nGCCopies;
+	unsigned wa = 100;
+	__u64 total = (__u64)dev->nPageWrites * 100;
+
+	if (userWrites > 0) {
+		do_div(total, userWrites);
+		wa = (unsigned)total;
+	}
+
+	return sprintf(buf, "writeAmplification %u.%02u\n", wa / 100, wa % 100);
+}
+
 static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 {
 	buf += sprintf(buf, "startBlock......... %d\n", dev->startBlock);
@@ -2409,6 +2515,10 @@ static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 	buf += sprintf(buf, "nFreeTnodes........ %d\n", dev->nFreeTnodes);
 	buf += sprintf(buf, "nObjectsCreated.... %d\n", dev->nObjectsCreated);
 	buf += sprintf(buf, "nFreeObjects....... %d\n", dev->nFreeObjects);
+	buf += sprintf(buf, "tnodeMemory........ %d\n", yaffs_TnodeMemory(dev));
+	buf += sprintf(buf, "nTnodesReleased.... %d\n", dev->nTnodesReleased);
+	buf += sprintf(buf, "objectMemory....... %d\n", yaffs_ObjectMemory(dev));
+	buf += sprintf(buf, "nObjectBuckets..... %d\n", dev->nObjectBuckets);
 	buf += sprintf(buf, "nFreeChunks........ %d\n", dev->nFreeChunks);
 	buf += sprintf(buf, "nPageWrites........ %d\n", dev->nPageWrites);
 	buf += sprintf(buf, "nPageReads......... %d\n", dev->nPageReads);
@@ -2417,6 +2527,13 @@ static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 	buf += sprintf(buf, "garbageCollections. %d\n", dev->garbageCollections);
 	buf += sprintf(buf, "passiveGCs......... %d\n",
 		    dev->passiveGarbageCollections);
+	buf += sprintf(buf, "backgroundGCs...... %d\n",
+		    dev->backgroundGarbageCollections);
+	buf += sprintf(buf, "gcTimeMs........... %u\n",
+		    jiffies_to_msecs(dev->gcTime));
+	buf += sprintf(buf, "backgroundGcTimeMs. %u\n",
+		    jiffies_to_msecs(dev->backgroundGcTime));
+	buf += yaffs_dump_write_amplification(buf, dev);
 	buf += sprintf(buf, "nRetriedWrites..... %d\n", dev->nRetriedWrites);
 	buf += sprintf(buf, "nShortOpCaches..... %d\n", dev->nShortOpCaches);
 	buf += sprintf(buf, "nRetireBlocks...... %d\n", dev->nRetiredBlocks);
@@ -2491,6 +2608,7 @@ static struct {
 } mask_flags[] = {
 	{"allocate", YAFFS_TRACE_ALLOCATE},
 	{"always", YAFFS_TRACE_ALWAYS},
+	{"background", YAFFS_TRACE_BACKGROUND},
 	{"bad_blocks", YAFFS_TRACE_BAD_BLOCKS},
 	{"buffers", YAFFS_TRACE_BUFFERS},
 	{"bug", YAFFS_TRACE_BUG},
@@ -2617,6 +2735,38 @@ struct file_system_to_install {
 	int installed;
 };
 
+/* Give unused tnode memory back under memory pressure.
+ * Devices that are busy are skipped rather than waited for.
+ */
+static int yaffs_shrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	struct ylist_head *item;
+	yaffs_Device *dev;
+	int nFree = 0;
+
+	if (nr_to_scan && !(gfp_mask & __GFP_FS))
+		return -1;
+
+	mutex_lock(&yaffs_dev_list_lock);
+	ylist_for_each(item, &yaffs_dev_list) {
+		dev = ylist_entry(item, yaffs_Device, devList);
+		if (nr_to_scan && nFree < nr_to_scan &&
+		    !down_trylock(&dev->grossLock)) {
+			yaffs_ShrinkTnodes(dev);
+			up(&dev->grossLock);
+		}
+		nFree += dev->nFreeTnodes;
+	}
+	mutex_unlock(&yaffs_dev_list_lock);
+
+	return nFree;
+}
+
+static struct shrinker yaffs_shrinker = {
+	.shrink = yaffs_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
 static struct file_system_to_install fs_to_install[] = {
 	{&yaffs_fs_type, 0},
 	{&yaffs2_fs_type, 0},
@@ -2665,7 +2815,8 @@ static int __init init_yaffs_fs(void)
 			}
 			fsinst++;
 		}
-	}
+	} else
+		register_shrinker(&yaffs_shrinker);
 
 	return error;
 }
@@ -2678,6 +2829,8 @@ static void __exit exit_yaffs_fs(void)
 	T(YAFFS_TRACE_ALWAYS, ("yaffs " __DATE__ " " __TIME__
 			       " removing. \n"));
 
+	unregister_shrinker(&yaffs_shrinker);
+
 	remove_proc_entry("yaffs", YPROC_ROOT);
 
 	fsinst = fs_to_install;
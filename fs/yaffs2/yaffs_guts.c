@@ -22,9 +22,7 @@ const char *yaffs_guts_c_version =
 #include "yaffs_getblockinfo.h"
 
 #include "yaffs_tagscompat.h"
-#ifndef CONFIG_YAFFS_USE_OWN_SORT
 #include "yaffs_qsort.h"
-#endif
 #include "yaffs_nand.h"
 
 #include "yaffs_checkptrw.h"
@@ -35,6 +33,13 @@ const char *yaffs_guts_c_version =
 
 #define YAFFS_PASSIVE_GC_CHUNKS 2
 
+/* Background gc tries to keep this many erased blocks (1/32 of the device,
+ * but at least YAFFS_BG_GC_MIN_SPARE) on top of the reserve so that writes
+ * don't have to do aggressive gc.
+ */
+#define YAFFS_BG_GC_SPARE_SHIFT	5
+#define YAFFS_BG_GC_MIN_SPARE	8
+
 #include "yaffs_ecc.h"
 
 
@@ -841,7 +846,7 @@ static void yaffs_VerifyObjects(yaffs_Device *dev)
 
 	/* Iterate through the objects in each hash entry */
 
-	for (i = 0; i <  YAFFS_NOBJECT_BUCKETS; i++) {
+	for (i = 0; i <  dev->nObjectBuckets; i++) {
 		ylist_for_each(lh, &dev->objectBucket[i].list) {
 			if (lh) {
 				obj = ylist_entry(lh, yaffs_Object, hashLink);
@@ -856,10 +861,10 @@ static void yaffs_VerifyObjects(yaffs_Device *dev)
  *  Simple hash function. Needs to have a reasonable spread
  */
 
-static Y_INLINE int yaffs_HashFunction(int n)
+static Y_INLINE int yaffs_HashFunction(yaffs_Device *dev, int n)
 {
 	n = abs(n);
-	return n % YAFFS_NOBJECT_BUCKETS;
+	return n & (dev->nObjectBuckets - 1);
 }
 
 /*
@@ -1226,6 +1231,7 @@ static int yaffs_CreateTnodes(yaffs_Device *dev, int nTnodes)
 		   return YAFFS_FAIL;
 	} else {
 		tnl->tnodes = newTnodes;
+		tnl->nTnodes = nTnodes;
 		tnl->next = dev->allocatedTnodeList;
 		dev->allocatedTnodeList = tnl;
 	}
@@ -1322,6 +1328,137 @@ static void yaffs_InitialiseTnodes(yaffs_Device *dev)
 	dev->nTnodesCreated = 0;
 }
 
+static int yaffs_TnodeListCompare(const void *a, const void *b)
+{
+	const __u8 *x = (const __u8 *)(*(yaffs_TnodeList **)a)->tnodes;
+	const __u8 *y = (const __u8 *)(*(yaffs_TnodeList **)b)->tnodes;
+
+	if (x < y)
+		return -1;
+	return (x > y) ? 1 : 0;
+}
+
+/* Find the allocation a tnode came from, index is sorted by address */
+static yaffs_TnodeList *yaffs_FindTnodeList(yaffs_TnodeList **index, int n,
+					yaffs_Tnode *tn, int tnodeSize)
+{
+	const __u8 *addr = (const __u8 *)tn;
+	const __u8 *start;
+	int lo = 0;
+	int hi = n - 1;
+	int mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		start = (const __u8 *)index[mid]->tnodes;
+		if (addr < start)
+			hi = mid - 1;
+		else if (addr >= start + index[mid]->nTnodes * tnodeSize)
+			lo = mid + 1;
+		else
+			return index[mid];
+	}
+
+	return NULL;
+}
+
+/* yaffs_ShrinkTnodes gives back to the system every tnode allocation whose
+ * tnodes are all on the free list. Tnodes are otherwise never freed, so
+ * after deleting or truncating big files a device can sit on a lot of
+ * unused memory.
+ * Returns the number of tnodes released.
+ */
+int yaffs_ShrinkTnodes(yaffs_Device *dev)
+{
+	yaffs_TnodeList **index;
+	yaffs_TnodeList **prev;
+	yaffs_TnodeList *tnl;
+	yaffs_Tnode **link;
+	yaffs_Tnode *tn;
+	int tnodeSize;
+	int nLists = 0;
+	int released = 0;
+	int i;
+
+	if (dev->nFreeTnodes < YAFFS_ALLOCATION_NTNODES)
+		return 0;
+
+	tnodeSize = (dev->tnodeWidth * YAFFS_NTNODES_LEVEL0)/8;
+	if (tnodeSize < sizeof(yaffs_Tnode))
+		tnodeSize = sizeof(yaffs_Tnode);
+
+	for (tnl = dev->allocatedTnodeList; tnl; tnl = tnl->next) {
+		tnl->nFree = 0;
+		nLists++;
+	}
+
+	index = YMALLOC(nLists * sizeof(yaffs_TnodeList *));
+	if (!index)
+		return 0;
+
+	for (i = 0, tnl = dev->allocatedTnodeList; tnl; tnl = tnl->next)
+		index[i++] = tnl;
+	yaffs_qsort(index, nLists, sizeof(yaffs_TnodeList *),
+		    yaffs_TnodeListCompare);
+
+	/* Count how many of each allocation's tnodes are free */
+	for (tn = dev->freeTnodes; tn; tn = tn->internal[0]) {
+		tnl = yaffs_FindTnodeList(index, nLists, tn, tnodeSize);
+		if (tnl)
+			tnl->nFree++;
+	}
+
+	/* Take the tnodes of wholly free allocations off the free list... */
+	link = &dev->freeTnodes;
+	while ((tn = *link) != NULL) {
+		tnl = yaffs_FindTnodeList(index, nLists, tn, tnodeSize);
+		if (tnl && tnl->nFree == tnl->nTnodes)
+			*link = tn->internal[0];
+		else
+			link = &tn->internal[0];
+	}
+
+	YFREE(index);
+
+	/* ... and free them */
+	prev = &dev->allocatedTnodeList;
+	while ((tnl = *prev) != NULL) {
+		if (tnl->nFree == tnl->nTnodes) {
+			*prev = tnl->next;
+			released += tnl->nTnodes;
+			YFREE(tnl->tnodes);
+			YFREE(tnl);
+		} else
+			prev = &tnl->next;
+	}
+
+	dev->nFreeTnodes -= released;
+	dev->nTnodesCreated -= released;
+	dev->nTnodesReleased += released;
+
+	T(YAFFS_TRACE_ALLOCATE,
+	  (TSTR("yaffs: released %d tnodes" TENDSTR), released));
+
+	return released;
+}
+
+/* Memory held by tnodes and by objects (including the object hash) */
+int yaffs_TnodeMemory(yaffs_Device *dev)
+{
+	int tnodeSize = (dev->tnodeWidth * YAFFS_NTNODES_LEVEL0)/8;
+
+	if (tnodeSize < sizeof(yaffs_Tnode))
+		tnodeSize = sizeof(yaffs_Tnode);
+
+	return dev->nTnodesCreated * tnodeSize;
+}
+
+int yaffs_ObjectMemory(yaffs_Device *dev)
+{
+	return dev->nObjectsCreated * sizeof(yaffs_Object) +
+		dev->nObjectBuckets * sizeof(yaffs_ObjectBucket);
+}
+
 
 void yaffs_PutLevel0Tnode(yaffs_Device *dev, yaffs_Tnode *tn, unsigned pos,
 		unsigned val)
@@ -1973,8 +2110,9 @@ static void yaffs_UnhashObject(yaffs_Object *tn)
 	/* If it is still linked into the bucket list, free from the list */
 	if (!ylist_empty(&tn->hashLink)) {
 		ylist_del_init(&tn->hashLink);
-		bucket = yaffs_HashFunction(tn->objectId);
+		bucket = yaffs_HashFunction(dev, tn->objectId);
 		dev->objectBucket[bucket].count--;
+		dev->nHashedObjects--;
 	}
 }
 
@@ -2026,6 +2164,87 @@ void yaffs_HandleDeferedFree(yaffs_Object *obj)
 
 #endif
 
+/* The YMALLOC_ALT fallback may recurse into the fs through reclaim, so
+ * it is only used at mount time (allowAlt), never with the gross lock
+ * held.
+ */
+static yaffs_ObjectBucket *yaffs_AllocateObjectBuckets(int nBuckets,
+							int allowAlt, int *alt)
+{
+	yaffs_ObjectBucket *buckets;
+	int i;
+
+	*alt = 0;
+	buckets = YMALLOC(nBuckets * sizeof(yaffs_ObjectBucket));
+	if (!buckets && allowAlt) {
+		buckets = YMALLOC_ALT(nBuckets * sizeof(yaffs_ObjectBucket));
+		*alt = 1;
+	}
+
+	if (buckets) {
+		for (i = 0; i < nBuckets; i++) {
+			YINIT_LIST_HEAD(&buckets[i].list);
+			buckets[i].count = 0;
+		}
+	}
+
+	return buckets;
+}
+
+static void yaffs_FreeObjectBuckets(yaffs_ObjectBucket *buckets, int alt)
+{
+	if (alt)
+		YFREE_ALT(buckets);
+	else
+		YFREE(buckets);
+}
+
+/* Double the size of the object hash once the chains get long, so that
+ * lookups stay cheap on devices with many files.
+ * If we can't get the memory we just carry on with longer chains.
+ */
+static void yaffs_GrowObjectHash(yaffs_Device *dev)
+{
+	yaffs_ObjectBucket *oldBuckets = dev->objectBucket;
+	int oldAlt = dev->objectBucketAlt;
+	int nOld = dev->nObjectBuckets;
+	yaffs_ObjectBucket *newBuckets;
+	yaffs_Object *obj;
+	struct ylist_head *lh;
+	struct ylist_head *n;
+	int newAlt;
+	int bucket;
+	int i;
+
+	if (dev->nHashedObjects <= nOld * YAFFS_OBJECT_HASH_LOAD ||
+	    nOld >= YAFFS_MAX_OBJECT_BUCKETS)
+		return;
+
+	newBuckets = yaffs_AllocateObjectBuckets(nOld * 2, 0, &newAlt);
+	if (!newBuckets)
+		return;
+
+	dev->objectBucket = newBuckets;
+	dev->objectBucketAlt = newAlt;
+	dev->nObjectBuckets = nOld * 2;
+
+	for (i = 0; i < nOld; i++) {
+		ylist_for_each_safe(lh, n, &oldBuckets[i].list) {
+			obj = ylist_entry(lh, yaffs_Object, hashLink);
+			bucket = yaffs_HashFunction(dev, obj->objectId);
+			ylist_del(lh);
+			ylist_add(lh, &newBuckets[bucket].list);
+			newBuckets[bucket].count++;
+		}
+	}
+
+	yaffs_FreeObjectBuckets(oldBuckets, oldAlt);
+
+	T(YAFFS_TRACE_ALLOCATE,
+	  (TSTR("yaffs: object hash grown to %d buckets for %d objects"
+		TENDSTR), dev->nObjectBuckets, dev->nHashedObjects));
+}
+
 static void yaffs_DeinitialiseObjects(yaffs_Device *dev)
 {
 	/* Free the list of allocated Objects */
@@ -2042,20 +2261,27 @@ static void yaffs_DeinitialiseObjects(yaffs_Device *dev)
 
 	dev->freeObjects = NULL;
 	dev->nFreeObjects = 0;
+
+	if (dev->objectBucket)
+		yaffs_FreeObjectBuckets(dev->objectBucket,
+					dev->objectBucketAlt);
+	dev->objectBucket = NULL;
+	dev->nObjectBuckets = 0;
+	dev->nHashedObjects = 0;
 }
 
-static void yaffs_InitialiseObjects(yaffs_Device *dev)
+static int yaffs_InitialiseObjects(yaffs_Device *dev)
 {
-	int i;
-
 	dev->allocatedObjectList = NULL;
 	dev->freeObjects = NULL;
 	dev->nFreeObjects = 0;
 
-	for (i = 0; i < YAFFS_NOBJECT_BUCKETS; i++) {
-		YINIT_LIST_HEAD(&dev->objectBucket[i].list);
-		dev->objectBucket[i].count = 0;
-	}
+	dev->nHashedObjects = 0;
+	dev->nObjectBuckets = YAFFS_NOBJECT_BUCKETS;
+	dev->objectBucket = yaffs_AllocateObjectBuckets(dev->nObjectBuckets, 1,
+						&dev->objectBucketAlt);
+
+	return dev->objectBucket ? YAFFS_OK : YAFFS_FAIL;
 }
 
 static int yaffs_FindNiceObjectBucket(yaffs_Device *dev)
@@ -2069,7 +2295,7 @@ static int yaffs_FindNiceObjectBucket(yaffs_Device *dev)
 
 	for (i = 0; i < 10 && lowest > 0; i++) {
 		x++;
-		x %= YAFFS_NOBJECT_BUCKETS;
+		x &= dev->nObjectBuckets - 1;
 		if (dev->objectBucket[x].count < lowest) {
 			lowest = dev->objectBucket[x].count;
 			l = x;
@@ -2083,7 +2309,7 @@ static int yaffs_FindNiceObjectBucket(yaffs_Device *dev)
 
 	for (i = 0; i < 10 && lowest > 3; i++) {
 		x++;
-		x %= YAFFS_NOBJECT_BUCKETS;
+		x &= dev->nObjectBuckets - 1;
 		if (dev->objectBucket[x].count < lowest) {
 			lowest = dev->objectBucket[x].count;
 			l = x;
@@ -2111,7 +2337,7 @@ static int yaffs_CreateNewObjectNumber(yaffs_Device *dev)
 
 	while (!found) {
 		found = 1;
-		n += YAFFS_NOBJECT_BUCKETS;
+		n += dev->nObjectBuckets;
 		if (1 || dev->objectBucket[bucket].count > 0) {
 			ylist_for_each(i, &dev->objectBucket[bucket].list) {
 				/* If there is already one in the list */
@@ -2128,16 +2354,17 @@ static int yaffs_CreateNewObjectNumber(yaffs_Device *dev)
 
 static void yaffs_HashObject(yaffs_Object *in)
 {
-	int bucket = yaffs_HashFunction(in->objectId);
 	yaffs_Device *dev = in->myDev;
+	int bucket = yaffs_HashFunction(dev, in->objectId);
 
 	ylist_add(&in->hashLink, &dev->objectBucket[bucket].list);
 	dev->objectBucket[bucket].count++;
+	dev->nHashedObjects++;
 }
 
 yaffs_Object *yaffs_FindObjectByNumber(yaffs_Device *dev, __u32 number)
 {
-	int bucket = yaffs_HashFunction(number);
+	int bucket = yaffs_HashFunction(dev, number);
 	struct ylist_head *i;
 	yaffs_Object *in;
 
@@ -2166,6 +2393,8 @@ yaffs_Object *yaffs_CreateNewObject(yaffs_Device *dev, int number,
 	yaffs_Object *theObject;
 	yaffs_Tnode *tn = NULL;
 
+	yaffs_GrowObjectHash(dev);
+
 	if (number < 0)
 		number = yaffs_CreateNewObjectNumber(dev);
 
@@ -2622,12 +2851,36 @@ static int yaffs_BlockNotDisqualifiedFromGC(yaffs_Device *dev,
 	return (bi->sequenceNumber <= dev->oldestDirtySequence);
 }
 
-/* FindDiretiestBlock is used to select the dirtiest block (or close enough)
- * for garbage collection.
+/* Cost-benefit score for collecting a block: the space it gives back
+ * weighted by how long it has gone unmodified, over the cost of copying out
+ * its live chunks. Cold blocks are worth collecting before slightly dirtier
+ * hot ones since their live data is unlikely to be rewritten soon.
+ * Age comes from the sequence number, so on yaffs1 this is just free space.
+ */
+static __u32 yaffs_GCScore(yaffs_Device *dev, yaffs_BlockInfo *bi)
+{
+	__u32 live = bi->pagesInUse - bi->softDeletions;
+	__u32 age = 1;
+
+	if (dev->isYaffs2 && dev->sequenceNumber >= bi->sequenceNumber)
+		age += dev->sequenceNumber - bi->sequenceNumber;
+	if (age > 0xFFFFF)
+		age = 0xFFFFF;
+
+	return ((dev->nChunksPerBlock - live) * age) /
+		(dev->nChunksPerBlock + live);
+}
+
+/* FindBlockForGarbageCollection is used to select the block to collect.
+ * Aggressive gc wants space now so it takes the dirtiest block (or close
+ * enough). Passive and background gc pick the best cost-benefit block.
+ * Background gc runs when the device is idle, so it searches the whole
+ * device and will take blocks with up to maxLive chunks still in use.
  */
 
 static int yaffs_FindBlockForGarbageCollection(yaffs_Device *dev,
-					int aggressive)
+					int aggressive, int background,
+					int maxLive)
 {
 	int b = dev->currentDirtyChecker;
 
@@ -2638,6 +2891,8 @@ static int yaffs_FindBlockForGarbageCollection(yaffs_Device *dev,
 	int prioritised = 0;
 	yaffs_BlockInfo *bi;
 	int pendingPrioritisedExist = 0;
+	__u32 score;
+	__u32 bestScore = 0;
 
 	/* First let's see if we need to grab a prioritised block */
 	if (dev->hasPendingPrioritisedGCs) {
@@ -2668,16 +2923,22 @@ static int yaffs_FindBlockForGarbageCollection(yaffs_Device *dev,
 	 * block has only a few pages in use.
 	 */
 
-	dev->nonAggressiveSkip--;
+	if (!background) {
+		dev->nonAggressiveSkip--;
 
-	if (!aggressive && (dev->nonAggressiveSkip > 0))
-		return -1;
+		if (!aggressive && (dev->nonAggressiveSkip > 0))
+			return -1;
+	}
 
-	if (!prioritised)
-		pagesInUse =
-			(aggressive) ? dev->nChunksPerBlock : YAFFS_PASSIVE_GC_CHUNKS + 1;
+	if (!prioritised) {
+		if (background)
+			pagesInUse = maxLive + 1;
+		else
+			pagesInUse = (aggressive) ?
+				dev->nChunksPerBlock : YAFFS_PASSIVE_GC_CHUNKS + 1;
+	}
 
-	if (aggressive)
+	if (aggressive || background)
 		iterations =
 		    dev->internalEndBlock - dev->internalStartBlock + 1;
 	else {
@@ -2704,22 +2965,32 @@ static int yaffs_FindBlockForGarbageCollection(yaffs_Device *dev,
 		if (bi->blockState == YAFFS_BLOCK_STATE_FULL &&
 			(bi->pagesInUse - bi->softDeletions) < pagesInUse &&
 				yaffs_BlockNotDisqualifiedFromGC(dev, bi)) {
-			dirtiest = b;
-			pagesInUse = (bi->pagesInUse - bi->softDeletions);
+			if (aggressive) {
+				dirtiest = b;
+				pagesInUse = (bi->pagesInUse - bi->softDeletions);
+			} else {
+				score = yaffs_GCScore(dev, bi);
+				if (dirtiest < 0 || score > bestScore) {
+					dirtiest = b;
+					bestScore = score;
+				}
+			}
 		}
 	}
 
 	dev->currentDirtyChecker = b;
 
 	if (dirtiest > 0) {
+		bi = yaffs_GetBlockInfo(dev, dirtiest);
 		T(YAFFS_TRACE_GC,
-		  (TSTR("GC Selected block %d with %d free, prioritised:%d" TENDSTR), dirtiest,
-		   dev->nChunksPerBlock - pagesInUse, prioritised));
+		  (TSTR("GC Selected block %d with %d free, prioritised:%d background:%d" TENDSTR),
+		   dirtiest, dev->nChunksPerBlock - (bi->pagesInUse - bi->softDeletions),
+		   prioritised, background));
 	}
 
 	dev->oldestDirtySequence = 0;
 
-	if (dirtiest > 0)
+	if (dirtiest > 0 && !background)
 		dev->nonAggressiveSkip = 4;
 
 	return dirtiest;
@@ -3256,13 +3527,16 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 		}
 
 		if (dev->gcBlock <= 0) {
-			dev->gcBlock = yaffs_FindBlockForGarbageCollection(dev, aggressive);
+			dev->gcBlock = yaffs_FindBlockForGarbageCollection(dev,
+							aggressive, 0, 0);
 			dev->gcChunk = 0;
 		}
 
 		block = dev->gcBlock;
 
 		if (block > 0) {
+			unsigned start = Y_CLOCK();
+
 			dev->garbageCollections++;
 			if (!aggressive)
 				dev->passiveGarbageCollections++;
@@ -3273,6 +3547,8 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 			   dev->nErasedBlocks, aggressive));
 
 			gcOk = yaffs_GarbageCollectBlock(dev, block, aggressive);
+
+			dev->gcTime += Y_CLOCK() - start;
 		}
 
 		if (dev->nErasedBlocks < (dev->nReservedBlocks) && block > 0) {
@@ -3288,6 +3564,69 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 	return aggressive ? gcOk : YAFFS_OK;
 }
 
+/* Background garbage collection, for the OS to call when the device is idle.
+ * Collects one whole block per call so that the write path finds erased
+ * blocks waiting instead of stalling in aggressive gc.
+ * While there are enough erased blocks only nearly empty blocks are taken,
+ * and only if that doesn't cost us a valid checkpoint. Below that any block
+ * with garbage in it will do.
+ * Returns YAFFS_OK if a block was collected, YAFFS_FAIL if there was
+ * nothing worth doing.
+ */
+int yaffs_BackgroundGarbageCollect(yaffs_Device *dev)
+{
+	int block;
+	int maxLive;
+	int spare;
+	int checkpointBlockAdjust;
+	unsigned start;
+
+	if (dev->isDoingGC)
+		return YAFFS_FAIL;
+
+	checkpointBlockAdjust = yaffs_CalcCheckpointBlocksRequired(dev) -
+				dev->blocksInCheckpoint;
+	if (checkpointBlockAdjust < 0)
+		checkpointBlockAdjust = 0;
+
+	spare = (dev->internalEndBlock - dev->internalStartBlock + 1) >>
+			YAFFS_BG_GC_SPARE_SHIFT;
+	if (spare < YAFFS_BG_GC_MIN_SPARE)
+		spare = YAFFS_BG_GC_MIN_SPARE;
+
+	if (dev->nErasedBlocks >=
+			dev->nReservedBlocks + checkpointBlockAdjust + spare) {
+		/* Not short of space. Leave a valid checkpoint alone rather
+		 * than invalidate it for the sake of tidying up.
+		 */
+		if (dev->isCheckpointed)
+			return YAFFS_FAIL;
+		maxLive = YAFFS_PASSIVE_GC_CHUNKS;
+	} else
+		maxLive = dev->nChunksPerBlock - 1;
+
+	if (dev->gcBlock <= 0) {
+		dev->gcBlock = yaffs_FindBlockForGarbageCollection(dev, 0, 1,
+								    maxLive);
+		dev->gcChunk = 0;
+	}
+
+	block = dev->gcBlock;
+	if (block <= 0)
+		return YAFFS_FAIL;
+
+	T(YAFFS_TRACE_GC | YAFFS_TRACE_BACKGROUND,
+	  (TSTR("yaffs: background GC block %d erasedBlocks %d" TENDSTR),
+	   block, dev->nErasedBlocks));
+
+	start = Y_CLOCK();
+	dev->backgroundGarbageCollections++;
+	yaffs_GarbageCollectBlock(dev, block, 1);
+	dev->backgroundGcTime += Y_CLOCK() - start;
+
+	return YAFFS_OK;
+}
+
 /*-------------------------  TAGS --------------------------------*/
 
 static int yaffs_TagsMatch(const yaffs_ExtendedTags *tags, int objectId,
@@ -4419,7 +4758,7 @@ static int yaffs_WriteCheckpointObjects(yaffs_Device *dev)
 	 * dumping them to the checkpointing stream.
 	 */
 
-	for (i = 0; ok &&  i <  YAFFS_NOBJECT_BUCKETS; i++) {
+	for (i = 0; ok &&  i <  dev->nObjectBuckets; i++) {
 		ylist_for_each(lh, &dev->objectBucket[i].list) {
 			if (lh) {
 				obj = ylist_entry(lh, yaffs_Object, hashLink);
@@ -5510,7 +5849,7 @@ static void yaffs_FixHangingObjects(yaffs_Device *dev)
 	 * Make sure it is rooted.
 	 */
 
-	for (i = 0; i <  YAFFS_NOBJECT_BUCKETS; i++) {
+	for (i = 0; i <  dev->nObjectBuckets; i++) {
 		ylist_for_each_safe(lh, n, &dev->objectBucket[i].list) {
 			if (lh) {
 				obj = ylist_entry(lh, yaffs_Object, hashLink);
@@ -6119,6 +6458,8 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 	yaffs_BlockIndex *blockIndex = NULL;
 	int altBlockIndex = 0;
 
+	yaffs_ExtendedTags *blockTags;
+
 	if (!dev->isYaffs2) {
 		T(YAFFS_TRACE_SCAN,
 		  (TSTR("yaffs_ScanBackwards is only for YAFFS2!" TENDSTR)));
@@ -6150,6 +6491,11 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 
 	chunkData = yaffs_GetTempBuffer(dev, __LINE__);
 
+	/* Tags for a whole block are read in one go. If we can't get the
+	 * memory for that just read them a chunk at a time.
+	 */
+	blockTags = YMALLOC(dev->nChunksPerBlock * sizeof(yaffs_ExtendedTags));
+
 	/* Scan all the blocks to determine their state */
 	for (blk = dev->internalStartBlock; blk <= dev->internalEndBlock; blk++) {
 		bi = yaffs_GetBlockInfo(dev, blk);
@@ -6265,6 +6611,11 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 
 		deleted = 0;
 
+		if (blockTags &&
+		    (state == YAFFS_BLOCK_STATE_NEEDS_SCANNING ||
+		     state == YAFFS_BLOCK_STATE_ALLOCATING))
+			yaffs_ReadBlockTagsFromNAND(dev, blk, blockTags);
+
 		/* For each chunk in each block that needs scanning.... */
 		foundChunksInBlock = 0;
 		for (c = dev->nChunksPerBlock - 1;
@@ -6277,8 +6628,11 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 
 			chunk = blk * dev->nChunksPerBlock + c;
 
-			result = yaffs_ReadChunkWithTagsFromNAND(dev, chunk, NULL,
-							&tags);
+			if (blockTags)
+				tags = blockTags[c];
+			else
+				result = yaffs_ReadChunkWithTagsFromNAND(dev,
+							chunk, NULL, &tags);
 
 			/* Let's have a good look at this chunk... */
 
@@ -6732,6 +7086,9 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 	else
 		YFREE(blockIndex);
 
+	if (blockTags)
+		YFREE(blockTags);
+
 	/* Ok, we've done all the scanning.
 	 * Fix up the hard link chains.
 	 * We should now have scanned all the objects, now it's time to add these
@@ -7504,7 +7861,8 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 		init_failed = 1;
 
 	yaffs_InitialiseTnodes(dev);
-	yaffs_InitialiseObjects(dev);
+	if (!init_failed && !yaffs_InitialiseObjects(dev))
+		init_failed = 1;
 
 	if (!init_failed && !yaffs_CreateInitialDirectories(dev))
 		init_failed = 1;
@@ -7540,7 +7898,8 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 					init_failed = 1;
 
 				yaffs_InitialiseTnodes(dev);
-				yaffs_InitialiseObjects(dev);
+				if (!init_failed && !yaffs_InitialiseObjects(dev))
+					init_failed = 1;
 
 				if (!init_failed && !yaffs_CreateInitialDirectories(dev))
 					init_failed = 1;
@@ -7571,6 +7930,9 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 	dev->nPageWrites = 0;
 	dev->nBlockErasures = 0;
 	dev->nGCCopies = 0;
+	dev->backgroundGarbageCollections = 0;
+	dev->gcTime = 0;
+	dev->backgroundGcTime = 0;
 	dev->nRetriedWrites = 0;
 
 	dev->nRetiredBlocks = 0;
@@ -58,7 +58,13 @@
 #define YAFFS_ALLOCATION_NTNODES	100
 #define YAFFS_ALLOCATION_NLINKS		100
 
+/* The object hash starts at YAFFS_NOBJECT_BUCKETS and doubles whenever
+ * the average chain gets longer than YAFFS_OBJECT_HASH_LOAD.
+ * Bucket counts must be powers of 2.
+ */
 #define YAFFS_NOBJECT_BUCKETS		256
+#define YAFFS_MAX_OBJECT_BUCKETS	16384
+#define YAFFS_OBJECT_HASH_LOAD		4
 
 
 #define YAFFS_OBJECT_SPACE		0x40000
@@ -365,6 +371,8 @@ typedef union yaffs_Tnode_union yaffs_Tnode;
 struct yaffs_TnodeList_struct {
 	struct yaffs_TnodeList_struct *next;
 	yaffs_Tnode *tnodes;
+	int nTnodes;
+	int nFree;		/* Only valid during yaffs_ShrinkTnodes() */
 };
 
 typedef struct yaffs_TnodeList_struct yaffs_TnodeList;
@@ -590,6 +598,11 @@ struct yaffs_DeviceStruct {
 	int (*markNANDBlockBad) (struct yaffs_DeviceStruct *dev, int blockNo);
 	int (*queryNANDBlock) (struct yaffs_DeviceStruct *dev, int blockNo,
 			       yaffs_BlockState *state, __u32 *sequenceNumber);
+	/* Optional. Reads the tags of every chunk in a block in one go,
+	 * used by the mount scan. tags must hold nChunksPerBlock entries.
+	 */
+	int (*readBlockTagsFromNAND) (struct yaffs_DeviceStruct *dev,
+				      int blockNo, yaffs_ExtendedTags *tags);
 #endif
 
 	int isYaffs2;
@@ -643,6 +656,8 @@ struct yaffs_DeviceStruct {
 
 				 */
 	void (*putSuperFunc) (struct super_block *sb);
+	struct task_struct *bgThread;	/* Background gc thread */
+	unsigned long lastActivity;	/* jiffies of last fs operation */
         struct ylist_head searchContexts;
 
 #endif
@@ -708,7 +723,10 @@ struct yaffs_DeviceStruct {
 
 	yaffs_ObjectList *allocatedObjectList;
 
-	yaffs_ObjectBucket objectBucket[YAFFS_NOBJECT_BUCKETS];
+	yaffs_ObjectBucket *objectBucket;
+	int nObjectBuckets;
+	int objectBucketAlt;	/* objectBucket was allocated using alt scheme */
+	int nHashedObjects;
 
 	int nFreeChunks;
 
@@ -725,6 +743,10 @@ struct yaffs_DeviceStruct {
 	int nGCCopies;
 	int garbageCollections;
 	int passiveGarbageCollections;
+	int backgroundGarbageCollections;
+	int nTnodesReleased;	/* Given back to the system by the shrinker */
+	unsigned gcTime;		/* In Y_CLOCK() ticks */
+	unsigned backgroundGcTime;
 	int nRetriedWrites;
 	int nRetiredBlocks;
 	int eccFixed;
@@ -856,6 +878,14 @@ void yaffs_FlushEntireDeviceCache(yaffs_Device *dev);
 int yaffs_CheckpointSave(yaffs_Device *dev);
 int yaffs_CheckpointRestore(yaffs_Device *dev);
 
+/* Garbage collection */
+int yaffs_BackgroundGarbageCollect(yaffs_Device *dev);
+
+/* Memory management */
+int yaffs_ShrinkTnodes(yaffs_Device *dev);
+int yaffs_TnodeMemory(yaffs_Device *dev);
+int yaffs_ObjectMemory(yaffs_Device *dev);
+
 /* Directory operations */
 yaffs_Object *yaffs_MknodDirectory(yaffs_Object *parent, const YCHAR *name,
 				__u32 mode, __u32 uid, __u32 gid);
@@ -53,6 +53,36 @@ int yaffs_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 	return result;
 }
 
+/*
+ * Read the tags of all the chunks in a block. If the driver can do this in
+ * one batched read use that, otherwise fall back to reading chunk by chunk.
+ */
+int yaffs_ReadBlockTagsFromNAND(yaffs_Device *dev, int blockInNAND,
+					yaffs_ExtendedTags *tags)
+{
+	int i;
+	int chunk = blockInNAND * dev->nChunksPerBlock;
+
+	if (dev->readBlockTagsFromNAND &&
+	    dev->readBlockTagsFromNAND(dev, blockInNAND - dev->blockOffset,
+					tags) == YAFFS_OK) {
+		yaffs_BlockInfo *bi = yaffs_GetBlockInfo(dev, blockInNAND);
+
+		dev->nPageReads += dev->nChunksPerBlock;
+
+		for (i = 0; i < dev->nChunksPerBlock; i++)
+			if (tags[i].eccResult > YAFFS_ECC_RESULT_NO_ERROR)
+				yaffs_HandleChunkError(dev, bi);
+
+		return YAFFS_OK;
+	}
+
+	for (i = 0; i < dev->nChunksPerBlock; i++)
+		yaffs_ReadChunkWithTagsFromNAND(dev, chunk + i, NULL, &tags[i]);
+
+	return YAFFS_OK;
+}
+
 int yaffs_WriteChunkWithTagsToNAND(yaffs_Device *dev,
 						   int chunkInNAND,
 						   const __u8 *buffer,
@@ -85,6 +85,9 @@
 #define Y_TIME_CONVERT(x) (x)
 #endif
 
+/* Free running clock used for gc timing statistics */
+#define Y_CLOCK() ((unsigned)jiffies)
+
 #define yaffs_SumCompare(x, y) ((x) == (y))
 #define yaffs_strcmp(a, b) strcmp(a, b)
 
@@ -158,6 +161,10 @@
 
 #endif
 
+#ifndef Y_CLOCK
+#define Y_CLOCK() 0
+#endif
+
 /* see yaffs_fs.c */
 extern unsigned int yaffs_traceMask;
 extern unsigned int yaffs_wr_attempts;
@@ -182,6 +189,7 @@ extern unsigned int yaffs_wr_attempts;
 #define YAFFS_TRACE_SCAN_DEBUG		0x00002000
 #define YAFFS_TRACE_MTD			0x00004000
 #define YAFFS_TRACE_CHECKPOINT		0x00008000
+#define YAFFS_TRACE_BACKGROUND		0x00100000
 
 #define YAFFS_TRACE_VERIFY		0x00010000
 #define YAFFS_TRACE_VERIFY_NAND		0x00020000
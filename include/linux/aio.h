@@ -124,6 +124,9 @@ struct kiocb {
 	 * this is the underlying file* to deliver event to.
 	 */
 	struct file		*ki_eventfd;
+
+	/* when io_submit() took the request, for the latency statistics */
+	ktime_t			ki_submit_time;
 };
 
 #define is_sync_kiocb(iocb)	((iocb)->ki_key == KIOCB_SYNC_KEY)
@@ -163,6 +166,12 @@ struct aio_ring {
 
 #define aio_ring_avail(info, ring)	(((ring)->head + (info)->nr - 1 - (ring)->tail) % (info)->nr)
 
+/*
+ * The ring is mapped into the submitter's address space at the context id,
+ * so completions can be harvested without io_getevents(): read ->tail,
+ * consume the events from ->head up to it, then store the new ->head.
+ * The kernel orders each event before the ->tail update that publishes it.
+ */
 #define AIO_RING_PAGES	8
 struct aio_ring_info {
 	unsigned long		mmap_base;
@@ -34,6 +34,8 @@
  */
 #define PMEM_GET_TOTAL_SIZE	_IOW(PMEM_IOCTL_MAGIC, 7, unsigned int)
 
+struct cma;
+
 struct android_pmem_platform_data
 {
 	const char* name;
@@ -49,6 +51,9 @@ struct android_pmem_platform_data
 	unsigned cached;
 	/* The MSM7k has bits to enable a write buffer in the bus controller*/
 	unsigned buffered;
+	/* contiguous memory area to back the region instead of a carveout,
+	 * start is ignored and size defaults to the size of the area */
+	struct cma *cma;
 };
 
 struct pmem_region {
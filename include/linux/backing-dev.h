@@ -18,14 +18,17 @@
 struct page;
 struct device;
 struct dentry;
+struct task_struct;
 
 /*
  * Bits in backing_dev_info.state
  */
 enum bdi_state {
-	BDI_pdflush,		/* A pdflush thread is working this device */
+	BDI_writeback_running,	/* The flusher thread is writing this device */
 	BDI_write_congested,	/* The write queue is getting full */
 	BDI_read_congested,	/* The read queue is getting full */
+	BDI_registered,		/* On bdi_list, may get a flusher thread */
+	BDI_pending,		/* A flusher thread is being started */
 	BDI_unused,		/* Available bits start here */
 };
 
@@ -34,6 +37,7 @@ typedef int (congested_fn)(void *, int);
 enum bdi_stat_item {
 	BDI_RECLAIMABLE,
 	BDI_WRITEBACK,
+	BDI_WRITTEN,
 	NR_BDI_STAT_ITEMS
 };
 
@@ -58,6 +62,25 @@ struct backing_dev_info {
 
 	struct device *dev;
 
+	/*
+	 * Writeback state.  The inode lists are protected by inode_lock,
+	 * bdi_list, task and wb_pages by bdi_list_lock.
+	 */
+	struct list_head bdi_list;	/* on bdi_list while registered */
+	struct task_struct *task;	/* flusher thread, if running */
+	int wb_users;			/* walkers holding us on bdi_list */
+	long wb_pages;			/* writeback asked of the flusher */
+	unsigned long last_old_flush;	/* last kupdate-style writeback */
+	struct list_head b_dirty;	/* dirty inodes */
+	struct list_head b_io;		/* parked for writeback */
+	struct list_head b_more_io;	/* parked for more writeback */
+
+	/* Write bandwidth estimate, updated on writeback completion */
+	spinlock_t bw_lock;
+	unsigned long bw_time_stamp;	/* jiffies of the last update */
+	unsigned long written_stamp;	/* BDI_WRITTEN at bw_time_stamp */
+	unsigned long write_bandwidth;	/* smoothed, in pages per second */
+
 #ifdef CONFIG_DEBUG_FS
 	struct dentry *debug_dir;
 	struct dentry *debug_stats;
@@ -71,6 +94,16 @@ int bdi_register(struct backing_dev_info *bdi, struct device *parent,
 		const char *fmt, ...);
 int bdi_register_dev(struct backing_dev_info *bdi, dev_t dev);
 void bdi_unregister(struct backing_dev_info *bdi);
+void __bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages);
+void bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages);
+int bdi_writeback_task(struct backing_dev_info *bdi);
+long bdi_do_writeback(struct backing_dev_info *bdi);
+int bdi_has_dirty_io(struct backing_dev_info *bdi);
+void bdi_wakeup_flushers(void);
+int __bdi_unpin(struct backing_dev_info *bdi);
+
+extern spinlock_t bdi_list_lock;
+extern struct list_head bdi_list;
 
 static inline void __add_bdi_stat(struct backing_dev_info *bdi,
 		enum bdi_stat_item item, s64 amount)
@@ -137,6 +170,17 @@ static inline s64 bdi_stat_sum(struct backing_dev_info *bdi,
 
 extern void bdi_writeout_inc(struct backing_dev_info *bdi);
 
+/*
+ * Keep a registered bdi on bdi_list while bdi_list_lock is dropped to
+ * write it back.  Both are called with bdi_list_lock held; __bdi_unpin()
+ * returns nonzero if the bdi was unregistered meanwhile, in which case
+ * the walk of bdi_list has to be restarted.
+ */
+static inline void __bdi_pin(struct backing_dev_info *bdi)
+{
+	bdi->wb_users++;
+}
+
 /*
  * maximal error of a stat counter.
  */
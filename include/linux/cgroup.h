@@ -22,6 +22,7 @@ struct cgroupfs_root;
 struct cgroup_subsys;
 struct inode;
 struct cgroup;
+struct poll_table_struct;
 
 extern int cgroup_init_early(void);
 extern int cgroup_init(void);
@@ -310,6 +311,13 @@ struct cftype {
 	 */
 	int (*trigger)(struct cgroup *cgrp, unsigned int event);
 
+	/*
+	 * poll() callback for files that userspace can wait on for
+	 * state changes. Without it the file is always reported ready.
+	 */
+	unsigned int (*poll)(struct cgroup *cgrp, struct cftype *cft,
+			     struct file *file, struct poll_table_struct *pt);
+
 	int (*release)(struct inode *inode, struct file *file);
 };
 
@@ -0,0 +1,59 @@
+#ifndef __LINUX_CMA_H
+#define __LINUX_CMA_H
+
+/*
+ * Contiguous memory allocator.
+ *
+ * A driver that needs physically contiguous buffers reserves a cma area
+ * at boot instead of a private carveout.  Until the driver claims parts
+ * of the area, its pages are used by the page allocator for movable
+ * allocations; cma_claim() migrates those pages away and hands the range
+ * to the driver, cma_release() gives it back.
+ */
+
+struct cma;
+
+#ifdef CONFIG_CMA
+
+extern struct cma *cma_reserve(const char *name, unsigned long base,
+			       unsigned long size);
+extern unsigned long cma_base(struct cma *cma);
+extern unsigned long cma_size(struct cma *cma);
+
+extern int cma_claim(struct cma *cma, unsigned long paddr,
+		     unsigned long size);
+extern void cma_release(struct cma *cma, unsigned long paddr,
+			unsigned long size);
+
+#else
+
+static inline struct cma *cma_reserve(const char *name, unsigned long base,
+				      unsigned long size)
+{
+	return NULL;
+}
+
+static inline unsigned long cma_base(struct cma *cma)
+{
+	return 0;
+}
+
+static inline unsigned long cma_size(struct cma *cma)
+{
+	return 0;
+}
+
+static inline int cma_claim(struct cma *cma, unsigned long paddr,
+			    unsigned long size)
+{
+	return 0;
+}
+
+static inline void cma_release(struct cma *cma, unsigned long paddr,
+			       unsigned long size)
+{
+}
+
+#endif /* CONFIG_CMA */
+
+#endif /* __LINUX_CMA_H */
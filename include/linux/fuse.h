@@ -25,6 +25,11 @@
  *  - add IOCTL message
  *  - add unsolicited notification support
  *  - add POLL message and NOTIFY_POLL notification
+ *
+ * 7.11 local extension
+ *  - add FUSE_BATCH_REQUESTS init flag.  It uses the top flag bit so that
+ *    it can't be mistaken for a flag of a later protocol version, and is
+ *    only honoured from a daemon speaking exactly this minor version
  */
 
 #ifndef _LINUX_FUSE_H
@@ -112,6 +117,8 @@ struct fuse_file_lock {
  * INIT request/reply flags
  *
  * FUSE_EXPORT_SUPPORT: filesystem handles lookups of "." and ".."
+ * FUSE_BATCH_REQUESTS: a read of the device may return several requests,
+ *			and a write may carry several replies, back to back
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -119,6 +126,7 @@ struct fuse_file_lock {
 #define FUSE_ATOMIC_O_TRUNC	(1 << 3)
 #define FUSE_EXPORT_SUPPORT	(1 << 4)
 #define FUSE_BIG_WRITES		(1 << 5)
+#define FUSE_BATCH_REQUESTS	(1 << 31)
 
 /**
  * Release flags
@@ -68,6 +68,7 @@ struct inotify_event {
 /* Flags for sys_inotify_init1.  */
 #define IN_CLOEXEC O_CLOEXEC
 #define IN_NONBLOCK O_NONBLOCK
+#define IN_COALESCE 0x00000001	/* hold back and merge IN_MODIFY events */
 
 #ifdef __KERNEL__
 
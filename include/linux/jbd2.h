@@ -648,6 +648,12 @@ struct transaction_s
 	 */
 	int t_handle_count;
 
+	/*
+	 * How many fsync callers are waiting for this transaction to
+	 * commit? [j_state_lock]
+	 */
+	int			t_sync_waiters;
+
 	/*
 	 * For use by the filesystem to store fs-specific data
 	 * structures associated with the transaction
@@ -663,6 +669,7 @@ struct transaction_run_stats_s {
 	unsigned long		rs_logging;
 
 	unsigned long		rs_handle_count;
+	unsigned long		rs_sync_waiters;
 	unsigned long		rs_blocks;
 	unsigned long		rs_blocks_logged;
 };
@@ -751,6 +758,8 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wbufsize: maximum number of buffer_heads allowed in j_wbuf, the
  *	number that will fit in j_blocksize
  * @j_last_sync_writer: most recent pid which did a synchronous write
+ * @j_last_sync_batch: number of fsync callers in the last commit anyone
+ *	waited for
  * @j_history: Buffer storing the transactions statistics history
  * @j_history_max: Maximum number of transactions in the statistics history
  * @j_history_cur: Current number of transactions in the statistics history
@@ -961,6 +970,12 @@ struct journal_s
 	 */
 	pid_t			j_last_sync_writer;
 
+	/*
+	 * how many fsync callers the last synchronously waited-upon
+	 * transaction carried [j_state_lock]
+	 */
+	int			j_last_sync_batch;
+
 	/*
 	 * the average amount of time in nanoseconds it takes to commit a
 	 * transaction to disk. [j_state_lock]
@@ -1208,6 +1223,7 @@ int __jbd2_log_start_commit(journal_t *journal, tid_t tid);
 int jbd2_journal_start_commit(journal_t *journal, tid_t *tid);
 int jbd2_journal_force_commit_nested(journal_t *journal);
 int jbd2_log_wait_commit(journal_t *journal, tid_t tid);
+int jbd2_complete_transaction(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
 
 void __jbd2_log_wait_for_space(journal_t *journal);
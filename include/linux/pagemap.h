@@ -355,6 +355,8 @@ static inline void lock_page_nosync(struct page *page)
  */
 extern void wait_on_page_bit(struct page *page, int bit_nr);
 
+extern int wait_on_page_locked_async(struct page *page, wait_queue_t *wait);
+
 /* 
  * Wait for a page to be unlocked.
  *
@@ -436,6 +438,7 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t index, gfp_t gfp_mask);
 extern void remove_from_page_cache(struct page *page);
 extern void __remove_from_page_cache(struct page *page);
+extern void __remove_from_page_cache_shadow(struct page *page, void *shadow);
 
 /*
  * Like add_to_page_cache_locked, but used to add newly allocated pages:
@@ -53,6 +53,21 @@ static inline int radix_tree_is_indirect_ptr(void *ptr)
 	return (int)((unsigned long)ptr & RADIX_TREE_INDIRECT_PTR);
 }
 
+/*
+ * An exceptional entry is a non-pointer value stored in a slot, marked by
+ * bit 1 being set (item pointers are at least word aligned).  The page
+ * cache uses them to remember evicted pages.  The gang lookups skip
+ * exceptional entries unless asked for them explicitly, and
+ * radix_tree_next_hole() treats them as holes.
+ */
+#define RADIX_TREE_EXCEPTIONAL_ENTRY	2
+#define RADIX_TREE_EXCEPTIONAL_SHIFT	2
+
+static inline int radix_tree_exceptional_entry(void *arg)
+{
+	return (unsigned long)arg & RADIX_TREE_EXCEPTIONAL_ENTRY;
+}
+
 /*** radix-tree API starts here ***/
 
 #define RADIX_TREE_MAX_TAGS 2
@@ -165,6 +180,10 @@ radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 unsigned int
 radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
 			unsigned long first_index, unsigned int max_items);
+unsigned int
+radix_tree_gang_lookup_exceptional(struct radix_tree_root *root,
+			void **results, unsigned long *indices,
+			unsigned long first_index, unsigned int max_items);
 unsigned long radix_tree_next_hole(struct radix_tree_root *root,
 				unsigned long index, unsigned long max_scan);
 int radix_tree_preload(gfp_t gfp_mask);
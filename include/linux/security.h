@@ -1620,6 +1620,7 @@ struct security_operations {
 /* prototypes */
 extern int security_init(void);
 extern int security_module_enable(struct security_operations *ops);
+extern int security_module_registered(void);
 extern int register_security(struct security_operations *ops);
 
 /* Security operations */
@@ -1804,6 +1805,11 @@ static inline int security_init(void)
 	return 0;
 }
 
+static inline int security_module_registered(void)
+{
+	return 0;
+}
+
 static inline int security_ptrace_may_access(struct task_struct *child,
 					     unsigned int mode)
 {
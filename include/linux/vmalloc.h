@@ -13,6 +13,7 @@ struct vm_area_struct;		/* vma defining user mapping in mm_types.h */
 #define VM_MAP		0x00000004	/* vmap()ed pages */
 #define VM_USERMAP	0x00000008	/* suitable for remap_vmalloc_range */
 #define VM_VPAGES	0x00000010	/* buffer for pages was vmalloc'ed */
+#define VM_LARGE	0x00000020	/* aligned for large page mappings */
 /* bits [20..32] reserved for arch specific ioremap internals */
 
 /*
@@ -23,6 +24,19 @@ struct vm_area_struct;		/* vma defining user mapping in mm_types.h */
 #define IOREMAP_MAX_ORDER	(7 + PAGE_SHIFT)	/* 128 pages */
 #endif
 
+#ifdef CONFIG_HAVE_ARCH_VMAP_LARGE
+/*
+ * Let the architecture map naturally aligned, physically contiguous runs
+ * of 1 << VMAP_LARGE_ORDER pages in the kernel range [addr, end), which
+ * has just been mapped, with a single TLB entry each.
+ */
+extern void arch_vmap_large_pages(unsigned long addr, unsigned long end);
+#else
+static inline void arch_vmap_large_pages(unsigned long addr, unsigned long end)
+{
+}
+#endif
+
 struct vm_struct {
 	struct vm_struct	*next;
 	void			*addr;
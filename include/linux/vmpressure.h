@@ -0,0 +1,64 @@
+#ifndef __LINUX_VMPRESSURE_H
+#define __LINUX_VMPRESSURE_H
+
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/gfp.h>
+
+struct mem_cgroup;
+struct file;
+struct poll_table_struct;
+
+enum vmpressure_levels {
+	VMPRESSURE_LOW = 0,
+	VMPRESSURE_MEDIUM,
+	VMPRESSURE_CRITICAL,
+	VMPRESSURE_NUM_LEVELS,
+};
+
+struct vmpressure {
+	/* Pages scanned and reclaimed since the last level computation */
+	unsigned long scanned;
+	unsigned long reclaimed;
+	spinlock_t sr_lock;
+
+	/* Most recently reported level and the number of reports so far */
+	enum vmpressure_levels level;
+	unsigned long events;
+	wait_queue_head_t wait;
+
+	struct work_struct work;
+};
+
+extern void vmpressure(gfp_t gfp, struct mem_cgroup *memcg,
+		       unsigned long scanned, unsigned long reclaimed);
+extern void vmpressure_prio(gfp_t gfp, struct mem_cgroup *memcg, int prio);
+
+extern void vmpressure_init(struct vmpressure *vmpr);
+extern void vmpressure_cleanup(struct vmpressure *vmpr);
+
+/* File helpers shared by /proc/vmpressure and memory.pressure_level */
+extern ssize_t vmpressure_file_read(struct vmpressure *vmpr, struct file *file,
+				    char __user *buf, size_t nbytes,
+				    loff_t *ppos);
+extern unsigned int vmpressure_file_poll(struct vmpressure *vmpr,
+					 struct file *file,
+					 struct poll_table_struct *pt);
+
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+extern struct vmpressure *memcg_to_vmpressure(struct mem_cgroup *memcg);
+extern struct vmpressure *vmpressure_parent(struct vmpressure *vmpr);
+#else
+static inline struct vmpressure *memcg_to_vmpressure(struct mem_cgroup *memcg)
+{
+	return NULL;
+}
+
+static inline struct vmpressure *vmpressure_parent(struct vmpressure *vmpr)
+{
+	return NULL;
+}
+#endif /* CONFIG_CGROUP_MEM_RES_CTLR */
+
+#endif /* __LINUX_VMPRESSURE_H */
@@ -38,6 +38,18 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		FOR_ALL_ZONES(PGSCAN_DIRECT),
 		PGINODESTEAL, SLABS_SCANNED, KSWAPD_STEAL, KSWAPD_INODESTEAL,
 		PAGEOUTRUN, ALLOCSTALL, PGROTATED,
+		DENTRY_PRUNED, DENTRY_NEGATIVE_PRUNED, DENTRY_NEGATIVE_CAPPED,
+		INODE_PRUNED,
+#ifdef CONFIG_EPOLL
+		EPOLL_WAIT, EPOLL_EVENTS,
+#endif
+#ifdef CONFIG_INOTIFY_USER
+		INOTIFY_QUEUED, INOTIFY_MERGED, INOTIFY_DROPPED,
+#endif
+#ifdef CONFIG_AIO
+		AIO_SUBMIT, AIO_SUBMIT_USECS, AIO_COMPLETE, AIO_COMPLETE_USECS,
+		AIO_READ_RETRY,
+#endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
 #endif
@@ -50,6 +62,10 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		UNEVICTABLE_PGCLEARED,	/* on COW, page truncate */
 		UNEVICTABLE_PGSTRANDED,	/* unable to isolate on unlock */
 		UNEVICTABLE_MLOCKFREED,
+#endif
+#ifdef CONFIG_COMPACTION
+		COMPACTBLOCKS, COMPACTPAGES, COMPACTPAGEFAILED,
+		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
 #endif
 		NR_VM_EVENT_ITEMS
 };
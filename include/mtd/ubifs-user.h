@@ -0,0 +1,41 @@
+/*
+ * This file is part of UBIFS.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __UBIFS_USER_H__
+#define __UBIFS_USER_H__
+
+/*
+ * Getting and setting the compressor of an inode
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * %UBIFS_IOC_GETCOMPR returns the compressor used for new data of an inode,
+ * %UBIFS_IOC_SETCOMPR sets it. The argument is a pointer to an int holding
+ * one of the compressor types of the on-flash format: 0 for none, 1 for LZO
+ * and 2 for zlib. Setting "none" also clears the compression flag of the
+ * inode, setting anything else sets it. Data already on flash is left as it
+ * is.
+ */
+
+/* ioctl commands of UBIFS files and directories */
+#define UBIFS_IOC_MAGIC 'O'
+
+/* Get the compressor of an inode */
+#define UBIFS_IOC_GETCOMPR _IOR(UBIFS_IOC_MAGIC, 0x40, int)
+/* Set the compressor of an inode */
+#define UBIFS_IOC_SETCOMPR _IOW(UBIFS_IOC_MAGIC, 0x41, int)
+
+#endif /* __UBIFS_USER_H__ */
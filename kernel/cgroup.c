@@ -47,6 +47,7 @@
 #include <linux/hash.h>
 #include <linux/namei.h>
 #include <linux/capability.h>
+#include <linux/poll.h>
 
 #include <asm/atomic.h>
 
@@ -1514,6 +1515,19 @@ static ssize_t cgroup_file_read(struct file *file, char __user *buf,
 	return -EINVAL;
 }
 
+static unsigned int cgroup_file_poll(struct file *file, poll_table *pt)
+{
+	struct cftype *cft = __d_cft(file->f_dentry);
+	struct cgroup *cgrp = __d_cgrp(file->f_dentry->d_parent);
+
+	if (cgroup_is_removed(cgrp))
+		return POLLERR;
+
+	if (cft->poll)
+		return cft->poll(cgrp, cft, file, pt);
+	return DEFAULT_POLLMASK;
+}
+
 /*
  * seqfile ops/methods for returning structured data. Currently just
  * supports string->u64 maps, but can be extended in future.
@@ -1613,6 +1627,7 @@ static int cgroup_rename(struct inode *old_dir, struct dentry *old_dentry,
 static struct file_operations cgroup_file_operations = {
 	.read = cgroup_file_read,
 	.write = cgroup_file_write,
+	.poll = cgroup_file_poll,
 	.llseek = generic_file_llseek,
 	.open = cgroup_file_open,
 	.release = cgroup_file_release,
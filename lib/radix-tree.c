@@ -636,7 +636,7 @@ EXPORT_SYMBOL(radix_tree_tag_get);
  *	@max_scan:	maximum range to search
  *
  *	Search the set [index, min(index+max_scan-1, MAX_INDEX)] for the lowest
- *	indexed hole.
+ *	indexed hole.  Exceptional entries count as holes.
  *
  *	Returns: the index of the hole if found, otherwise returns an index
  *	outside of the set specified (in which case 'return - index >= max_scan'
@@ -655,7 +655,9 @@ unsigned long radix_tree_next_hole(struct radix_tree_root *root,
 	unsigned long i;
 
 	for (i = 0; i < max_scan; i++) {
-		if (!radix_tree_lookup(root, index))
+		void *item = radix_tree_lookup(root, index);
+
+		if (!item || radix_tree_exceptional_entry(item))
 			break;
 		index++;
 		if (index == 0)
@@ -666,9 +668,15 @@ unsigned long radix_tree_next_hole(struct radix_tree_root *root,
 }
 EXPORT_SYMBOL(radix_tree_next_hole);
 
+/*
+ * Collect up to max_items slots starting at index.  Exceptional entries are
+ * returned instead of regular items when @exceptional is set, and their
+ * indices are stored in @indices.
+ */
 static unsigned int
 __lookup(struct radix_tree_node *slot, void ***results, unsigned long index,
-	unsigned int max_items, unsigned long *next_index)
+	unsigned int max_items, unsigned long *next_index,
+	int exceptional, unsigned long *indices)
 {
 	unsigned int nr_found = 0;
 	unsigned int shift, height;
@@ -701,8 +709,12 @@ __lookup(struct radix_tree_node *slot, void ***results, unsigned long index,
 
 	/* Bottom level: grab some items */
 	for (i = index & RADIX_TREE_MAP_MASK; i < RADIX_TREE_MAP_SIZE; i++) {
+		void *item = slot->slots[i];
+
 		index++;
-		if (slot->slots[i]) {
+		if (item && !radix_tree_exceptional_entry(item) == !exceptional) {
+			if (indices)
+				indices[nr_found] = index - 1;
 			results[nr_found++] = &(slot->slots[i]);
 			if (nr_found == max_items)
 				goto out;
@@ -746,7 +758,7 @@ radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 		return 0;
 
 	if (!radix_tree_is_indirect_ptr(node)) {
-		if (first_index > 0)
+		if (first_index > 0 || radix_tree_exceptional_entry(node))
 			return 0;
 		results[0] = node;
 		return 1;
@@ -763,12 +775,12 @@ radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 		if (cur_index > max_index)
 			break;
 		slots_found = __lookup(node, (void ***)results + ret, cur_index,
-					max_items - ret, &next_index);
+					max_items - ret, &next_index, 0, NULL);
 		nr_found = 0;
 		for (i = 0; i < slots_found; i++) {
 			struct radix_tree_node *slot;
 			slot = *(((void ***)results)[ret + i]);
-			if (!slot)
+			if (!slot || radix_tree_exceptional_entry(slot))
 				continue;
 			results[ret + nr_found] = rcu_dereference(slot);
 			nr_found++;
@@ -814,7 +826,7 @@ radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
 		return 0;
 
 	if (!radix_tree_is_indirect_ptr(node)) {
-		if (first_index > 0)
+		if (first_index > 0 || radix_tree_exceptional_entry(node))
 			return 0;
 		results[0] = (void **)&root->rnode;
 		return 1;
@@ -831,7 +843,7 @@ radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
 		if (cur_index > max_index)
 			break;
 		slots_found = __lookup(node, results + ret, cur_index,
-					max_items - ret, &next_index);
+					max_items - ret, &next_index, 0, NULL);
 		ret += slots_found;
 		if (next_index == 0)
 			break;
@@ -842,6 +854,65 @@ radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
 }
 EXPORT_SYMBOL(radix_tree_gang_lookup_slot);
 
+/**
+ *	radix_tree_gang_lookup_exceptional - gang lookup of exceptional entries
+ *	@root:		radix tree root
+ *	@results:	where the entries are placed
+ *	@indices:	where their indices are placed
+ *	@first_index:	start the lookup from this key
+ *	@max_items:	place up to this many entries at *@results
+ *
+ *	Like radix_tree_gang_lookup, but returns only the exceptional entries
+ *	that the other gang lookups skip, together with their indices.  The
+ *	caller must hold the tree lock so that the entries stay in place.
+ */
+unsigned int
+radix_tree_gang_lookup_exceptional(struct radix_tree_root *root,
+			void **results, unsigned long *indices,
+			unsigned long first_index, unsigned int max_items)
+{
+	unsigned long max_index;
+	struct radix_tree_node *node;
+	unsigned long cur_index = first_index;
+	unsigned int ret;
+
+	node = root->rnode;
+	if (!node)
+		return 0;
+
+	if (!radix_tree_is_indirect_ptr(node)) {
+		if (first_index > 0 || !radix_tree_exceptional_entry(node))
+			return 0;
+		results[0] = node;
+		indices[0] = 0;
+		return 1;
+	}
+	node = radix_tree_indirect_to_ptr(node);
+
+	max_index = radix_tree_maxindex(node->height);
+
+	ret = 0;
+	while (ret < max_items) {
+		unsigned int slots_found, i;
+		unsigned long next_index;	/* Index of next search */
+
+		if (cur_index > max_index)
+			break;
+		slots_found = __lookup(node, (void ***)results + ret, cur_index,
+					max_items - ret, &next_index,
+					1, indices + ret);
+		for (i = 0; i < slots_found; i++)
+			results[ret + i] = *(((void ***)results)[ret + i]);
+		ret += slots_found;
+		if (next_index == 0)
+			break;
+		cur_index = next_index;
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL(radix_tree_gang_lookup_exceptional);
+
 /*
  * FIXME: the two tag_get()s here should use find_next_bit() instead of
  * open-coding the search.
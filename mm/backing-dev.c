@@ -6,10 +6,24 @@
 #include <linux/module.h>
 #include <linux/writeback.h>
 #include <linux/device.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 
 
 static struct class *bdi_class;
 
+/*
+ * Registered bdis that write back dirty data, each of which gets a flusher
+ * thread while it has something to write.
+ */
+DEFINE_SPINLOCK(bdi_list_lock);
+LIST_HEAD(bdi_list);
+
+static DECLARE_WAIT_QUEUE_HEAD(bdi_users_wait);
+
+/* Initial write bandwidth estimate: 100MB/s */
+#define INIT_BW			(100 << (20 - PAGE_SHIFT))
+
 #ifdef CONFIG_DEBUG_FS
 #include <linux/debugfs.h>
 #include <linux/seq_file.h>
@@ -36,12 +50,18 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "BdiReclaimable:   %8lu kB\n"
 		   "BdiDirtyThresh:   %8lu kB\n"
 		   "DirtyThresh:      %8lu kB\n"
-		   "BackgroundThresh: %8lu kB\n",
+		   "BackgroundThresh: %8lu kB\n"
+		   "BdiWritten:       %8lu kB\n"
+		   "BdiWriteBandwidth:%8lu kBps\n"
+		   "BdiFlusher:       %8s\n",
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITEBACK)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_RECLAIMABLE)),
 		   K(bdi_thresh),
 		   K(dirty_thresh),
-		   K(background_thresh));
+		   K(background_thresh),
+		   (unsigned long) K(bdi_stat(bdi, BDI_WRITTEN)),
+		   K(bdi->write_bandwidth),
+		   bdi->task ? "running" : "idle");
 #undef K
 
 	return 0;
@@ -150,12 +170,15 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+BDI_SHOW(write_bandwidth, K(bdi->write_bandwidth))
+
 #define __ATTR_RW(attr) __ATTR(attr, 0644, attr##_show, attr##_store)
 
 static struct device_attribute bdi_dev_attrs[] = {
 	__ATTR_RW(read_ahead_kb),
 	__ATTR_RW(min_ratio),
 	__ATTR_RW(max_ratio),
+	__ATTR(write_bandwidth, 0444, write_bandwidth_show, NULL),
 	__ATTR_NULL,
 };
 
@@ -169,6 +192,245 @@ static __init int bdi_class_init(void)
 
 postcore_initcall(bdi_class_init);
 
+static int bdi_sched_wait(void *word)
+{
+	schedule();
+	return 0;
+}
+
+static void bdi_wakeup_forker(void)
+{
+	struct task_struct *forker = default_backing_dev_info.task;
+
+	if (forker)
+		wake_up_process(forker);
+}
+
+/*
+ * Called with bdi_list_lock held.
+ */
+int __bdi_unpin(struct backing_dev_info *bdi)
+{
+	int unlisted = list_empty(&bdi->bdi_list);
+
+	if (!--bdi->wb_users && unlisted)
+		wake_up(&bdi_users_wait);
+	return unlisted;
+}
+
+/*
+ * Called with bdi_list_lock held, which keeps bdi->task from exiting.
+ */
+void __bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages)
+{
+	bdi->wb_pages += nr_pages;
+	if (bdi->task)
+		wake_up_process(bdi->task);
+	else
+		bdi_wakeup_forker();
+}
+
+/**
+ * bdi_start_writeback - ask a device's flusher thread for writeback
+ * @bdi: the device
+ * @nr_pages: the minimum number of pages to write
+ *
+ * The flusher writes at least @nr_pages of the device's dirty data, and
+ * carries on for as long as the system is over the background dirty
+ * threshold.  A flusher is started for @bdi if it has none.
+ */
+void bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages)
+{
+	spin_lock(&bdi_list_lock);
+	__bdi_start_writeback(bdi, nr_pages);
+	spin_unlock(&bdi_list_lock);
+}
+
+/*
+ * Kick all flushers, so that they notice a changed writeback interval.
+ */
+void bdi_wakeup_flushers(void)
+{
+	struct backing_dev_info *bdi;
+
+	spin_lock(&bdi_list_lock);
+	list_for_each_entry(bdi, &bdi_list, bdi_list) {
+		if (bdi->task)
+			wake_up_process(bdi->task);
+	}
+	spin_unlock(&bdi_list_lock);
+}
+
+static int bdi_start_fn(void *ptr)
+{
+	struct backing_dev_info *bdi = ptr;
+
+	current->flags |= PF_FLUSHER | PF_SWAPWRITE;
+	set_freezable();
+
+	/* Our parent, the forker, may have been reniced.  Don't inherit that */
+	set_user_nice(current, 0);
+
+	spin_lock(&bdi_list_lock);
+	bdi->task = current;
+	spin_unlock(&bdi_list_lock);
+
+	clear_bit(BDI_pending, &bdi->state);
+	smp_mb__after_clear_bit();
+	wake_up_bit(&bdi->state, BDI_pending);
+
+	return bdi_writeback_task(bdi);
+}
+
+/*
+ * Find a registered bdi that needs a flusher thread but has none, and mark
+ * it BDI_pending so that it is neither picked twice nor freed under us.
+ */
+static struct backing_dev_info *bdi_find_idle(struct backing_dev_info *me)
+{
+	struct backing_dev_info *bdi, *found = NULL;
+
+	spin_lock(&inode_lock);
+	spin_lock(&bdi_list_lock);
+	list_for_each_entry(bdi, &bdi_list, bdi_list) {
+		if (bdi == me || bdi->task ||
+		    test_bit(BDI_pending, &bdi->state))
+			continue;
+		if (!bdi->wb_pages && !bdi_has_dirty_io(bdi))
+			continue;
+		set_bit(BDI_pending, &bdi->state);
+		found = bdi;
+		break;
+	}
+	spin_unlock(&bdi_list_lock);
+	spin_unlock(&inode_lock);
+
+	return found;
+}
+
+/*
+ * The flusher of default_backing_dev_info.  Besides writing back inodes
+ * of filesystems without a registered bdi of their own, it starts the
+ * flushers of other devices when they get dirty data and runs
+ * sync_supers() every dirty_writeback_interval.
+ */
+static int bdi_forker_task(void *ptr)
+{
+	struct backing_dev_info *me = ptr;
+	unsigned long last_sync = jiffies;
+
+	current->flags |= PF_FLUSHER | PF_SWAPWRITE;
+	set_freezable();
+	set_user_nice(current, 0);
+
+	while (!kthread_should_stop()) {
+		struct backing_dev_info *bdi;
+		struct task_struct *task;
+		long wait = MAX_SCHEDULE_TIMEOUT;
+
+		if (dirty_writeback_interval) {
+			if (time_after_eq(jiffies,
+					  last_sync + dirty_writeback_interval)) {
+				last_sync = jiffies;
+				sync_supers();
+			}
+			wait = dirty_writeback_interval;
+		}
+
+		bdi_do_writeback(me);
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		bdi = bdi_find_idle(me);
+		if (!bdi) {
+			if (!me->wb_pages)
+				schedule_timeout(wait);
+			__set_current_state(TASK_RUNNING);
+			try_to_freeze();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		task = kthread_run(bdi_start_fn, bdi, "flush-%s",
+				   dev_name(bdi->dev));
+		if (IS_ERR(task)) {
+			/*
+			 * No flusher for this device; better to write its
+			 * data back ourselves than to let it sit there.
+			 */
+			bdi_do_writeback(bdi);
+			clear_bit(BDI_pending, &bdi->state);
+			smp_mb__after_clear_bit();
+			wake_up_bit(&bdi->state, BDI_pending);
+		}
+	}
+
+	return 0;
+}
+
+static void bdi_wb_init(struct backing_dev_info *bdi)
+{
+	struct task_struct *task;
+
+	if (!bdi_cap_writeback_dirty(bdi))
+		return;
+
+	spin_lock(&bdi_list_lock);
+	list_add_tail(&bdi->bdi_list, &bdi_list);
+	spin_unlock(&bdi_list_lock);
+	set_bit(BDI_registered, &bdi->state);
+
+	if (bdi != &default_backing_dev_info)
+		return;
+
+	task = kthread_run(bdi_forker_task, bdi, "bdi-default");
+	if (IS_ERR(task)) {
+		printk(KERN_ERR "bdi: unable to start the default flusher\n");
+		return;
+	}
+	spin_lock(&bdi_list_lock);
+	bdi->task = task;
+	spin_unlock(&bdi_list_lock);
+}
+
+/*
+ * Stop the flusher of a bdi that goes away, and hand any inodes that are
+ * still dirty against it over to the default bdi.
+ */
+static void bdi_wb_shutdown(struct backing_dev_info *bdi)
+{
+	struct backing_dev_info *dst = &default_backing_dev_info;
+	struct task_struct *task;
+
+	if (!test_bit(BDI_registered, &bdi->state))
+		return;
+
+	spin_lock(&bdi_list_lock);
+	list_del_init(&bdi->bdi_list);
+	spin_unlock(&bdi_list_lock);
+	wait_event(bdi_users_wait, !bdi->wb_users);
+
+	/* From now on, newly dirtied inodes go to the default bdi */
+	spin_lock(&inode_lock);
+	clear_bit(BDI_registered, &bdi->state);
+	spin_unlock(&inode_lock);
+
+	wait_on_bit(&bdi->state, BDI_pending, bdi_sched_wait,
+			TASK_UNINTERRUPTIBLE);
+
+	spin_lock(&bdi_list_lock);
+	task = bdi->task;
+	bdi->task = NULL;
+	spin_unlock(&bdi_list_lock);
+	if (task)
+		kthread_stop(task);
+
+	spin_lock(&inode_lock);
+	list_splice_init(&bdi->b_dirty, &dst->b_dirty);
+	list_splice_init(&bdi->b_io, &dst->b_io);
+	list_splice_init(&bdi->b_more_io, &dst->b_more_io);
+	spin_unlock(&inode_lock);
+}
+
 int bdi_register(struct backing_dev_info *bdi, struct device *parent,
 		const char *fmt, ...)
 {
@@ -189,6 +451,7 @@ int bdi_register(struct backing_dev_info *bdi, struct device *parent,
 
 	bdi->dev = dev;
 	bdi_debug_register(bdi, dev_name(dev));
+	bdi_wb_init(bdi);
 
 exit:
 	return ret;
@@ -204,6 +467,7 @@ EXPORT_SYMBOL(bdi_register_dev);
 void bdi_unregister(struct backing_dev_info *bdi)
 {
 	if (bdi->dev) {
+		bdi_wb_shutdown(bdi);
 		bdi_debug_unregister(bdi);
 		device_unregister(bdi->dev);
 		bdi->dev = NULL;
@@ -222,6 +486,20 @@ int bdi_init(struct backing_dev_info *bdi)
 	bdi->max_ratio = 100;
 	bdi->max_prop_frac = PROP_FRAC_BASE;
 
+	INIT_LIST_HEAD(&bdi->bdi_list);
+	bdi->task = NULL;
+	bdi->wb_users = 0;
+	bdi->wb_pages = 0;
+	bdi->last_old_flush = jiffies;
+	INIT_LIST_HEAD(&bdi->b_dirty);
+	INIT_LIST_HEAD(&bdi->b_io);
+	INIT_LIST_HEAD(&bdi->b_more_io);
+
+	spin_lock_init(&bdi->bw_lock);
+	bdi->bw_time_stamp = jiffies;
+	bdi->written_stamp = 0;
+	bdi->write_bandwidth = INIT_BW;
+
 	for (i = 0; i < NR_BDI_STAT_ITEMS; i++) {
 		err = percpu_counter_init(&bdi->bdi_stat[i], 0);
 		if (err)
@@ -0,0 +1,386 @@
+/*
+ * linux/mm/cma.c
+ *
+ * Contiguous memory allocator.
+ *
+ * Display, camera and multimedia drivers need buffers of several
+ * megabytes of physically contiguous memory.  Traditionally they get a
+ * carveout reserved at boot which is lost to the rest of the system even
+ * while the device is idle.
+ *
+ * A cma area is reserved at boot just like such a carveout, but once the
+ * page allocator is up its pageblocks are handed to the buddy allocator
+ * as MIGRATE_CMA.  Only movable allocations fall back to those blocks and
+ * they are never converted to another migratetype, so every page in the
+ * area is either free or movable.  When the driver claims a range, the
+ * pageblocks around it are isolated, the pages in use are migrated
+ * elsewhere and the now free range is taken off the free lists.
+ *
+ * Claims can fail (a movable page may be pinned for a while by
+ * get_user_pages() or by I/O in flight) and take time, so the number of
+ * attempts, failures and the claim latency are kept per area and shown
+ * in debugfs as "cma".
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/bootmem.h>
+#include <linux/swap.h>
+#include <linux/migrate.h>
+#include <linux/mutex.h>
+#include <linux/page-isolation.h>
+#include <linux/pageblock-flags.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/debugfs.h>
+#include <linux/cma.h>
+#include "internal.h"
+
+/* Number of times a claim migrates and retries before it gives up */
+#define CMA_CLAIM_RETRIES	5
+
+/* Number of pages isolated from the LRU per call to migrate_pages() */
+#define CMA_MIGRATE_BATCH	256
+
+struct cma {
+	const char	*name;
+	unsigned long	base_pfn;
+	unsigned long	nr_pages;
+	/* Non-zero once the area has been handed to the buddy allocator */
+	int		lent;
+
+	/* Statistics, protected by cma_mutex */
+	unsigned long	claimed;	/* pages currently claimed */
+	unsigned long	attempts;
+	unsigned long	failures;
+	unsigned long	migrated;	/* pages migrated out by claims */
+	u64		total_us;	/* time spent in successful claims */
+	u64		max_us;
+};
+
+static struct cma cma_areas[CONFIG_CMA_MAX_AREAS];
+static unsigned cma_area_count;
+
+/* Serialises claims, so that no two claims isolate the same pageblock */
+static DEFINE_MUTEX(cma_mutex);
+
+/*
+ * Areas are aligned to whole free blocks of the buddy allocator, so that
+ * a free block never straddles the area boundary.
+ */
+static unsigned long cma_align_pages(void)
+{
+	return max_t(unsigned long, MAX_ORDER_NR_PAGES, pageblock_nr_pages);
+}
+
+/**
+ * cma_reserve - reserve a contiguous memory area at boot
+ * @name: name of the area, for the statistics
+ * @base: physical base address, or 0 to place the area anywhere
+ * @size: size of the area in bytes
+ *
+ * Must be called while the bootmem allocator is still active, i.e. from
+ * board map_io or reserve code.  @size is rounded up to the area
+ * alignment (4MB with the default MAX_ORDER).
+ *
+ * Returns the new area or NULL if it could not be reserved.
+ */
+struct cma * __init cma_reserve(const char *name, unsigned long base,
+				unsigned long size)
+{
+	unsigned long align = cma_align_pages() << PAGE_SHIFT;
+	struct cma *cma;
+	void *addr;
+
+	if (cma_area_count == ARRAY_SIZE(cma_areas)) {
+		printk(KERN_ERR "cma: too many areas, %s not reserved\n", name);
+		return NULL;
+	}
+
+	size = ALIGN(size, align);
+	if (!size)
+		return NULL;
+
+	if (base) {
+		if (base & (align - 1)) {
+			printk(KERN_ERR "cma: %s: base %08lx not aligned to "
+			       "%lu bytes\n", name, base, align);
+			return NULL;
+		}
+		if (reserve_bootmem(base, size, BOOTMEM_EXCLUSIVE) < 0) {
+			printk(KERN_ERR "cma: %s: failed to reserve %08lx-%08lx\n",
+			       name, base, base + size - 1);
+			return NULL;
+		}
+	} else {
+		addr = __alloc_bootmem_nopanic(size, align, 0);
+		if (!addr) {
+			printk(KERN_ERR "cma: %s: failed to allocate %lu bytes\n",
+			       name, size);
+			return NULL;
+		}
+		base = virt_to_phys(addr);
+	}
+
+	cma = &cma_areas[cma_area_count++];
+	cma->name = name;
+	cma->base_pfn = base >> PAGE_SHIFT;
+	cma->nr_pages = size >> PAGE_SHIFT;
+
+	printk(KERN_INFO "cma: reserved %lu MiB at %08lx for %s\n",
+	       size >> 20, base, name);
+	return cma;
+}
+
+unsigned long cma_base(struct cma *cma)
+{
+	return cma->base_pfn << PAGE_SHIFT;
+}
+EXPORT_SYMBOL(cma_base);
+
+unsigned long cma_size(struct cma *cma)
+{
+	return cma->nr_pages << PAGE_SHIFT;
+}
+EXPORT_SYMBOL(cma_size);
+
+/*
+ * Hand the reserved areas to the buddy allocator.  An area that spans
+ * more than one zone stays a plain carveout.
+ */
+static int __init cma_activate_areas(void)
+{
+	unsigned long pfn, end;
+	struct zone *zone;
+	struct cma *cma;
+
+	for (cma = cma_areas; cma < cma_areas + cma_area_count; cma++) {
+		end = cma->base_pfn + cma->nr_pages;
+		zone = page_zone(pfn_to_page(cma->base_pfn));
+
+		for (pfn = cma->base_pfn; pfn < end; pfn++)
+			if (!pfn_valid(pfn) || page_zone(pfn_to_page(pfn)) != zone)
+				break;
+		if (pfn < end) {
+			printk(KERN_WARNING "cma: %s spans several zones, "
+			       "keeping it reserved\n", cma->name);
+			continue;
+		}
+
+		for (pfn = cma->base_pfn; pfn < end; pfn += pageblock_nr_pages)
+			init_cma_reserved_pageblock(pfn_to_page(pfn));
+		cma->lent = 1;
+	}
+	return 0;
+}
+core_initcall(cma_activate_areas);
+
+static struct page *cma_migrate_alloc(struct page *page, unsigned long private,
+				      int **resultp)
+{
+	/* The claimed range is isolated, so this cannot land in it */
+	return alloc_page(GFP_HIGHUSER_MOVABLE);
+}
+
+/*
+ * Migrate the pages in use in [start, end) out of the range.  Pages that
+ * are not on the LRU are left alone; they are either free, about to be
+ * freed, or pinned, in which case the claim fails.
+ */
+static int cma_migrate_range(struct cma *cma, unsigned long start,
+			     unsigned long end)
+{
+	unsigned long pfn = start;
+	struct page *page;
+	LIST_HEAD(source);
+	int nr;
+	int ret;
+
+	while (pfn < end) {
+		nr = 0;
+		for (; pfn < end && nr < CMA_MIGRATE_BATCH; pfn++) {
+			page = pfn_to_page(pfn);
+			if (!page_count(page))
+				continue;
+			if (isolate_lru_page(page))
+				continue;
+			list_add_tail(&page->lru, &source);
+			nr++;
+		}
+		if (!nr)
+			continue;
+
+		/* migrate_pages() puts the pages it could not move back */
+		ret = migrate_pages(&source, cma_migrate_alloc, 0);
+		if (ret < 0)
+			return ret;
+		cma->migrated += nr - ret;
+	}
+	return 0;
+}
+
+static int cma_claim_range(struct cma *cma, unsigned long start,
+			   unsigned long end)
+{
+	unsigned long align = cma_align_pages();
+	unsigned long outer_start = start & ~(align - 1);
+	unsigned long outer_end = ALIGN(end, align);
+	int tries;
+	int ret;
+
+	ret = start_isolate_page_range(outer_start, outer_end, MIGRATE_CMA);
+	if (ret)
+		return ret;
+
+	for (tries = 0; tries < CMA_CLAIM_RETRIES; tries++) {
+		/* Get the pages sitting in LRU pagevecs onto the LRU first */
+		lru_add_drain_all();
+		ret = cma_migrate_range(cma, start, end);
+		if (ret)
+			break;
+
+		/* Migrated pages are freed to the per-cpu lists */
+		drain_all_pages();
+		ret = alloc_isolated_range(start, end);
+		if (!ret)
+			break;
+		yield();
+	}
+
+	undo_isolate_page_range(outer_start, outer_end, MIGRATE_CMA);
+	return ret;
+}
+
+/**
+ * cma_claim - take a physical range of a cma area for a device
+ * @cma: area the range lies in
+ * @paddr: page aligned physical start of the range
+ * @size: size of the range in bytes
+ *
+ * Migrates the pages currently using the range elsewhere and removes it
+ * from the page allocator.  May sleep for a while.
+ *
+ * Returns 0 on success, -EINVAL if the range is not inside @cma, -EBUSY
+ * if some page in the range could not be freed and -ENOMEM if there was
+ * no memory to migrate to.
+ */
+int cma_claim(struct cma *cma, unsigned long paddr, unsigned long size)
+{
+	unsigned long start = paddr >> PAGE_SHIFT;
+	unsigned long end = start + (PAGE_ALIGN(size) >> PAGE_SHIFT);
+	ktime_t t0;
+	u64 us;
+	int ret;
+
+	if ((paddr & ~PAGE_MASK) || start < cma->base_pfn ||
+	    end > cma->base_pfn + cma->nr_pages || end <= start)
+		return -EINVAL;
+
+	mutex_lock(&cma_mutex);
+	if (!cma->lent) {
+		cma->claimed += end - start;
+		mutex_unlock(&cma_mutex);
+		return 0;
+	}
+
+	t0 = ktime_get();
+	ret = cma_claim_range(cma, start, end);
+	us = ktime_us_delta(ktime_get(), t0);
+
+	cma->attempts++;
+	if (ret) {
+		cma->failures++;
+	} else {
+		cma->claimed += end - start;
+		cma->total_us += us;
+		if (us > cma->max_us)
+			cma->max_us = us;
+	}
+	mutex_unlock(&cma_mutex);
+
+	if (ret)
+		printk(KERN_WARNING "cma: %s: claiming %08lx-%08lx failed (%d)\n",
+		       cma->name, paddr, paddr + size - 1, ret);
+	return ret;
+}
+EXPORT_SYMBOL(cma_claim);
+
+/**
+ * cma_release - give a range taken with cma_claim() back
+ * @cma: area the range lies in
+ * @paddr: physical start of the range
+ * @size: size of the range in bytes
+ */
+void cma_release(struct cma *cma, unsigned long paddr, unsigned long size)
+{
+	unsigned long start = paddr >> PAGE_SHIFT;
+	unsigned long end = start + (PAGE_ALIGN(size) >> PAGE_SHIFT);
+	unsigned long pfn;
+
+	if (WARN_ON(start < cma->base_pfn ||
+		    end > cma->base_pfn + cma->nr_pages))
+		return;
+
+	mutex_lock(&cma_mutex);
+	cma->claimed -= end - start;
+	mutex_unlock(&cma_mutex);
+
+	if (!cma->lent)
+		return;
+
+	for (pfn = start; pfn < end; pfn++)
+		__free_page(pfn_to_page(pfn));
+}
+EXPORT_SYMBOL(cma_release);
+
+#ifdef CONFIG_DEBUG_FS
+static int cma_debug_show(struct seq_file *s, void *unused)
+{
+	struct cma *cma;
+	unsigned long succeeded;
+
+	mutex_lock(&cma_mutex);
+	for (cma = cma_areas; cma < cma_areas + cma_area_count; cma++) {
+		succeeded = cma->attempts - cma->failures;
+		seq_printf(s, "%s: %08lx-%08lx %s\n", cma->name,
+			   cma->base_pfn << PAGE_SHIFT,
+			   ((cma->base_pfn + cma->nr_pages) << PAGE_SHIFT) - 1,
+			   cma->lent ? "lent" : "reserved");
+		seq_printf(s, "    claimed    %8lu pages of %lu\n",
+			   cma->claimed, cma->nr_pages);
+		seq_printf(s, "    attempts   %8lu\n", cma->attempts);
+		seq_printf(s, "    failures   %8lu\n", cma->failures);
+		seq_printf(s, "    migrated   %8lu pages\n", cma->migrated);
+		seq_printf(s, "    latency    %8llu us avg, %llu us max\n",
+			   succeeded ?
+			   (unsigned long long)div64_u64(cma->total_us,
+							 succeeded) : 0ULL,
+			   (unsigned long long)cma->max_us);
+	}
+	mutex_unlock(&cma_mutex);
+
+	return 0;
+}
+
+static int cma_debug_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cma_debug_show, inode->i_private);
+}
+
+static const struct file_operations cma_debug_fops = {
+	.open		= cma_debug_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init cma_debugfs_init(void)
+{
+	debugfs_create_file("cma", S_IRUGO, NULL, NULL, &cma_debug_fops);
+	return 0;
+}
+late_initcall(cma_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
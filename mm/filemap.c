@@ -107,16 +107,39 @@
  *    ->dcache_lock		(proc_pid_lookup)
  */
 
+static void page_cache_tree_delete(struct address_space *mapping,
+				   struct page *page, void *shadow)
+{
+	void **slot;
+
+	if (!shadow) {
+		radix_tree_delete(&mapping->page_tree, page->index);
+		return;
+	}
+
+	/* The shadow entry takes over the slot, minus the page's tags */
+	radix_tree_tag_clear(&mapping->page_tree, page->index,
+			     PAGECACHE_TAG_DIRTY);
+	radix_tree_tag_clear(&mapping->page_tree, page->index,
+			     PAGECACHE_TAG_WRITEBACK);
+	slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+	radix_tree_replace_slot(slot, shadow);
+	workingset_shadow_added(mapping);
+}
+
 /*
  * Remove a page from the page cache and free it. Caller has to make
  * sure the page is locked and that nobody else uses it - or that usage
  * is safe.  The caller must hold the mapping's tree_lock.
+ *
+ * If @shadow is not NULL it is left in the page's slot to remember the
+ * eviction, see mm/workingset.c.
  */
-void __remove_from_page_cache(struct page *page)
+void __remove_from_page_cache_shadow(struct page *page, void *shadow)
 {
 	struct address_space *mapping = page->mapping;
 
-	radix_tree_delete(&mapping->page_tree, page->index);
+	page_cache_tree_delete(mapping, page, shadow);
 	page->mapping = NULL;
 	mapping->nrpages--;
 	__dec_zone_page_state(page, NR_FILE_PAGES);
@@ -136,6 +159,11 @@ void __remove_from_page_cache(struct page *page)
 	}
 }
 
+void __remove_from_page_cache(struct page *page)
+{
+	__remove_from_page_cache_shadow(page, NULL);
+}
+
 void remove_from_page_cache(struct page *page)
 {
 	struct address_space *mapping = page->mapping;
@@ -442,18 +470,35 @@ int filemap_write_and_wait_range(struct address_space *mapping,
 	return err;
 }
 
-/**
- * add_to_page_cache_locked - add a locked page to the pagecache
- * @page:	page to add
- * @mapping:	the page's address_space
- * @offset:	page index
- * @gfp_mask:	page allocation mode
- *
- * This function is used to add a page to the pagecache. It must be locked.
- * This function does not add the page to the LRU.  The caller must do that.
+/*
+ * Insert the page into its slot, replacing the shadow entry of an
+ * earlier eviction if there is one.  The shadow is returned in *@shadowp
+ * when the caller is interested in it.
  */
-int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
-		pgoff_t offset, gfp_t gfp_mask)
+static int page_cache_tree_insert(struct address_space *mapping,
+				  struct page *page, void **shadowp)
+{
+	void **slot;
+
+	slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+	if (slot) {
+		void *p = radix_tree_deref_slot(slot);
+
+		if (!radix_tree_exceptional_entry(p))
+			return -EEXIST;
+		radix_tree_replace_slot(slot, page);
+		workingset_shadow_removed(mapping);
+		if (shadowp)
+			*shadowp = p;
+		return 0;
+	}
+	return radix_tree_insert(&mapping->page_tree, page->index, page);
+}
+
+static int __add_to_page_cache_locked(struct page *page,
+				      struct address_space *mapping,
+				      pgoff_t offset, gfp_t gfp_mask,
+				      void **shadowp)
 {
 	int error;
 
@@ -471,7 +516,7 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 		page->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		error = radix_tree_insert(&mapping->page_tree, offset, page);
+		error = page_cache_tree_insert(mapping, page, shadowp);
 		if (likely(!error)) {
 			mapping->nrpages++;
 			__inc_zone_page_state(page, NR_FILE_PAGES);
@@ -488,11 +533,29 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 out:
 	return error;
 }
+
+/**
+ * add_to_page_cache_locked - add a locked page to the pagecache
+ * @page:	page to add
+ * @mapping:	the page's address_space
+ * @offset:	page index
+ * @gfp_mask:	page allocation mode
+ *
+ * This function is used to add a page to the pagecache. It must be locked.
+ * This function does not add the page to the LRU.  The caller must do that.
+ */
+int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
+		pgoff_t offset, gfp_t gfp_mask)
+{
+	return __add_to_page_cache_locked(page, mapping, offset,
+					  gfp_mask, NULL);
+}
 EXPORT_SYMBOL(add_to_page_cache_locked);
 
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t offset, gfp_t gfp_mask)
 {
+	void *shadow = NULL;
 	int ret;
 
 	/*
@@ -504,14 +567,27 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 	if (mapping_cap_swap_backed(mapping))
 		SetPageSwapBacked(page);
 
-	ret = add_to_page_cache(page, mapping, offset, gfp_mask);
-	if (ret == 0) {
-		if (page_is_file_cache(page))
-			lru_cache_add_file(page);
-		else
-			lru_cache_add_active_anon(page);
+	__set_page_locked(page);
+	ret = __add_to_page_cache_locked(page, mapping, offset,
+					 gfp_mask, &shadow);
+	if (unlikely(ret)) {
+		__clear_page_locked(page);
+		return ret;
 	}
-	return ret;
+
+	if (page_is_file_cache(page)) {
+		/*
+		 * A page that was evicted recently enough to still be
+		 * part of the working set skips the inactive list.
+		 */
+		if (shadow && workingset_refault(shadow)) {
+			workingset_activation(page);
+			lru_cache_add_active_file(page);
+		} else
+			lru_cache_add_file(page);
+	} else
+		lru_cache_add_active_anon(page);
+	return 0;
 }
 
 #ifdef CONFIG_NUMA
@@ -564,6 +640,44 @@ void wait_on_page_bit(struct page *page, int bit_nr)
 }
 EXPORT_SYMBOL(wait_on_page_bit);
 
+/**
+ * wait_on_page_locked_async - queue a waiter for the unlock of a page
+ * @page: the page
+ * @wait: the waiter, with its ->func set up by the caller
+ *
+ * Starts the I/O the page may be locked for and adds @wait to the wait
+ * queue of @page.  The queue is hashed and shared with other pages, so
+ * @wait->func has to check the wait_bit_key it is woken with.
+ *
+ * Returns -EAGAIN, with @wait left unqueued, if the page is not locked.
+ * The caller must hold a reference on the page.
+ */
+int wait_on_page_locked_async(struct page *page, wait_queue_t *wait)
+{
+	wait_queue_head_t *q = page_waitqueue(page);
+	struct address_space *mapping;
+	unsigned long flags;
+	int ret = 0;
+
+	/* as in sync_page(), but without sleeping for the I/O */
+	smp_mb();
+	mapping = page_mapping(page);
+	if (mapping && mapping->a_ops && mapping->a_ops->sync_page)
+		mapping->a_ops->sync_page(page);
+
+	spin_lock_irqsave(&q->lock, flags);
+	__add_wait_queue(q, wait);
+	smp_mb();
+	if (!PageLocked(page)) {
+		__remove_wait_queue(q, wait);
+		ret = -EAGAIN;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL(wait_on_page_locked_async);
+
 /**
  * unlock_page - unlock a locked page
  * @page: the page
@@ -664,6 +778,12 @@ repeat:
 		if (unlikely(!page || page == RADIX_TREE_RETRY))
 			goto repeat;
 
+		/* The shadow entry of an evicted page, see workingset.c */
+		if (radix_tree_exceptional_entry(page)) {
+			page = NULL;
+			goto out;
+		}
+
 		if (!page_cache_get_speculative(page))
 			goto repeat;
 
@@ -677,6 +797,7 @@ repeat:
 			goto repeat;
 		}
 	}
+out:
 	rcu_read_unlock();
 
 	return page;
@@ -801,6 +922,10 @@ repeat:
 		if (unlikely(page == RADIX_TREE_RETRY))
 			goto restart;
 
+		/* Evicted since the lookup, the slot holds its shadow */
+		if (unlikely(radix_tree_exceptional_entry(page)))
+			continue;
+
 		if (!page_cache_get_speculative(page))
 			goto repeat;
 
@@ -854,6 +979,9 @@ repeat:
 		if (unlikely(page == RADIX_TREE_RETRY))
 			goto restart;
 
+		if (unlikely(radix_tree_exceptional_entry(page)))
+			break;
+
 		if (page->mapping == NULL || page->index != index)
 			break;
 
@@ -911,6 +1039,10 @@ repeat:
 		if (unlikely(page == RADIX_TREE_RETRY))
 			goto restart;
 
+		/* Evicted since the lookup, the slot holds its shadow */
+		if (unlikely(radix_tree_exceptional_entry(page)))
+			continue;
+
 		if (!page_cache_get_speculative(page))
 			goto repeat;
 
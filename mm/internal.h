@@ -51,6 +51,13 @@ extern void putback_lru_page(struct page *page);
  */
 extern unsigned long highest_memmap_pfn;
 extern void __free_pages_bootmem(struct page *page, unsigned int order);
+#ifdef CONFIG_COMPACTION
+extern int split_free_page(struct page *page);
+#endif
+#ifdef CONFIG_CMA
+extern void init_cma_reserved_pageblock(struct page *page);
+extern int alloc_isolated_range(unsigned long start_pfn, unsigned long end_pfn);
+#endif
 
 /*
  * function for dealing with page's order in buddy system.
@@ -36,6 +36,7 @@
 #include <linux/vmalloc.h>
 #include <linux/mm_inline.h>
 #include <linux/page_cgroup.h>
+#include <linux/vmpressure.h>
 #include "internal.h"
 
 #include <asm/uaccess.h>
@@ -166,6 +167,9 @@ struct mem_cgroup {
 
 	unsigned int	swappiness;
 
+	/* reclaim efficiency reported to memory.pressure_level readers */
+	struct vmpressure vmpressure;
+
 	/*
 	 * statistics. This must be placed at the end of memcg.
 	 */
@@ -2020,6 +2024,42 @@ static int mem_cgroup_swappiness_write(struct cgroup *cgrp, struct cftype *cft,
 	return 0;
 }
 
+struct vmpressure *memcg_to_vmpressure(struct mem_cgroup *memcg)
+{
+	return &memcg->vmpressure;
+}
+
+struct vmpressure *vmpressure_parent(struct vmpressure *vmpr)
+{
+	struct mem_cgroup *memcg;
+
+	memcg = container_of(vmpr, struct mem_cgroup, vmpressure);
+	memcg = parent_mem_cgroup(memcg);
+	if (!memcg)
+		return NULL;
+	return memcg_to_vmpressure(memcg);
+}
+
+static ssize_t mem_cgroup_pressure_read(struct cgroup *cgrp,
+					struct cftype *cft, struct file *file,
+					char __user *buf, size_t nbytes,
+					loff_t *ppos)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	return vmpressure_file_read(memcg_to_vmpressure(memcg), file,
+				    buf, nbytes, ppos);
+}
+
+static unsigned int mem_cgroup_pressure_poll(struct cgroup *cgrp,
+					     struct cftype *cft,
+					     struct file *file,
+					     struct poll_table_struct *pt)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	return vmpressure_file_poll(memcg_to_vmpressure(memcg), file, pt);
+}
 
 static struct cftype mem_cgroup_files[] = {
 	{
@@ -2063,6 +2103,11 @@ static struct cftype mem_cgroup_files[] = {
 		.read_u64 = mem_cgroup_swappiness_read,
 		.write_u64 = mem_cgroup_swappiness_write,
 	},
+	{
+		.name = "pressure_level",
+		.read = mem_cgroup_pressure_read,
+		.poll = mem_cgroup_pressure_poll,
+	},
 };
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR_SWAP
@@ -2262,6 +2307,7 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 	}
 	mem->last_scanned_child = NULL;
 	spin_lock_init(&mem->reclaim_param_lock);
+	vmpressure_init(&mem->vmpressure);
 
 	if (parent)
 		mem->swappiness = get_swappiness(parent);
@@ -2285,6 +2331,8 @@ static void mem_cgroup_destroy(struct cgroup_subsys *ss,
 	struct mem_cgroup *mem = mem_cgroup_from_cont(cont);
 	struct mem_cgroup *last_scanned_child = mem->last_scanned_child;
 
+	vmpressure_cleanup(&mem->vmpressure);
+
 	if (last_scanned_child) {
 		VM_BUG_ON(!mem_cgroup_is_obsolete(last_scanned_child));
 		mem_cgroup_put(last_scanned_child);
@@ -46,6 +46,7 @@
 #include <linux/page-isolation.h>
 #include <linux/page_cgroup.h>
 #include <linux/debugobjects.h>
+#include <linux/compaction.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -695,7 +696,12 @@ static struct page *__rmqueue_smallest(struct zone *zone, unsigned int order,
 static int fallbacks[MIGRATE_TYPES][MIGRATE_TYPES-1] = {
 	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,   MIGRATE_RESERVE },
 	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,   MIGRATE_RESERVE },
+#ifdef CONFIG_CMA
+	[MIGRATE_MOVABLE]     = { MIGRATE_CMA,         MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
+	[MIGRATE_CMA]         = { MIGRATE_RESERVE }, /* Never used */
+#else
 	[MIGRATE_MOVABLE]     = { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
+#endif
 	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE,     MIGRATE_RESERVE,   MIGRATE_RESERVE }, /* Never used */
 };
 
@@ -786,7 +792,7 @@ static struct page *__rmqueue_fallback(struct zone *zone, int order,
 
 			/* MIGRATE_RESERVE handled later if necessary */
 			if (migratetype == MIGRATE_RESERVE)
-				continue;
+				break;
 
 			area = &(zone->free_area[current_order]);
 			if (list_empty(&area->free_list[migratetype]))
@@ -800,10 +806,12 @@ static struct page *__rmqueue_fallback(struct zone *zone, int order,
 			 * If breaking a large block of pages, move all free
 			 * pages to the preferred allocation list. If falling
 			 * back for a reclaimable kernel allocation, be more
-			 * agressive about taking ownership of free pages
+			 * agressive about taking ownership of free pages.
+			 * CMA pageblocks are only borrowed, never claimed.
 			 */
-			if (unlikely(current_order >= (pageblock_order >> 1)) ||
-					start_migratetype == MIGRATE_RECLAIMABLE) {
+			if (!is_migrate_cma(migratetype) &&
+			    (unlikely(current_order >= (pageblock_order >> 1)) ||
+					start_migratetype == MIGRATE_RECLAIMABLE)) {
 				unsigned long pages;
 				pages = move_freepages_block(zone, page,
 								start_migratetype);
@@ -822,7 +830,8 @@ static struct page *__rmqueue_fallback(struct zone *zone, int order,
 			__mod_zone_page_state(zone, NR_FREE_PAGES,
 							-(1UL << order));
 
-			if (current_order == pageblock_order)
+			if (current_order == pageblock_order &&
+			    !is_migrate_cma(migratetype))
 				set_pageblock_migratetype(page,
 							start_migratetype);
 
@@ -1000,6 +1009,7 @@ static void free_hot_cold_page(struct page *page, int cold)
 	struct zone *zone = page_zone(page);
 	struct per_cpu_pages *pcp;
 	unsigned long flags;
+	int migratetype;
 
 	if (PageAnon(page))
 		page->mapping = NULL;
@@ -1020,7 +1030,14 @@ static void free_hot_cold_page(struct page *page, int cold)
 		list_add_tail(&page->lru, &pcp->list);
 	else
 		list_add(&page->lru, &pcp->list);
-	set_page_private(page, get_pageblock_migratetype(page));
+	/*
+	 * Pages of CMA pageblocks are only ever handed out to movable
+	 * allocations, so let those pick them up from the pcp list.
+	 */
+	migratetype = get_pageblock_migratetype(page);
+	if (is_migrate_cma(migratetype))
+		migratetype = MIGRATE_MOVABLE;
+	set_page_private(page, migratetype);
 	pcp->count++;
 	if (pcp->count >= pcp->high) {
 		free_pages_bulk(zone, pcp->batch, &pcp->list, 0);
@@ -1058,6 +1075,53 @@ void split_page(struct page *page, unsigned int order)
 		set_page_refcounted(page + i);
 }
 
+#ifdef CONFIG_COMPACTION
+/*
+ * Similar to split_page except the page is already free. As this is only
+ * being used for migration, the migratetype of the block also changes.
+ * The caller must hold zone->lock.  Returns the number of pages split
+ * off, or 0 if taking them would push the zone below its low watermark.
+ */
+int split_free_page(struct page *page)
+{
+	unsigned int order;
+	unsigned long watermark;
+	struct zone *zone;
+
+	BUG_ON(!PageBuddy(page));
+
+	zone = page_zone(page);
+	order = page_order(page);
+
+	/* Obey watermarks as if the page was being allocated */
+	watermark = zone->pages_low + (1 << order);
+	if (!zone_watermark_ok(zone, 0, watermark, 0, 0))
+		return 0;
+
+	/* Remove page from free list */
+	list_del(&page->lru);
+	zone->free_area[order].nr_free--;
+	rmv_page_order(page);
+	__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+
+	/* Split into individual pages */
+	set_page_refcounted(page);
+	split_page(page, order);
+
+	if (order >= pageblock_order - 1) {
+		struct page *endpage = page + (1 << order) - 1;
+
+		for (; page < endpage; page += pageblock_nr_pages) {
+			if (is_migrate_cma(get_pageblock_migratetype(page)))
+				continue;
+			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+		}
+	}
+
+	return 1 << order;
+}
+#endif
+
 /*
  * Really, prep_compound_page() should be called from __rmqueue_bulk().  But
  * we cheat by calling it from here, in the order > 0 path.  Saves a branch
@@ -1461,6 +1525,57 @@ try_next_zone:
 	return page;
 }
 
+#ifdef CONFIG_COMPACTION
+/*
+ * High-order allocations usually fail for want of contiguous free pages
+ * rather than of free memory.  Try compacting the zones first, reclaim
+ * would throw out far more pages than the request needs.
+ */
+static struct page *
+__alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
+	struct zonelist *zonelist, enum zone_type high_zoneidx,
+	nodemask_t *nodemask, int alloc_flags)
+{
+	unsigned long compact_result;
+	struct page *page;
+
+	if (!order)
+		return NULL;
+
+	current->flags |= PF_MEMALLOC;
+	compact_result = try_to_compact_pages(zonelist, order, gfp_mask,
+						nodemask);
+	current->flags &= ~PF_MEMALLOC;
+
+	if (compact_result == COMPACT_SKIPPED)
+		return NULL;
+
+	/* Page migration frees to the PCP lists but we want merging */
+	drain_pages(get_cpu());
+	put_cpu();
+
+	page = get_page_from_freelist(gfp_mask, nodemask, order, zonelist,
+					high_zoneidx, alloc_flags);
+	if (page) {
+		count_vm_event(COMPACTSUCCESS);
+		return page;
+	}
+
+	count_vm_event(COMPACTFAIL);
+	cond_resched();
+
+	return NULL;
+}
+#else
+static inline struct page *
+__alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
+	struct zonelist *zonelist, enum zone_type high_zoneidx,
+	nodemask_t *nodemask, int alloc_flags)
+{
+	return NULL;
+}
+#endif /* CONFIG_COMPACTION */
+
 /*
  * This is the 'heart' of the zoned buddy allocator.
  */
@@ -1572,6 +1687,12 @@ nofail_alloc:
 
 	cond_resched();
 
+	/* Try memory compaction for high-order allocations before reclaim */
+	page = __alloc_pages_direct_compact(gfp_mask, order, zonelist,
+					high_zoneidx, nodemask, alloc_flags);
+	if (page)
+		goto got_pg;
+
 	/* We now go into synchronous reclaim */
 	cpuset_memory_pressure_bump();
 	/*
@@ -4721,7 +4842,8 @@ int set_migratetype_isolate(struct page *page)
 	/*
 	 * In future, more migrate types will be able to be isolation target.
 	 */
-	if (get_pageblock_migratetype(page) != MIGRATE_MOVABLE)
+	if (get_pageblock_migratetype(page) != MIGRATE_MOVABLE &&
+	    !is_migrate_cma(get_pageblock_migratetype(page)))
 		goto out;
 	set_pageblock_migratetype(page, MIGRATE_ISOLATE);
 	move_freepages_block(zone, page, MIGRATE_ISOLATE);
@@ -4733,7 +4855,7 @@ out:
 	return ret;
 }
 
-void unset_migratetype_isolate(struct page *page)
+void unset_migratetype_isolate(struct page *page, int migratetype)
 {
 	struct zone *zone;
 	unsigned long flags;
@@ -4741,12 +4863,102 @@ void unset_migratetype_isolate(struct page *page)
 	spin_lock_irqsave(&zone->lock, flags);
 	if (get_pageblock_migratetype(page) != MIGRATE_ISOLATE)
 		goto out;
-	set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-	move_freepages_block(zone, page, MIGRATE_MOVABLE);
+	set_pageblock_migratetype(page, migratetype);
+	move_freepages_block(zone, page, migratetype);
 out:
 	spin_unlock_irqrestore(&zone->lock, flags);
 }
 
+#ifdef CONFIG_CMA
+/*
+ * Hand a pageblock that was reserved at boot for the contiguous memory
+ * allocator over to the buddy allocator as MIGRATE_CMA.
+ */
+void __init init_cma_reserved_pageblock(struct page *page)
+{
+	unsigned i = pageblock_nr_pages;
+	struct page *p = page;
+
+	do {
+		__ClearPageReserved(p);
+		set_page_count(p, 0);
+	} while (++p, --i);
+
+	set_pageblock_migratetype(page, MIGRATE_CMA);
+	set_page_refcounted(page);
+	__free_pages(page, pageblock_order);
+	totalram_pages += pageblock_nr_pages;
+}
+
+/* Return the first pfn of the free buddy block covering @pfn, or -1UL. */
+static unsigned long free_block_start(unsigned long pfn)
+{
+	struct page *page;
+	unsigned long head;
+	int order;
+
+	for (order = 0; order < MAX_ORDER; order++) {
+		head = pfn & ~((1UL << order) - 1);
+		page = pfn_to_page(head);
+		if (PageBuddy(page) && page_order(page) >= order)
+			return head;
+	}
+	return -1UL;
+}
+
+/*
+ * Take the free pages in [start_pfn, end_pfn) off the buddy lists and
+ * give them to the caller as order-0 pages with a reference count of
+ * one.  The range must lie in a single zone and the pageblocks around it
+ * must be isolated, up to MAX_ORDER_NR_PAGES alignment, so that the free
+ * blocks covering it cannot change under us.  Parts of a free block that
+ * stick out of the range are put back on the (isolated) free lists.
+ *
+ * Returns -EBUSY and leaves the free lists untouched if any page in the
+ * range is not free.
+ */
+int alloc_isolated_range(unsigned long start_pfn, unsigned long end_pfn)
+{
+	struct zone *zone = page_zone(pfn_to_page(start_pfn));
+	unsigned long pfn, head, next;
+	unsigned long flags;
+	struct page *page;
+	int order;
+
+	spin_lock_irqsave(&zone->lock, flags);
+	for (pfn = start_pfn; pfn < end_pfn; pfn = next) {
+		head = free_block_start(pfn);
+		if (head == -1UL) {
+			spin_unlock_irqrestore(&zone->lock, flags);
+			return -EBUSY;
+		}
+		next = head + (1UL << page_order(pfn_to_page(head)));
+	}
+
+	for (pfn = start_pfn; pfn < end_pfn; pfn = next) {
+		head = free_block_start(pfn);
+		page = pfn_to_page(head);
+		order = page_order(page);
+
+		list_del(&page->lru);
+		rmv_page_order(page);
+		zone->free_area[order].nr_free--;
+		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+
+		next = head + (1UL << order);
+		for (; head < next; head++) {
+			page = pfn_to_page(head);
+			if (head < start_pfn || head >= end_pfn)
+				__free_one_page(page, zone, 0);
+			else
+				set_page_refcounted(page);
+		}
+	}
+	spin_unlock_irqrestore(&zone->lock, flags);
+	return 0;
+}
+#endif /* CONFIG_CMA */
+
 #ifdef CONFIG_MEMORY_HOTREMOVE
 /*
  * All pages in the range must be isolated before calling this.
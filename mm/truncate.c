@@ -135,6 +135,39 @@ invalidate_complete_page(struct address_space *mapping, struct page *page)
 	return ret;
 }
 
+/*
+ * Drop the shadow entries of evicted pages in [start, end], so that the
+ * radix tree can be freed along with the inode.
+ */
+static void clear_shadow_entries(struct address_space *mapping,
+				 pgoff_t start, pgoff_t end)
+{
+	void *shadows[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	pgoff_t next = start;
+	unsigned int nr, i;
+
+	while (mapping->nrshadows) {
+		spin_lock_irq(&mapping->tree_lock);
+		nr = radix_tree_gang_lookup_exceptional(&mapping->page_tree,
+					shadows, indices, next, PAGEVEC_SIZE);
+		for (i = 0; i < nr; i++) {
+			if (indices[i] > end)
+				break;
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			workingset_shadow_removed(mapping);
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+
+		if (i < nr || nr < PAGEVEC_SIZE)
+			break;
+		next = indices[nr - 1] + 1;
+		if (!next)
+			break;
+		cond_resched();
+	}
+}
+
 /**
  * truncate_inode_pages - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -168,7 +201,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	pgoff_t next;
 	int i;
 
-	if (mapping->nrpages == 0)
+	if (mapping->nrpages == 0 && mapping->nrshadows == 0)
 		return;
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
@@ -251,6 +284,10 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		}
 		pagevec_release(&pvec);
 	}
+
+	/* Reclaim may have left shadows of pages it raced us for */
+	if (mapping->nrshadows)
+		clear_shadow_entries(mapping, start, end);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
@@ -29,6 +29,16 @@
 #include <asm/uaccess.h>
 #include <asm/tlbflush.h>
 
+/*
+ * Architectures that can map 1 << VMAP_LARGE_ORDER contiguous pages with
+ * one TLB entry get vmalloc areas backed by such contiguous chunks where
+ * the allocator can provide them.  Only those areas, and vmap()s of pages
+ * that hold such a chunk, are aligned for it (VM_LARGE).
+ */
+#ifndef CONFIG_HAVE_ARCH_VMAP_LARGE
+#define VMAP_LARGE_ORDER	0
+#endif
+#define VMAP_LARGE_PAGES	(1U << VMAP_LARGE_ORDER)
 
 /*** Page table manipulation functions ***/
 
@@ -1065,6 +1075,8 @@ static struct vm_struct *__get_vm_area_node(unsigned long size,
 			bit = PAGE_SHIFT;
 
 		align = 1ul << bit;
+	} else if (flags & VM_LARGE) {
+		align = VMAP_LARGE_PAGES << PAGE_SHIFT;
 	}
 
 	size = PAGE_ALIGN(size);
@@ -1271,6 +1283,28 @@ void vunmap(const void *addr)
 }
 EXPORT_SYMBOL(vunmap);
 
+/*
+ * Does @pages hold a naturally aligned, physically contiguous chunk at a
+ * large page boundary of the area, i.e. is aligning the area worth it?
+ */
+static int vmap_has_large_chunk(struct page **pages, unsigned int count)
+{
+	unsigned int i, j;
+	unsigned long pfn;
+
+	for (i = 0; i + VMAP_LARGE_PAGES <= count; i += VMAP_LARGE_PAGES) {
+		pfn = page_to_pfn(pages[i]);
+		if (pfn & (VMAP_LARGE_PAGES - 1))
+			continue;
+		for (j = 1; j < VMAP_LARGE_PAGES; j++)
+			if (page_to_pfn(pages[i + j]) != pfn + j)
+				break;
+		if (j == VMAP_LARGE_PAGES)
+			return 1;
+	}
+	return 0;
+}
+
 /**
  *	vmap  -  map an array of pages into virtually contiguous space
  *	@pages:		array of page pointers
@@ -1289,6 +1323,9 @@ void *vmap(struct page **pages, unsigned int count,
 	if (count > num_physpages)
 		return NULL;
 
+	if (VMAP_LARGE_ORDER && vmap_has_large_chunk(pages, count))
+		flags |= VM_LARGE;
+
 	area = get_vm_area_caller((count << PAGE_SHIFT), flags,
 					__builtin_return_address(0));
 	if (!area)
@@ -1298,18 +1335,54 @@ void *vmap(struct page **pages, unsigned int count,
 		vunmap(area->addr);
 		return NULL;
 	}
+	arch_vmap_large_pages((unsigned long)area->addr,
+			      (unsigned long)area->addr + (count << PAGE_SHIFT));
 
 	return area->addr;
 }
 EXPORT_SYMBOL(vmap);
 
+/*
+ * Try to get VMAP_LARGE_PAGES contiguous pages for a vmalloc area.  This
+ * is only an optimisation, so don't make any effort if memory is
+ * fragmented: no reclaim, no retries.  The chunk is split so that vfree()
+ * can free the pages one by one.
+ */
+static struct page *vmalloc_alloc_large(int node, gfp_t gfp_mask)
+{
+	struct page *page;
+
+	gfp_mask = (gfp_mask & ~__GFP_WAIT) | __GFP_NOWARN | __GFP_NORETRY;
+	if (node < 0)
+		page = alloc_pages(gfp_mask, VMAP_LARGE_ORDER);
+	else
+		page = alloc_pages_node(node, gfp_mask, VMAP_LARGE_ORDER);
+	if (page)
+		split_page(page, VMAP_LARGE_ORDER);
+	return page;
+}
+
 static void *__vmalloc_node(unsigned long size, gfp_t gfp_mask, pgprot_t prot,
 			    int node, void *caller);
+static void vmalloc_free_large(struct page *page)
+{
+	unsigned int i;
+
+	for (i = 0; i < VMAP_LARGE_PAGES; i++)
+		__free_page(page + i);
+}
+
+/*
+ * @first is a large chunk for the start of the area that the caller
+ * already got, or NULL.  Only VM_LARGE areas are backed by large chunks.
+ */
 static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
-				 pgprot_t prot, int node, void *caller)
+				 pgprot_t prot, int node, void *caller,
+				 struct page *first)
 {
 	struct page **pages;
-	unsigned int nr_pages, array_size, i;
+	unsigned int nr_pages, array_size, i, j;
+	int large = VMAP_LARGE_ORDER && (area->flags & VM_LARGE);
 
 	nr_pages = (area->size - PAGE_SIZE) >> PAGE_SHIFT;
 	array_size = (nr_pages * sizeof(struct page *));
@@ -1328,6 +1401,8 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 	area->pages = pages;
 	area->caller = caller;
 	if (!area->pages) {
+		if (first)
+			vmalloc_free_large(first);
 		remove_vm_area(area->addr);
 		kfree(area);
 		return NULL;
@@ -1336,6 +1411,23 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 	for (i = 0; i < area->nr_pages; i++) {
 		struct page *page;
 
+		if (large && !(i & (VMAP_LARGE_PAGES - 1)) &&
+		    area->nr_pages - i >= VMAP_LARGE_PAGES) {
+			if (first) {
+				page = first;
+				first = NULL;
+			} else
+				page = vmalloc_alloc_large(node, gfp_mask);
+			if (page) {
+				for (j = 0; j < VMAP_LARGE_PAGES; j++)
+					area->pages[i + j] = page + j;
+				i += VMAP_LARGE_PAGES - 1;
+				continue;
+			}
+			/* Don't retry for every chunk of a big area */
+			large = 0;
+		}
+
 		if (node < 0)
 			page = alloc_page(gfp_mask);
 		else
@@ -1351,6 +1443,8 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 
 	if (map_vm_area(area, prot, &pages))
 		goto fail;
+	arch_vmap_large_pages((unsigned long)area->addr,
+			      (unsigned long)area->addr + area->size - PAGE_SIZE);
 	return area->addr;
 
 fail:
@@ -1361,7 +1455,7 @@ fail:
 void *__vmalloc_area(struct vm_struct *area, gfp_t gfp_mask, pgprot_t prot)
 {
 	return __vmalloc_area_node(area, gfp_mask, prot, -1,
-					__builtin_return_address(0));
+					__builtin_return_address(0), NULL);
 }
 
 /**
@@ -1380,18 +1474,33 @@ static void *__vmalloc_node(unsigned long size, gfp_t gfp_mask, pgprot_t prot,
 						int node, void *caller)
 {
 	struct vm_struct *area;
+	struct page *first = NULL;
+	unsigned long flags = VM_ALLOC;
 
 	size = PAGE_ALIGN(size);
 	if (!size || (size >> PAGE_SHIFT) > num_physpages)
 		return NULL;
 
-	area = __get_vm_area_node(size, VM_ALLOC, VMALLOC_START, VMALLOC_END,
+	/*
+	 * Only align the area for large pages if we can get the first
+	 * chunk: the alignment costs vmalloc space.
+	 */
+	if (VMAP_LARGE_ORDER && size >= (VMAP_LARGE_PAGES << PAGE_SHIFT)) {
+		first = vmalloc_alloc_large(node, gfp_mask);
+		if (first)
+			flags |= VM_LARGE;
+	}
+
+	area = __get_vm_area_node(size, flags, VMALLOC_START, VMALLOC_END,
 						node, gfp_mask, caller);
 
-	if (!area)
+	if (!area) {
+		if (first)
+			vmalloc_free_large(first);
 		return NULL;
+	}
 
-	return __vmalloc_area_node(area, gfp_mask, prot, node, caller);
+	return __vmalloc_area_node(area, gfp_mask, prot, node, caller, first);
 }
 
 void *__vmalloc(unsigned long size, gfp_t gfp_mask, pgprot_t prot)
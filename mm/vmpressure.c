@@ -0,0 +1,345 @@
+/*
+ * linux/mm/vmpressure.c
+ *
+ * Memory pressure level notification.
+ *
+ * The reclaim paths report how many pages they scanned and how many of
+ * those they managed to free.  Once a window worth of pages has been
+ * scanned the ratio is turned into a pressure level (low, medium or
+ * critical) which is handed to userspace through pollable files, so that
+ * it can drop caches well before the low memory killer has to step in.
+ *
+ * The global level is exported as /proc/vmpressure and each memory
+ * cgroup has its own memory.pressure_level file.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/proc_fs.h>
+#include <linux/swap.h>
+#include <linux/vmpressure.h>
+
+/*
+ * Number of scanned pages after which the reclaim efficiency is turned
+ * into a pressure level.  Smaller windows give faster but noisier
+ * notifications; 512 pages (2MB) is a few reclaim batches.
+ */
+static const unsigned long vmpressure_win = SWAP_CLUSTER_MAX * 16;
+
+/*
+ * Reclaim efficiency thresholds, in percent of scanned pages that could
+ * not be reclaimed.
+ */
+static const unsigned int vmpressure_level_med = 60;
+static const unsigned int vmpressure_level_critical = 95;
+
+/*
+ * When direct reclaim has to lower its priority this far the allocating
+ * task is stalled scanning a tenth of the LRU or more: report critical
+ * pressure no matter how many pages were reclaimed on the way.
+ */
+static const int vmpressure_level_critical_prio = 3;	/* ilog2(100 / 10) */
+
+static const char *vmpressure_str_levels[] = {
+	[VMPRESSURE_LOW] = "low",
+	[VMPRESSURE_MEDIUM] = "medium",
+	[VMPRESSURE_CRITICAL] = "critical",
+};
+
+static void vmpressure_work_fn(struct work_struct *work);
+
+static struct vmpressure global_vmpressure = {
+	.sr_lock = __SPIN_LOCK_UNLOCKED(global_vmpressure.sr_lock),
+	.wait = __WAIT_QUEUE_HEAD_INITIALIZER(global_vmpressure.wait),
+	.work = __WORK_INITIALIZER(global_vmpressure.work, vmpressure_work_fn),
+};
+
+static struct vmpressure *work_to_vmpressure(struct work_struct *work)
+{
+	return container_of(work, struct vmpressure, work);
+}
+
+static enum vmpressure_levels vmpressure_level(unsigned long pressure)
+{
+	if (pressure >= vmpressure_level_critical)
+		return VMPRESSURE_CRITICAL;
+	else if (pressure >= vmpressure_level_med)
+		return VMPRESSURE_MEDIUM;
+	return VMPRESSURE_LOW;
+}
+
+static enum vmpressure_levels vmpressure_calc_level(unsigned long scanned,
+						    unsigned long reclaimed)
+{
+	unsigned long scale = scanned + reclaimed;
+	unsigned long pressure = 0;
+
+	/*
+	 * reclaimed can be greater than scanned, e.g. when slab pages
+	 * freed by the shrinkers are added to it without any scanned
+	 * pages to go with them. That's no pressure at all, and the
+	 * calculation below would underflow into a critical level.
+	 */
+	if (reclaimed >= scanned)
+		goto out;
+	/*
+	 * We calculate the ratio (in percents) of how many pages were
+	 * scanned vs. reclaimed in a given time frame (window). Note that
+	 * time is in VM reclaimer's "ticks", i.e. number of pages
+	 * scanned. This makes it possible to set desired reaction time
+	 * and serves as a ratelimit.
+	 */
+	pressure = scale - (reclaimed * scale / scanned);
+	pressure = pressure * 100 / scale;
+
+out:
+	pr_debug("%s: %3lu  (s: %lu  r: %lu)\n", __func__, pressure,
+		 scanned, reclaimed);
+
+	return vmpressure_level(pressure);
+}
+
+static void vmpressure_event(struct vmpressure *vmpr,
+			     enum vmpressure_levels level)
+{
+	spin_lock(&vmpr->sr_lock);
+	vmpr->level = level;
+	vmpr->events++;
+	spin_unlock(&vmpr->sr_lock);
+
+	wake_up_interruptible(&vmpr->wait);
+}
+
+static void vmpressure_work_fn(struct work_struct *work)
+{
+	struct vmpressure *vmpr = work_to_vmpressure(work);
+	unsigned long scanned;
+	unsigned long reclaimed;
+	enum vmpressure_levels level;
+
+	spin_lock(&vmpr->sr_lock);
+	/*
+	 * Several contexts might be calling vmpressure(), so it is
+	 * possible that the work was rescheduled again before the old
+	 * work context cleared the counters. In that case we will run
+	 * just after the old work returns, but then scanned might be zero
+	 * here.
+	 */
+	scanned = vmpr->scanned;
+	if (!scanned) {
+		spin_unlock(&vmpr->sr_lock);
+		return;
+	}
+	reclaimed = vmpr->reclaimed;
+	vmpr->scanned = 0;
+	vmpr->reclaimed = 0;
+	spin_unlock(&vmpr->sr_lock);
+
+	level = vmpressure_calc_level(scanned, reclaimed);
+
+	/* Pressure in a cgroup is also pressure on the cgroups above it. */
+	do {
+		vmpressure_event(vmpr, level);
+	} while ((vmpr = vmpressure_parent(vmpr)));
+}
+
+/**
+ * vmpressure() - Account memory pressure through scanned/reclaimed ratio
+ * @gfp:	reclaimer's gfp mask
+ * @memcg:	cgroup memory controller handle, NULL for global reclaim
+ * @scanned:	number of pages scanned
+ * @reclaimed:	number of pages reclaimed
+ *
+ * This function should be called from the vmscan reclaim path to account
+ * "instantaneous" memory pressure (scanned/reclaimed ratio). The level
+ * is computed from a work item once vmpressure_win pages were scanned.
+ *
+ * This function does not return any value.
+ */
+void vmpressure(gfp_t gfp, struct mem_cgroup *memcg,
+		unsigned long scanned, unsigned long reclaimed)
+{
+	struct vmpressure *vmpr;
+
+	vmpr = memcg ? memcg_to_vmpressure(memcg) : &global_vmpressure;
+	if (!vmpr)
+		return;
+
+	/*
+	 * Here we only want to account pressure that userland is able to
+	 * help us with. For example, suppose that DMA zone is under
+	 * pressure; if we notify userland about that kind of pressure,
+	 * then it will be mostly a waste as it will trigger unnecessary
+	 * freeing of memory by userland (since userland is more likely to
+	 * have HIGHMEM/MOVABLE pages instead of the DMA fallback). That
+	 * is why we include only movable, highmem and FS/IO pages.
+	 * Indirect reclaim (kswapd) sets sc->gfp_mask to GFP_KERNEL, so
+	 * we account it too.
+	 */
+	if (!(gfp & (__GFP_HIGHMEM | __GFP_MOVABLE | __GFP_IO | __GFP_FS)))
+		return;
+
+	/*
+	 * If we got here with no pages scanned, then that is an indicator
+	 * that reclaimer was unable to find any shrinkable LRUs at the
+	 * current scanning depth. But it does not mean that we should
+	 * report the critical pressure, yet. If the scanning priority
+	 * (scanning depth) goes too high (deep), we will be notified
+	 * through vmpressure_prio(). But so far, keep calm.
+	 */
+	if (!scanned)
+		return;
+
+	spin_lock(&vmpr->sr_lock);
+	vmpr->scanned += scanned;
+	vmpr->reclaimed += reclaimed;
+	scanned = vmpr->scanned;
+	spin_unlock(&vmpr->sr_lock);
+
+	if (scanned < vmpressure_win)
+		return;
+	schedule_work(&vmpr->work);
+}
+
+/**
+ * vmpressure_prio() - Account memory pressure through reclaimer priority level
+ * @gfp:	reclaimer's gfp mask
+ * @memcg:	cgroup memory controller handle, NULL for global reclaim
+ * @prio:	reclaimer's priority
+ *
+ * This function should be called from the reclaim path every time when
+ * the vmscan's reclaiming priority (scanning depth) changes.
+ *
+ * This function does not return any value.
+ */
+void vmpressure_prio(gfp_t gfp, struct mem_cgroup *memcg, int prio)
+{
+	/*
+	 * We only use prio for accounting critical level. For more info
+	 * see comment for vmpressure_level_critical_prio variable above.
+	 */
+	if (prio > vmpressure_level_critical_prio)
+		return;
+
+	/*
+	 * OK, the prio is below the threshold, updating vmpressure
+	 * information before shrinker dives into long shrinking of long
+	 * range vmscan. Passing scanned = vmpressure_win, reclaimed = 0
+	 * to the vmpressure() basically means that we signal 'critical'
+	 * level.
+	 */
+	vmpressure(gfp, memcg, vmpressure_win, 0);
+}
+
+/**
+ * vmpressure_init() - Initialize vmpressure control structure
+ * @vmpr:	Structure to be initialized
+ *
+ * This function should be called on every allocated vmpressure structure
+ * before any usage.
+ */
+void vmpressure_init(struct vmpressure *vmpr)
+{
+	spin_lock_init(&vmpr->sr_lock);
+	init_waitqueue_head(&vmpr->wait);
+	INIT_WORK(&vmpr->work, vmpressure_work_fn);
+	vmpr->scanned = 0;
+	vmpr->reclaimed = 0;
+	vmpr->level = VMPRESSURE_LOW;
+	vmpr->events = 0;
+}
+
+/**
+ * vmpressure_cleanup() - shuts down vmpressure control structure
+ * @vmpr:	Structure to be cleaned up
+ *
+ * This should be called before the structure is freed, to make sure
+ * that a pending work item does not touch it afterwards.
+ */
+void vmpressure_cleanup(struct vmpressure *vmpr)
+{
+	cancel_work_sync(&vmpr->work);
+}
+
+/*
+ * Every open file remembers how many events it has seen, plus one, in
+ * file->private_data; zero means the file has not been armed yet.  The
+ * first poll() or read() arms it.  From then on poll() reports the file
+ * readable as soon as a newer level was computed, and reading it (from
+ * offset 0, as for sysfs attributes) returns the level name and rearms
+ * the notification.
+ */
+static unsigned long vmpressure_file_arm(struct vmpressure *vmpr,
+					 struct file *file, int force)
+{
+	unsigned long seen = (unsigned long)file->private_data;
+
+	if (force || !seen) {
+		seen = vmpr->events + 1;
+		file->private_data = (void *)seen;
+	}
+	return seen - 1;
+}
+
+ssize_t vmpressure_file_read(struct vmpressure *vmpr, struct file *file,
+			     char __user *buf, size_t nbytes, loff_t *ppos)
+{
+	char tmp[16];
+	enum vmpressure_levels level;
+	int len;
+
+	spin_lock(&vmpr->sr_lock);
+	level = vmpr->level;
+	vmpressure_file_arm(vmpr, file, 1);
+	spin_unlock(&vmpr->sr_lock);
+
+	len = snprintf(tmp, sizeof(tmp), "%s\n", vmpressure_str_levels[level]);
+	return simple_read_from_buffer(buf, nbytes, ppos, tmp, len);
+}
+
+unsigned int vmpressure_file_poll(struct vmpressure *vmpr, struct file *file,
+				  struct poll_table_struct *pt)
+{
+	unsigned long seen;
+
+	poll_wait(file, &vmpr->wait, pt);
+
+	spin_lock(&vmpr->sr_lock);
+	seen = vmpressure_file_arm(vmpr, file, 0);
+	spin_unlock(&vmpr->sr_lock);
+
+	if (vmpr->events != seen)
+		return POLLIN | POLLRDNORM | POLLPRI;
+	return 0;
+}
+
+#ifdef CONFIG_PROC_FS
+static ssize_t vmpressure_proc_read(struct file *file, char __user *buf,
+				    size_t nbytes, loff_t *ppos)
+{
+	return vmpressure_file_read(&global_vmpressure, file, buf, nbytes,
+				    ppos);
+}
+
+static unsigned int vmpressure_proc_poll(struct file *file, poll_table *pt)
+{
+	return vmpressure_file_poll(&global_vmpressure, file, pt);
+}
+
+static const struct file_operations proc_vmpressure_file_operations = {
+	.read		= vmpressure_proc_read,
+	.poll		= vmpressure_proc_poll,
+	.llseek		= generic_file_llseek,
+};
+
+static int __init vmpressure_proc_init(void)
+{
+	proc_create("vmpressure", S_IRUGO, NULL,
+		    &proc_vmpressure_file_operations);
+	return 0;
+}
+module_init(vmpressure_proc_init)
+#endif /* CONFIG_PROC_FS */
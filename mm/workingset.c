@@ -0,0 +1,255 @@
+/*
+ * linux/mm/workingset.c
+ *
+ * Working set detection for the page cache.
+ *
+ * The file LRU lists only know about pages that are in memory.  When a
+ * large stream of used-once pages (a video being played, a big file being
+ * copied) goes through the inactive list, the pages that make up the
+ * working set of other tasks are pushed out with it, and when they are
+ * faulted back in they start at the bottom of the inactive list again, to
+ * be evicted by the stream the next time around.  The cache thrashes even
+ * though the working set would comfortably fit into the active list.
+ *
+ * To break this, reclaim leaves a shadow entry in the page cache radix tree
+ * slot of every file page it evicts.  The shadow records the zone and the
+ * zone's inactive_age at eviction time; inactive_age is a clock that ticks
+ * for every eviction and every activation, i.e. for every page that leaves
+ * the inactive list.
+ *
+ * When the page is faulted back in, the difference between the current
+ * inactive_age and the one recorded in the shadow is the number of pages
+ * that left the inactive list while the page was out of memory: its
+ * refault distance.  Had the inactive list been that much bigger, the
+ * page would have been activated instead of evicted.  The inactive list
+ * can only grow at the cost of the active list, so if the refault
+ * distance is not bigger than the active file list the page is taken to
+ * be part of the working set and goes straight onto the active list,
+ * where it competes with the established active pages on equal terms.
+ *
+ * Shadow entries are dropped when the slot is refilled or the file is
+ * truncated.  Until then they pin the radix tree nodes they sit in, even
+ * when a mapping has no pages left at all, so the mappings that hold
+ * shadows are kept on a list and a shrinker drops their shadows under
+ * memory pressure.
+ */
+
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/swap.h>
+#include <linux/vmstat.h>
+#include <linux/pagevec.h>
+#include <linux/module.h>
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction;
+	unsigned long refault;
+	int zid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	*zone = NODE_DATA(entry & ((1UL << NODES_SHIFT) - 1))->node_zones + zid;
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+
+	/*
+	 * The unsigned subtraction here gives an accurate distance
+	 * across inactive_age overflows in most cases.
+	 *
+	 * There is a special case: usually, shadow entries have a short
+	 * lifetime and are either refaulted or reclaimed along with the
+	 * inode before they get too old.  But it is not impossible for
+	 * the inactive_age to lap a shadow entry in the field, which can
+	 * then result in a false small refault distance, leading to a
+	 * false activation should this old entry actually refault again.
+	 * However, earlier kernels used to deactivate unconditionally
+	 * with *every* reclaim invocation for the longest time, so the
+	 * occasional inappropriate activation leading to pressure on the
+	 * active list is not a problem.
+	 */
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns non-zero if the page should be activated, zero otherwise.
+ */
+int workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * Mappings with shadow entries, and the total number of shadows.  The
+ * lock nests inside mapping->tree_lock, the shrinker only trylocks the
+ * tree_lock of the mappings it finds on the list.  A mapping is on the
+ * list for as long as it has shadows, and clear_inode() drops those
+ * before the mapping goes away.
+ */
+static LIST_HEAD(shadow_mappings);
+static DEFINE_SPINLOCK(shadow_mappings_lock);
+static unsigned long nr_shadow_mappings;
+static atomic_long_t nr_shadows = ATOMIC_LONG_INIT(0);
+
+/**
+ * workingset_shadow_added - account a shadow entry stored in @mapping
+ * @mapping: address space, with its tree_lock held
+ */
+void workingset_shadow_added(struct address_space *mapping)
+{
+	atomic_long_inc(&nr_shadows);
+	if (mapping->nrshadows++)
+		return;
+	spin_lock(&shadow_mappings_lock);
+	list_add_tail(&mapping->shadow_list, &shadow_mappings);
+	nr_shadow_mappings++;
+	spin_unlock(&shadow_mappings_lock);
+}
+
+static void __workingset_shadow_removed(struct address_space *mapping)
+{
+	atomic_long_dec(&nr_shadows);
+	if (--mapping->nrshadows)
+		return;
+	list_del_init(&mapping->shadow_list);
+	nr_shadow_mappings--;
+}
+
+/**
+ * workingset_shadow_removed - account a shadow entry gone from @mapping
+ * @mapping: address space, with its tree_lock held
+ */
+void workingset_shadow_removed(struct address_space *mapping)
+{
+	if (mapping->nrshadows > 1) {
+		atomic_long_dec(&nr_shadows);
+		mapping->nrshadows--;
+		return;
+	}
+	spin_lock(&shadow_mappings_lock);
+	__workingset_shadow_removed(mapping);
+	spin_unlock(&shadow_mappings_lock);
+}
+
+/*
+ * Drop up to @nr_to_scan shadows of @mapping, lowest index first.
+ * Called with the mapping's tree_lock and shadow_mappings_lock held.
+ */
+static int shrink_mapping_shadows(struct address_space *mapping,
+				  int nr_to_scan)
+{
+	void *shadows[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned int nr, i;
+	int freed = 0;
+
+	while (mapping->nrshadows && freed < nr_to_scan) {
+		nr = min_t(unsigned int, PAGEVEC_SIZE, nr_to_scan - freed);
+		nr = radix_tree_gang_lookup_exceptional(&mapping->page_tree,
+						shadows, indices, 0, nr);
+		if (!nr)
+			break;
+		for (i = 0; i < nr; i++) {
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			__workingset_shadow_removed(mapping);
+			freed++;
+		}
+	}
+	return freed;
+}
+
+static int shrink_shadows(int nr_to_scan, gfp_t gfp_mask)
+{
+	struct address_space *mapping;
+	unsigned long nr_mappings;
+
+	if (nr_to_scan) {
+		spin_lock_irq(&shadow_mappings_lock);
+		nr_mappings = nr_shadow_mappings;
+		while (nr_to_scan > 0 && nr_mappings--) {
+			mapping = list_first_entry(&shadow_mappings,
+					struct address_space, shadow_list);
+			/* rotate, so that busy mappings don't stall us */
+			list_move_tail(&mapping->shadow_list, &shadow_mappings);
+			if (!spin_trylock(&mapping->tree_lock))
+				continue;
+			nr_to_scan -= shrink_mapping_shadows(mapping,
+							     nr_to_scan);
+			spin_unlock(&mapping->tree_lock);
+		}
+		spin_unlock_irq(&shadow_mappings_lock);
+	}
+	return min_t(long, atomic_long_read(&nr_shadows), INT_MAX);
+}
+
+static struct shrinker workingset_shadow_shrinker = {
+	.shrink = shrink_shadows,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	register_shrinker(&workingset_shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);
@@ -94,6 +94,15 @@ int __init security_module_enable(struct security_operations *ops)
 	return 1;
 }
 
+/**
+ * security_module_registered - is a security module other than the
+ * default capabilities one in charge?
+ */
+int security_module_registered(void)
+{
+	return security_ops != &default_security_ops;
+}
+
 /**
  * register_security - registers a security framework with the kernel
  * @ops: a pointer to the struct security_options that is to be registered